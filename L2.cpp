@@ -4,109 +4,118 @@
  */
 
 #include "L2.h"
+#include "flow_stats.hpp"
+#include "flow_trace.hpp"
 #include "L3.h"
-#include <sstream>
+#include "checksum.hpp"
 #include <iomanip>
 #include <cstring>
 #include <cstdint>
 
-l2_packet::l2_packet(const std::string& packet_str) : packet_data(packet_str) {
-    parse_packet();
+l2_packet::l2_packet(field_view packet_str, checksum_mode checksum,
+                     const route_table *routes, nat_table *nat)
+    : packet_data(packet_str), parsed(false), checksum_check(checksum),
+      routes(routes), nat(nat) {
+    parsed = parse_packet();
 }
 
-void l2_packet::parse_packet() {
+l2_packet::l2_packet(field_view packet_str, const packet_record *rec,
+                     checksum_mode checksum, const route_table *routes,
+                     nat_table *nat)
+    : packet_data(packet_str), parsed(rec != nullptr), checksum_check(checksum),
+      routes(routes), nat(nat) {
+    if (parsed) {
+        record = *rec;
+    }
+}
+
+bool l2_packet::parse_packet() {
     // Format: src_mac|dst_mac|...|checksum
-    std::istringstream iss(packet_data);
-    std::string token;
-    
+    field_tokenizer tokens(packet_data, '|');
+    field_view token;
+
     // Parse source MAC
-    std::getline(iss, token, '|');
-    std::istringstream mac_iss(token);
-    std::string mac_part;
-    int i = 0;
-    while (std::getline(mac_iss, mac_part, ':') && i < MAC_SIZE) {
-        src_mac[i++] = std::stoi(mac_part, nullptr, 16);
+    if (!tokens.next(token) ||
+        parse_address(token, ':', 16, record.src_mac, MAC_SIZE) != PARSE_OK) {
+        return false;
     }
-    
+
     // Parse destination MAC
-    std::getline(iss, token, '|');
-    mac_iss.clear();
-    mac_iss.str(token);
-    i = 0;
-    while (std::getline(mac_iss, mac_part, ':') && i < MAC_SIZE) {
-        dst_mac[i++] = std::stoi(mac_part, nullptr, 16);
+    if (!tokens.next(token) ||
+        parse_address(token, ':', 16, record.dst_mac, MAC_SIZE) != PARSE_OK) {
+        return false;
     }
-    
+
     // Get the rest of the data (L3 packet)
-    std::getline(iss, l3_data);
+    field_view l3_data = tokens.rest();
     
     // Extract checksum from the end
-    size_t last_pipe = l3_data.find_last_of('|');
-    if (last_pipe != std::string::npos) {
-        std::string checksum_str = l3_data.substr(last_pipe + 1);
-        checksum = std::stoi(checksum_str, nullptr, 16);
-        l3_data = l3_data.substr(0, last_pipe);
+    size_t last_pipe = l3_data.rfind('|');
+    if (last_pipe == field_view::npos ||
+        parse_u16(l3_data.substr(last_pipe + 1), record.l2_checksum, 16) != PARSE_OK) {
+        return false;
     }
+    record.l3_text = l3_data.substr(0, last_pipe);
+
+    // Parse the carried L3 packet once, L3 and L4 work on the record
+    return l3_packet::parse_fields(record.l3_text, record);
 }
 
-bool l2_packet::validate_packet(open_port_vec open_ports,
-                               uint8_t ip[IP_V4_SIZE],
-                               uint8_t mask,
+bool l2_packet::validate_packet(const open_port_vec & /* open_ports */,
+                               uint8_t /* ip */[IP_V4_SIZE],
+                               uint8_t /* mask */,
                                uint8_t mac[MAC_SIZE]) {
+    NIC_TRACE_SCOPE("l2.validate");
+    if (!parsed) {
+        count(STAT_PARSE_ERROR);
+        return false;
+    }
+
     // Check if destination MAC matches NIC's MAC
     for (int i = 0; i < MAC_SIZE; i++) {
-        if (dst_mac[i] != mac[i]) {
+        if (record.dst_mac[i] != mac[i]) {
+            count(STAT_L2_MAC_MISMATCH);
             return false;
         }
     }
     
-    // Temporarily disable checksum validation for testing
-    // return validate_checksum();
+    // Checksum validation is selected at runtime
+    if (checksum_check == CHECKSUM_VERIFY && !validate_checksum()) {
+        count(STAT_L2_BAD_CHECKSUM);
+        return false;
+    }
     return true;
 }
 
 bool l2_packet::validate_checksum() {
     // Simple checksum validation - in real implementation this would be more complex
-    uint16_t calculated_checksum = 0;
-    for (int i = 0; i < MAC_SIZE; i++) {
-        calculated_checksum += src_mac[i] + dst_mac[i];
-    }
+    uint32_t calculated_checksum = checksum_bytes(record.src_mac, MAC_SIZE) +
+                                   checksum_bytes(record.dst_mac, MAC_SIZE);
     
     // Add L3 data to checksum calculation
-    for (char c : l3_data) {
-        calculated_checksum += static_cast<uint8_t>(c);
-    }
+    calculated_checksum += checksum_text(record.l3_text);
     
-    return (calculated_checksum & 0xFFFF) == checksum;
+    return (calculated_checksum & 0xFFFF) == record.l2_checksum;
 }
 
 bool l2_packet::proccess_packet(open_port_vec &open_ports,
                                uint8_t ip[IP_V4_SIZE],
-                               uint8_t mask,
                                memory_dest &dst) {
-    // Strip L2 headers and pass to L3
-    // Create L3 packet from the L3 data
-    l3_packet l3_pkt(l3_data);
-    
-    // Validate and process L3 packet
-    if (!l3_pkt.validate_packet(open_ports, ip, mask, nullptr)) {
+    NIC_TRACE_SCOPE("l2.process");
+    if (!parsed) {
         return false;
     }
-    
-    bool result = l3_pkt.proccess_packet(open_ports, ip, mask, dst);
-    
-    // Update the L3 data with the processed packet
-    if (result) {
-        l3_pkt.as_string(l3_data);
+
+    // Strip L2 headers and pass to L3, the L3 fields are already in the record
+    if (!l3_packet::validate_record(record, checksum_check)) {
+        return false;
     }
     
-    return result;
+    return l3_packet::process_record(record, open_ports, ip, routes, nat, dst);
 }
 
 bool l2_packet::as_string(std::string &packet) {
-    packet.clear();
     // For TQ output, we should output L3 format (without MAC addresses)
-    // The l3_data already contains the L3 packet in the correct format
-    packet = l3_data;
+    l3_packet::format_record(record, packet);
     return true;
-} 
\ No newline at end of file
+}
@@ -11,31 +11,61 @@
 
 #include <cstdint>
 #include "packets.hpp"
+#include "route_table.hpp"
+#include "nat_table.hpp"
 
-class l2_packet : public generic_packet {
+class l2_packet final : public generic_packet {
 public:
     /**
      * @fn l2_packet
      * @brief Constructor for L2 packet.
      * 
      * @param packet_str - String representation of the L2 packet.
+     * @param checksum - Whether validate_packet checks the checksums.
+     * @param routes - Routing table of the NIC, nullptr routes everything
+     *        to TQ.
+     * @param nat - Connection tracking of the NIC, nullptr translates
+     *        sources without tracking them.
+     *
+     * @return New L2 packet object.
+     *
+     * @note The packet keeps views into 'packet_str' and pointers to
+     *       'routes' and 'nat', which must outlive it.
+     */
+    l2_packet(field_view packet_str,
+              checksum_mode checksum = CHECKSUM_OFF,
+              const route_table *routes = nullptr,
+              nat_table *nat = nullptr);
+
+    /**
+     * @fn l2_packet
+     * @brief Constructor for a packet parsed ahead of time, adopts the
+     *        record parsed from 'packet_str' instead of parsing it again.
+     *
+     * @param packet_str - String representation of the packet.
+     * @param rec - The packet's record, nullptr if it didn't parse.
+     * @param checksum, routes, nat - See above.
      *
      * @return New L2 packet object.
      */
-    l2_packet(const std::string& packet_str);
+    l2_packet(field_view packet_str,
+              const packet_record *rec,
+              checksum_mode checksum,
+              const route_table *routes,
+              nat_table *nat);
 
     /**
      * @fn validate_packet
      * @brief Validates the L2 packet by checking destination MAC and checksum.
      *
-     * @param open_ports - Vector containing all the NIC's open ports.
+     * @param open_ports - Flow table of all the NIC's open ports.
      * @param ip - NIC's IP address.
      * @param mask - NIC's mask.
      * @param mac - NIC's MAC address.
      *
      * @return true if the packet is valid, false otherwise.
      */
-    bool validate_packet(open_port_vec open_ports,
+    bool validate_packet(const open_port_vec &open_ports,
                         uint8_t ip[IP_V4_SIZE],
                         uint8_t mask,
                         uint8_t mac[MAC_SIZE]) override;
@@ -44,16 +74,14 @@ public:
      * @fn proccess_packet
      * @brief Processes the L2 packet by stripping L2 headers and passing to L3.
      *
-     * @param open_ports - Vector containing all the NIC's open ports.
+     * @param open_ports - Flow table of all the NIC's open ports.
      * @param ip - NIC's IP address.
-     * @param mask - NIC's mask.
      * @param dst - Reference to memory destination enum.
      *
      * @return true on success, false on failure.
      */
     bool proccess_packet(open_port_vec &open_ports,
                         uint8_t ip[IP_V4_SIZE],
-                        uint8_t mask,
                         memory_dest &dst) override;
 
     /**
@@ -66,18 +94,43 @@ public:
      */
     bool as_string(std::string &packet) override;
 
+    /**
+     * @fn queued_record
+     * @brief Gives the processed packet to RQ/TQ without formatting it.
+     *
+     * @return The packet's record, nullptr if it wasn't parsed.
+     */
+    const packet_record *queued_record() const {
+        return parsed ? &record : nullptr;
+    }
+
+    /**
+     * @fn batch_record
+     * @brief Gives the parsed record to nic_sim::process_batch, which
+     *        processes it in place.
+     *
+     * @return The packet's record, nullptr if it wasn't parsed.
+     */
+    packet_record *batch_record() {
+        return parsed ? &record : nullptr;
+    }
+
 private:
-    std::string packet_data;
-    uint8_t src_mac[MAC_SIZE];
-    uint8_t dst_mac[MAC_SIZE];
-    std::string l3_data;
-    uint16_t checksum;
+    field_view packet_data;
+    packet_record record;
+    bool parsed;
+    checksum_mode checksum_check;
+    const route_table *routes;
+    nat_table *nat;
 
     /**
      * @fn parse_packet
-     * @brief Parses the packet string to extract L2 fields.
+     * @brief Parses the packet string to extract the L2 fields and the
+     *        carried L3 packet.
+     *
+     * @return true on success, false if a field is malformed.
      */
-    void parse_packet();
+    bool parse_packet();
 
     /**
      * @fn validate_checksum
@@ -88,4 +141,4 @@ private:
     bool validate_checksum();
 };
 
-#endif 
\ No newline at end of file
+#endif
@@ -4,265 +4,288 @@
  */
 
 #include "L3.h"
+#include "flow_stats.hpp"
+#include "flow_trace.hpp"
 #include "L4.h"
+#include "hex_decode.hpp"
+#include "checksum.hpp"
 #include <iostream>
 #include <iomanip>
 #include <cstring>
 #include <cstdint>
 
-l3_packet::l3_packet(const std::string& packet_str) : packet_data(packet_str) {
-    parse_packet();
+l3_packet::l3_packet(field_view packet_str, checksum_mode checksum,
+                     const route_table *routes, nat_table *nat)
+    : packet_data(packet_str), parsed(false), checksum_check(checksum),
+      routes(routes), nat(nat) {
+    parsed = parse_fields(packet_data, record);
 }
 
-void l3_packet::parse_packet() {
+l3_packet::l3_packet(field_view packet_str, const packet_record *rec,
+                     checksum_mode checksum, const route_table *routes,
+                     nat_table *nat)
+    : packet_data(packet_str), parsed(rec != nullptr), checksum_check(checksum),
+      routes(routes), nat(nat) {
+    if (parsed) {
+        record = *rec;
+    }
+}
+
+bool l3_packet::parse_fields(field_view text, packet_record &rec) {
     // Format: src_ip|dst_ip|ttl|checksum|src_port|dst_port|index|data
-    size_t start = 0, end = 0;
-    int field = 0;
-    std::string fields[7];
+    field_tokenizer tokens(text, '|');
+    field_view fields[6];
     for (int i = 0; i < 6; ++i) {
-        end = packet_data.find('|', start);
-        if (end == std::string::npos) {
-            std::cerr << "Error: Not enough fields in L3 packet: " << packet_data << std::endl;
-            return;
+        if (!tokens.next(fields[i]) || tokens.done()) {
+            std::cerr << "Error: Not enough fields in L3 packet: " << text.str() << std::endl;
+            return false;
         }
-        fields[i] = packet_data.substr(start, end - start);
-        start = end + 1;
     }
-    fields[6] = packet_data.substr(start);
 
     // Parse src_ip
-    int ip_idx = 0, ip_start = 0, ip_end = 0;
-    std::string ip_part;
-    for (int i = 0; i < IP_V4_SIZE; ++i) {
-        ip_end = fields[0].find('.', ip_start);
-        if (ip_end == std::string::npos && i < IP_V4_SIZE - 1) {
-            std::cerr << "Error: Not enough parts in src_ip: " << fields[0] << std::endl;
-            return;
-        }
-        ip_part = (ip_end == std::string::npos) ? fields[0].substr(ip_start) : fields[0].substr(ip_start, ip_end - ip_start);
-        try {
-            src_ip[i] = static_cast<uint8_t>(std::stoi(ip_part));
-        } catch (...) {
-            std::cerr << "Error: Invalid src_ip part: " << ip_part << std::endl;
-            return;
-        }
-        ip_start = ip_end + 1;
+    if (parse_address(fields[0], '.', 10, rec.src_ip, IP_V4_SIZE) != PARSE_OK) {
+        std::cerr << "Error: Invalid src_ip: " << fields[0].str() << std::endl;
+        return false;
     }
     // Parse dst_ip
-    ip_start = 0;
-    for (int i = 0; i < IP_V4_SIZE; ++i) {
-        ip_end = fields[1].find('.', ip_start);
-        if (ip_end == std::string::npos && i < IP_V4_SIZE - 1) {
-            std::cerr << "Error: Not enough parts in dst_ip: " << fields[1] << std::endl;
-            return;
-        }
-        ip_part = (ip_end == std::string::npos) ? fields[1].substr(ip_start) : fields[1].substr(ip_start, ip_end - ip_start);
-        try {
-            dst_ip[i] = static_cast<uint8_t>(std::stoi(ip_part));
-        } catch (...) {
-            std::cerr << "Error: Invalid dst_ip part: " << ip_part << std::endl;
-            return;
-        }
-        ip_start = ip_end + 1;
+    if (parse_address(fields[1], '.', 10, rec.dst_ip, IP_V4_SIZE) != PARSE_OK) {
+        std::cerr << "Error: Invalid dst_ip: " << fields[1].str() << std::endl;
+        return false;
     }
     // TTL
-    try {
-        ttl = static_cast<uint8_t>(std::stoi(fields[2]));
-    } catch (...) {
-        std::cerr << "Error: Invalid TTL: " << fields[2] << std::endl;
-        return;
+    if (parse_u8(fields[2], rec.ttl) != PARSE_OK) {
+        std::cerr << "Error: Invalid TTL: " << fields[2].str() << std::endl;
+        return false;
     }
     // Checksum
-    try {
-        checksum = static_cast<uint16_t>(std::stoi(fields[3]));
-    } catch (...) {
-        std::cerr << "Error: Invalid checksum: " << fields[3] << std::endl;
-        return;
+    if (parse_u16(fields[3], rec.l3_checksum) != PARSE_OK) {
+        std::cerr << "Error: Invalid checksum: " << fields[3].str() << std::endl;
+        return false;
     }
     // src_port
-    try {
-        src_port = static_cast<uint16_t>(std::stoi(fields[4]));
-    } catch (...) {
-        std::cerr << "Error: Invalid src_port: " << fields[4] << std::endl;
-        return;
+    if (parse_u16(fields[4], rec.src_port) != PARSE_OK) {
+        std::cerr << "Error: Invalid src_port: " << fields[4].str() << std::endl;
+        return false;
     }
     // dst_port
-    try {
-        dst_port = static_cast<uint16_t>(std::stoi(fields[5]));
-    } catch (...) {
-        std::cerr << "Error: Invalid dst_port: " << fields[5] << std::endl;
-        return;
+    if (parse_u16(fields[5], rec.dst_port) != PARSE_OK) {
+        std::cerr << "Error: Invalid dst_port: " << fields[5].str() << std::endl;
+        return false;
     }
-    // l4_data (index|data)
-    l4_data = fields[6];
+    // L4 part (index|data). Forwarded packets keep a malformed one as it
+    // came, packets to the NIC are rejected by the L4 validation
+    l4_packet::parse_payload(tokens.rest(), rec, false);
+    return true;
 }
 
-bool l3_packet::validate_packet(open_port_vec open_ports,
-                               uint8_t ip[IP_V4_SIZE],
-                               uint8_t mask,
-                               uint8_t mac[MAC_SIZE]) {
+bool l3_packet::validate_packet(const open_port_vec & /* open_ports */,
+                               uint8_t /* ip */[IP_V4_SIZE],
+                               uint8_t /* mask */,
+                               uint8_t /* mac */[MAC_SIZE]) {
+    if (!parsed) {
+        count(STAT_PARSE_ERROR);
+        return false;
+    }
+    return validate_record(record, checksum_check);
+}
+
+bool l3_packet::validate_record(const packet_record &rec,
+                                checksum_mode checksum) {
+    NIC_TRACE_SCOPE("l3.validate");
     // Check TTL > 0
-    if (ttl <= 0) {
+    if (rec.ttl <= 0) {
+        count(STAT_L3_TTL_EXPIRED);
         return false;
     }
     
-    // Temporarily disable checksum validation for testing
-    // bool checksum_valid = validate_checksum();
-    // if (!checksum_valid) {
-    //     return false;
-    // }
+    // Checksum validation is selected at runtime
+    if (checksum == CHECKSUM_VERIFY && !validate_checksum(rec)) {
+        count(STAT_L3_BAD_CHECKSUM);
+        return false;
+    }
     
     return true;
 }
 
-bool l3_packet::validate_checksum() {
+bool l3_packet::validate_checksum(const packet_record &rec) {
     // Simple checksum validation
-    uint16_t calculated_checksum = 0;
-    for (int i = 0; i < IP_V4_SIZE; i++) {
-        calculated_checksum += src_ip[i] + dst_ip[i];
-    }
-    calculated_checksum += ttl + dst_port + src_port;
+    uint32_t calculated_checksum = checksum_bytes(rec.src_ip, IP_V4_SIZE) +
+                                   checksum_bytes(rec.dst_ip, IP_V4_SIZE);
+    calculated_checksum += rec.ttl + rec.dst_port + rec.src_port;
     
     // Add L4 data to checksum calculation
-    for (char c : l4_data) {
-        calculated_checksum += static_cast<uint8_t>(c);
-    }
-    
-    uint16_t final_checksum = calculated_checksum & 0xFFFF;
-    
-    std::cout << "    Checksum validation: expected=" << checksum << ", calculated=" << final_checksum << std::endl;
+    calculated_checksum += checksum_text(rec.l4_text);
     
-    return final_checksum == checksum;
+    return (calculated_checksum & 0xFFFF) == rec.l3_checksum;
+}
+
+void l3_packet::rewrite_port(packet_record &rec, uint16_t &port, uint16_t value) {
+    rec.l3_checksum = checksum_update_word(rec.l3_checksum, port, value);
+    port = value;
 }
 
-bool l3_packet::is_local_network(uint8_t nic_ip[IP_V4_SIZE], uint8_t mask) {
-    // Check if destination IP is in the same subnet
+bool l3_packet::is_targeted_to_nic(const packet_record &rec,
+                                   const uint8_t nic_ip[IP_V4_SIZE]) {
+    // Check if destination IP matches NIC's IP
     for (int i = 0; i < IP_V4_SIZE; i++) {
-        uint8_t mask_byte = (i < mask / 8) ? 0xFF : 
-                           (i == mask / 8) ? (0xFF << (8 - (mask % 8))) : 0x00;
-        if ((dst_ip[i] & mask_byte) != (nic_ip[i] & mask_byte)) {
+        if (rec.dst_ip[i] != nic_ip[i]) {
             return false;
         }
     }
     return true;
 }
 
-bool l3_packet::is_targeted_to_nic(uint8_t nic_ip[IP_V4_SIZE]) {
-    // Check if destination IP matches NIC's IP
+void l3_packet::rewrite_src_ip(packet_record &rec,
+                               const uint8_t new_ip[IP_V4_SIZE]) {
+    // Only the source IP changes, so the checksum is patched with its delta
+    rec.l3_checksum = checksum_update(rec.l3_checksum, rec.src_ip, new_ip,
+                                      IP_V4_SIZE);
     for (int i = 0; i < IP_V4_SIZE; i++) {
-        if (dst_ip[i] != nic_ip[i]) {
-            return false;
-        }
+        rec.src_ip[i] = new_ip[i];
     }
-    return true;
 }
 
 bool l3_packet::proccess_packet(open_port_vec &open_ports,
                                uint8_t ip[IP_V4_SIZE],
-                               uint8_t mask,
                                memory_dest &dst) {
-    // Decrement TTL
-    ttl--;
-    
-    // Update checksum after TTL change
-    checksum = (checksum - 1) & 0xFFFF;
-    
+    if (!parsed) {
+        return false;
+    }
+    return process_record(record, open_ports, ip, routes, nat, dst);
+}
+
+bool l3_packet::process_record(packet_record &rec,
+                               open_port_vec &open_ports,
+                               uint8_t ip[IP_V4_SIZE],
+                               const route_table *routes,
+                               nat_table *nat,
+                               memory_dest &dst) {
+    NIC_TRACE_SCOPE("l3.process");
+    // A packet whose TTL runs out with the decrement is dropped
+    if (rec.ttl <= 1) {
+        count(STAT_L3_TTL_EXPIRED);
+        return false;
+    }
+
+    // Decrement TTL and update checksum after TTL change
+    uint8_t old_ttl = rec.ttl--;
+    rec.l3_checksum = checksum_update(rec.l3_checksum, old_ttl, rec.ttl);
+
+    bool to_nic = is_targeted_to_nic(rec, ip);
+    route_action route = (to_nic || routes == nullptr) ? ROUTE_TQ :
+                         routes->lookup(ip_to_u32(rec.dst_ip));
+    return forward_record(rec, open_ports, ip, routes, nat, to_nic, route, dst);
+}
+
+bool l3_packet::forward_record(packet_record &rec,
+                               open_port_vec &open_ports,
+                               uint8_t ip[IP_V4_SIZE],
+                               const route_table *routes,
+                               nat_table *nat,
+                               bool to_nic,
+                               route_action route,
+                               memory_dest &dst) {
     // Check if packet is targeted to this NIC
-    if (is_targeted_to_nic(ip)) {
+    uint32_t local_ip;
+    uint16_t local_port;
+    if (to_nic &&
+        nat != nullptr &&
+        nat->translate_in(ip_to_u32(rec.src_ip), rec.src_port, rec.dst_port,
+                          local_ip, local_port)) {
+        // Reply of a NAT connection, translate it back to the local
+        // endpoint and route it there
+        count(STAT_NAT_REVERSE);
+        uint8_t local_bytes[IP_V4_SIZE];
+        u32_to_ip(local_ip, local_bytes);
+        rec.l3_checksum = checksum_update(rec.l3_checksum, rec.dst_ip, local_bytes,
+                                          IP_V4_SIZE);
+        std::memcpy(rec.dst_ip, local_bytes, IP_V4_SIZE);
+        rewrite_port(rec, rec.dst_port, local_port);
+        route = routes ? routes->lookup(local_ip) : ROUTE_TQ;
+    } else if (to_nic) {
+        count(STAT_L3_TO_NIC);
+
         // Change source IP to NIC's IP when packet is targeted to NIC
-        for (int i = 0; i < IP_V4_SIZE; i++) {
-            src_ip[i] = ip[i];
-        }
-        
-        // Recalculate checksum after IP change
-        uint16_t calculated_checksum = 0;
-        for (int i = 0; i < IP_V4_SIZE; i++) {
-            calculated_checksum += src_ip[i] + dst_ip[i];
-        }
-        calculated_checksum += ttl + dst_port + src_port;
-        
-        // Add L4 data to checksum calculation
-        for (char c : l4_data) {
-            calculated_checksum += static_cast<uint8_t>(c);
-        }
-        
-        checksum = calculated_checksum & 0xFFFF;
+        rewrite_src_ip(rec, ip);
         
-        // Strip to L4 and handle
-        // Create L4 packet with correct format: index|src_port|dest_port|data_bytes
-        // Extract index from l4_data (first part before |)
-        size_t pipe_pos = l4_data.find('|');
-        std::string index_str = (pipe_pos != std::string::npos) ? l4_data.substr(0, pipe_pos) : "0";
-        std::string data_bytes = (pipe_pos != std::string::npos) ? l4_data.substr(pipe_pos + 1) : l4_data;
-        
-        // Use the correct port order: src_port=4413, dst_port=763
-        std::string l4_packet_str = index_str + "|" + std::to_string(src_port) + "|" + std::to_string(dst_port) + "|" + data_bytes;
-        
-        l4_packet l4_pkt(l4_packet_str);
-        
-        if (!l4_pkt.validate_packet(open_ports, ip, mask, nullptr)) {
+        // Strip to L4 and handle, the L4 fields are already in the record
+        if (!l4_packet::validate_record(rec, open_ports)) {
             return false;
         }
         
-        return l4_pkt.proccess_packet(open_ports, ip, mask, dst);
+        return l4_packet::process_record(rec, open_ports, dst);
     }
     
-    // Check if source IP is in local network
-    bool src_in_local = true;
-    for (int i = 0; i < IP_V4_SIZE; i++) {
-        uint8_t mask_byte = (i < mask / 8) ? 0xFF : 
-                           (i == mask / 8) ? (0xFF << (8 - (mask % 8))) : 0x00;
-        if ((src_ip[i] & mask_byte) != (ip[i] & mask_byte)) {
-            src_in_local = false;
+    // Route on the destination, longest prefix first
+    switch (route) {
+        case ROUTE_RQ:
+            // Incoming packet to local network -> RQ
+            dst = RQ;
+            count(STAT_ROUTE_RQ);
+            return true;
+        case ROUTE_NAT:
+            // Sources in the NIC's subnet are translated to the NIC's IP
+            // and their connection's NAT port, whatever their own route
+            if (routes->is_local(ip_to_u32(rec.src_ip))) {
+                uint16_t nat_port = rec.src_port;
+                if (nat != nullptr &&
+                    !nat->translate_out(ip_to_u32(rec.src_ip), rec.src_port,
+                                        ip_to_u32(rec.dst_ip), rec.dst_port,
+                                        open_ports, nat_port)) {
+                    count(STAT_NAT_EXHAUSTED);
+                    return false;
+                }
+                count(STAT_L3_NAT);
+                rewrite_src_ip(rec, ip);
+                if (nat_port != rec.src_port) {
+                    rewrite_port(rec, rec.src_port, nat_port);
+                }
+            }
             break;
-        }
-    }
-    
-    // If source is in local network and destination is external, change source IP to NIC's IP (NAT)
-    if (src_in_local && !is_local_network(ip, mask)) {
-        for (int i = 0; i < IP_V4_SIZE; i++) {
-            src_ip[i] = ip[i];
-        }
-        
-        // Recalculate checksum after IP change
-        uint16_t calculated_checksum = 0;
-        for (int i = 0; i < IP_V4_SIZE; i++) {
-            calculated_checksum += src_ip[i] + dst_ip[i];
-        }
-        calculated_checksum += ttl + dst_port + src_port;
-        
-        // Add L4 data to checksum calculation
-        for (char c : l4_data) {
-            calculated_checksum += static_cast<uint8_t>(c);
-        }
-        
-        checksum = calculated_checksum & 0xFFFF;
-    }
-    
-    // Check if destination is in local network
-    if (is_local_network(ip, mask)) {
-        // Incoming packet to local network -> RQ
-        dst = RQ;
-    } else {
-        // Outgoing packet or internal routing -> TQ
-        dst = TQ;
+        case ROUTE_TQ:
+            break;
+        case ROUTE_DROP:
+            count(STAT_ROUTE_DROP);
+            return false;
     }
-    
+
+    // Outgoing packet or internal routing -> TQ
+    dst = TQ;
+    count(STAT_ROUTE_TQ);
     return true;
 }
 
 bool l3_packet::as_string(std::string &packet) {
+    format_record(record, packet);
+    return true;
+}
+
+void l3_packet::format_record(const packet_record &rec, std::string &packet) {
     packet.clear();
-    // Format: src_ip|dst_ip|ttl|checksum|src_port|dst_port|data
+    // Format: src_ip|dst_ip|ttl|checksum|src_port|dst_port|index|data
     for (int i = 0; i < IP_V4_SIZE; i++) {
-        if (i > 0) packet += ".";
-        packet += std::to_string(src_ip[i]);
+        if (i > 0) packet += '.';
+        append_uint(packet, rec.src_ip[i]);
     }
-    packet += "|";
+    packet += '|';
     for (int i = 0; i < IP_V4_SIZE; i++) {
-        if (i > 0) packet += ".";
-        packet += std::to_string(dst_ip[i]);
+        if (i > 0) packet += '.';
+        append_uint(packet, rec.dst_ip[i]);
     }
-    packet += "|" + std::to_string(ttl) + "|" + std::to_string(checksum) + "|" + std::to_string(src_port) + "|" + std::to_string(dst_port) + "|" + l4_data;
-    return true;
-} 
\ No newline at end of file
+    packet += '|';
+    append_uint(packet, rec.ttl);
+    packet += '|';
+    append_uint(packet, rec.l3_checksum);
+    packet += '|';
+    append_uint(packet, rec.src_port);
+    packet += '|';
+    append_uint(packet, rec.dst_port);
+    packet += '|';
+    if (!rec.l4_canonical) {
+        packet.append(rec.l4_text.ptr, rec.l4_text.len);
+        return;
+    }
+    append_uint(packet, rec.index);
+    packet += '|';
+    append_hex_payload(packet, rec.payload, rec.payload_len);
+}
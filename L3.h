@@ -11,31 +11,61 @@
 
 #include <cstdint>
 #include "packets.hpp"
+#include "route_table.hpp"
+#include "nat_table.hpp"
 
-class l3_packet : public generic_packet {
+class l3_packet final : public generic_packet {
 public:
     /**
      * @fn l3_packet
      * @brief Constructor for L3 packet.
      * 
      * @param packet_str - String representation of the L3 packet.
+     * @param checksum - Whether validate_packet checks the checksums.
+     * @param routes - Routing table of the NIC, nullptr routes everything
+     *        to TQ.
+     * @param nat - Connection tracking of the NIC, nullptr translates
+     *        sources without tracking them.
+     *
+     * @return New L3 packet object.
+     *
+     * @note The packet keeps views into 'packet_str' and pointers to
+     *       'routes' and 'nat', which must outlive it.
+     */
+    l3_packet(field_view packet_str,
+              checksum_mode checksum = CHECKSUM_OFF,
+              const route_table *routes = nullptr,
+              nat_table *nat = nullptr);
+
+    /**
+     * @fn l3_packet
+     * @brief Constructor for a packet parsed ahead of time, adopts the
+     *        record parsed from 'packet_str' instead of parsing it again.
+     *
+     * @param packet_str - String representation of the packet.
+     * @param rec - The packet's record, nullptr if it didn't parse.
+     * @param checksum, routes, nat - See above.
      *
      * @return New L3 packet object.
      */
-    l3_packet(const std::string& packet_str);
+    l3_packet(field_view packet_str,
+              const packet_record *rec,
+              checksum_mode checksum,
+              const route_table *routes,
+              nat_table *nat);
 
     /**
      * @fn validate_packet
      * @brief Validates the L3 packet by checking TTL and checksum.
      *
-     * @param open_ports - Vector containing all the NIC's open ports.
+     * @param open_ports - Flow table of all the NIC's open ports.
      * @param ip - NIC's IP address.
      * @param mask - NIC's mask.
      * @param mac - NIC's MAC address.
      *
      * @return true if the packet is valid, false otherwise.
      */
-    bool validate_packet(open_port_vec open_ports,
+    bool validate_packet(const open_port_vec &open_ports,
                         uint8_t ip[IP_V4_SIZE],
                         uint8_t mask,
                         uint8_t mac[MAC_SIZE]) override;
@@ -44,16 +74,14 @@ public:
      * @fn proccess_packet
      * @brief Processes the L3 packet based on routing logic.
      *
-     * @param open_ports - Vector containing all the NIC's open ports.
+     * @param open_ports - Flow table of all the NIC's open ports.
      * @param ip - NIC's IP address.
-     * @param mask - NIC's mask.
      * @param dst - Reference to memory destination enum.
      *
      * @return true on success, false on failure.
      */
     bool proccess_packet(open_port_vec &open_ports,
                         uint8_t ip[IP_V4_SIZE],
-                        uint8_t mask,
                         memory_dest &dst) override;
 
     /**
@@ -66,50 +94,160 @@ public:
      */
     bool as_string(std::string &packet) override;
 
-private:
-    std::string packet_data;
-    uint8_t src_ip[IP_V4_SIZE];
-    uint8_t dst_ip[IP_V4_SIZE];
-    uint8_t ttl;
-    uint16_t checksum;
-    uint16_t dst_port;
-    uint16_t src_port;
-    std::string l4_data;
+    /**
+     * @fn queued_record
+     * @brief Gives the processed packet to RQ/TQ without formatting it.
+     *
+     * @return The packet's record, nullptr if it wasn't parsed.
+     */
+    const packet_record *queued_record() const {
+        return parsed ? &record : nullptr;
+    }
 
     /**
-     * @fn parse_packet
-     * @brief Parses the packet string to extract L3 fields.
+     * @fn parse_fields
+     * @brief Parses an L3 packet string into the L3 and L4 parts of 'rec'.
+     *
+     * @param text - String representation of the L3 packet.
+     * @param rec - Record to fill.
+     *
+     * @return true on success, false if a field is malformed.
+     */
+    static bool parse_fields(field_view text, packet_record &rec);
+
+    /**
+     * @fn validate_record
+     * @brief validate_packet on an already parsed record, used by L2 to hand
+     *        its payload down without building a string.
+     *
+     * @param rec - Parsed packet.
+     * @param checksum - Whether the L3 checksum is checked.
+     *
+     * @return true if the packet is valid, false otherwise.
      */
-    void parse_packet();
+    static bool validate_record(const packet_record &rec,
+                                checksum_mode checksum = CHECKSUM_OFF);
+
+    /**
+     * @fn process_record
+     * @brief proccess_packet on an already parsed and validated record.
+     *
+     * @param rec - Parsed packet, its L3 header is updated in place.
+     * @param open_ports - Flow table of all the NIC's open ports.
+     * @param ip - NIC's IP address.
+     * @param routes - Routing table of the NIC, nullptr routes everything
+     *        to TQ.
+     * @param nat - Connection tracking of the NIC, nullptr translates
+     *        sources without tracking them.
+     * @param dst - Reference to memory destination enum.
+     *
+     * @return true on success, false on failure.
+     */
+    static bool process_record(packet_record &rec,
+                               open_port_vec &open_ports,
+                               uint8_t ip[IP_V4_SIZE],
+                               const route_table *routes,
+                               nat_table *nat,
+                               memory_dest &dst);
+
+    /**
+     * @fn forward_record
+     * @brief The part of 'process_record' after the TTL decrement, for a
+     *        header whose NIC test and route were already computed (see
+     *        nic_sim::process_batch).
+     *
+     * @param rec - Parsed packet, its TTL already decremented.
+     * @param open_ports, ip, routes, nat, dst - As in 'process_record'.
+     * @param to_nic - Whether the destination is the NIC's IP.
+     * @param route - Route of the destination, unused if 'to_nic'.
+     *
+     * @return true on success, false on failure.
+     */
+    static bool forward_record(packet_record &rec,
+                               open_port_vec &open_ports,
+                               uint8_t ip[IP_V4_SIZE],
+                               const route_table *routes,
+                               nat_table *nat,
+                               bool to_nic,
+                               route_action route,
+                               memory_dest &dst);
+
+    /**
+     * @fn batch_record
+     * @brief Gives the parsed record to nic_sim::process_batch, which
+     *        processes it in place.
+     *
+     * @return The packet's record, nullptr if it wasn't parsed.
+     */
+    packet_record *batch_record() {
+        return parsed ? &record : nullptr;
+    }
+
+    /**
+     * @fn format_record
+     * @brief Converts the L3 part of a record to the RQ/TQ string format:
+     *        src_ip|dst_ip|ttl|checksum|src_port|dst_port|index|data
+     *
+     * @param rec - Packet to format.
+     * @param packet - Output string representation.
+     *
+     * @return None.
+     */
+    static void format_record(const packet_record &rec, std::string &packet);
+
+private:
+    field_view packet_data;
+    packet_record record;
+    bool parsed;
+    checksum_mode checksum_check;
+    const route_table *routes;
+    nat_table *nat;
 
     /**
      * @fn validate_checksum
      * @brief Validates the packet checksum.
      *
+     * @param rec - Parsed packet.
+     *
      * @return true if checksum is valid, false otherwise.
      */
-    bool validate_checksum();
+    static bool validate_checksum(const packet_record &rec);
 
     /**
-     * @fn is_local_network
-     * @brief Checks if the destination IP is in the local network.
+     * @fn rewrite_src_ip
+     * @brief Replaces the source IP and incrementally updates the checksum.
      *
-     * @param nic_ip - NIC's IP address.
-     * @param mask - NIC's subnet mask.
+     * @param rec - Parsed packet.
+     * @param new_ip - New source IP.
+     *
+     * @return None.
+     */
+    static void rewrite_src_ip(packet_record &rec,
+                               const uint8_t new_ip[IP_V4_SIZE]);
+
+    /**
+     * @fn rewrite_port
+     * @brief Replaces a port and incrementally updates the checksum.
+     *
+     * @param rec - Parsed packet.
+     * @param port - 'rec.src_port' or 'rec.dst_port'.
+     * @param value - New port.
      *
-     * @return true if destination is in local network, false otherwise.
+     * @return None.
      */
-    bool is_local_network(uint8_t nic_ip[IP_V4_SIZE], uint8_t mask);
+    static void rewrite_port(packet_record &rec, uint16_t &port, uint16_t value);
 
     /**
      * @fn is_targeted_to_nic
      * @brief Checks if the packet is targeted to this NIC.
      *
+     * @param rec - Parsed packet.
      * @param nic_ip - NIC's IP address.
      *
      * @return true if packet is targeted to NIC, false otherwise.
      */
-    bool is_targeted_to_nic(uint8_t nic_ip[IP_V4_SIZE]);
+    static bool is_targeted_to_nic(const packet_record &rec,
+                                   const uint8_t nic_ip[IP_V4_SIZE]);
 };
 
-#endif 
\ No newline at end of file
+#endif
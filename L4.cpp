@@ -8,158 +8,188 @@
 #include <cstring>
 #include <cstdint>
 #include "L4.h"
+#include "flow_stats.hpp"
+#include "flow_trace.hpp"
+#include "hex_decode.hpp"
 
-l4_packet::l4_packet(const std::string& packet_str) : packet_data(packet_str) {
-    parse_packet();
+l4_packet::l4_packet(field_view packet_str) : packet_data(packet_str),
+                                               parsed(false) {
+    parsed = parse_packet();
 }
 
-void l4_packet::parse_packet() {
+l4_packet::l4_packet(field_view packet_str, const packet_record *rec)
+    : packet_data(packet_str), parsed(rec != nullptr) {
+    if (parsed) {
+        record = *rec;
+    }
+}
+
+bool l4_packet::parse_packet() {
     // Format: src_port|dst_port|index|data_bytes
-    size_t start = 0, end = 0;
-    std::string fields[4];
-    for (int i = 0; i < 3; ++i) {
-        end = packet_data.find('|', start);
-        if (end == std::string::npos) {
-            std::cerr << "Error: Not enough fields in L4 packet: " << packet_data << std::endl;
-            return;
+    field_tokenizer tokens(packet_data, '|');
+    field_view fields[2];
+    for (int i = 0; i < 2; ++i) {
+        if (!tokens.next(fields[i]) || tokens.done()) {
+            std::cerr << "Error: Not enough fields in L4 packet: " << packet_data.str() << std::endl;
+            return false;
         }
-        fields[i] = packet_data.substr(start, end - start);
-        start = end + 1;
     }
-    fields[3] = packet_data.substr(start);
     
     // src_port
-    try {
-        src_port = static_cast<uint16_t>(std::stoi(fields[0]));
-    } catch (...) {
-        std::cerr << "Error: Invalid src_port: " << fields[0] << std::endl;
-        return;
+    if (parse_u16(fields[0], record.src_port) != PARSE_OK) {
+        std::cerr << "Error: Invalid src_port: " << fields[0].str() << std::endl;
+        return false;
     }
     
     // dst_port
-    try {
-        dst_port = static_cast<uint16_t>(std::stoi(fields[1]));
-    } catch (...) {
-        std::cerr << "Error: Invalid dst_port: " << fields[1] << std::endl;
-        return;
+    if (parse_u16(fields[1], record.dst_port) != PARSE_OK) {
+        std::cerr << "Error: Invalid dst_port: " << fields[1].str() << std::endl;
+        return false;
     }
     
+    // index|data
+    return parse_payload(tokens.rest(), record, true);
+}
+
+bool l4_packet::parse_payload(field_view text, packet_record &rec, bool report) {
+    rec.l4_text = text;
+    rec.l4_canonical = false;
+    rec.index = 0xFFFF;
+    rec.payload_len = -1;
+    rec.port_index = -1;
+
+    size_t pipe_pos = text.find('|');
+    if (pipe_pos == field_view::npos) {
+        if (report) {
+            std::cerr << "Error: Not enough fields in L4 packet: " << text.str() << std::endl;
+        }
+        return false;
+    }
+
     // index
-    try {
-        index = static_cast<uint16_t>(std::stoi(fields[2]));
-    } catch (...) {
-        std::cerr << "Error: Invalid index: " << fields[2] << std::endl;
-        return;
+    field_view index_str = text.substr(0, pipe_pos);
+    if (parse_u16(index_str, rec.index) != PARSE_OK) {
+        if (report) {
+            std::cerr << "Error: Invalid index: " << index_str.str() << std::endl;
+        }
+        return false;
     }
-    
-    // data
-    data = fields[3];
+
+    // data (hex bytes separated by spaces)
+    field_view data_str = text.substr(pipe_pos + 1);
+    rec.payload_len = decode_hex_payload(data_str, rec.payload, DATA_ARR_SIZE);
+
+    // Formatting the fields gives the text back unless the index has leading
+    // zeros or the data isn't in the canonical layout (e.g upper case, extra
+    // spaces, more than DATA_ARR_SIZE bytes)
+    rec.l4_canonical = (index_str.size() == 1 || index_str[0] != '0') &&
+                       hex_payload_matches(data_str, rec.payload, rec.payload_len);
+    return rec.payload_len >= 0;
 }
 
-bool l4_packet::validate_packet(open_port_vec open_ports,
-                               uint8_t ip[IP_V4_SIZE],
-                               uint8_t mask,
-                               uint8_t mac[MAC_SIZE]) {
-    // Check if there's a matching open port (communication exists)
-    int port_index = find_open_port(open_ports);
-    if (port_index == -1) {
+bool l4_packet::validate_packet(const open_port_vec &open_ports,
+                               uint8_t /* ip */[IP_V4_SIZE],
+                               uint8_t /* mask */,
+                               uint8_t /* mac */[MAC_SIZE]) {
+    if (!parsed) {
+        count(STAT_PARSE_ERROR);
+        return false;
+    }
+    return validate_record(record, open_ports);
+}
+
+bool l4_packet::validate_record(packet_record &rec,
+                                const open_port_vec &open_ports) {
+    NIC_TRACE_SCOPE("l4.validate");
+    // Check if there's a matching open port (communication exists), the
+    // processing stage reuses it
+    rec.port_index = find_open_port(rec, open_ports);
+    if (rec.port_index == -1) {
         // No open channel exists - throw the packet
+        count(STAT_L4_UNKNOWN_FLOW);
         return false;
     }
     
     // Validate index is within bounds
-    if (index >= DATA_ARR_SIZE) {
+    if (rec.index >= DATA_ARR_SIZE) {
         // Invalid index - kill the packet
+        count(STAT_L4_BAD_INDEX);
         return false;
     }
     
-    // Validate data format (should be hex bytes separated by spaces)
-    if (data.empty()) {
+    // Validate data format (hex bytes were decoded by the parser)
+    if (rec.payload_len <= 0) {
+        count(STAT_L4_EMPTY_PAYLOAD);
         return false;
     }
     
-    // Check if data contains valid hex bytes
-    size_t start = 0, end = 0;
-    int byte_count = 0;
-    while (start < data.size() && byte_count < DATA_ARR_SIZE) {
-        while (start < data.size() && data[start] == ' ') ++start;
-        if (start >= data.size()) break;
-        
-        end = data.find(' ', start);
-        std::string hex_byte = (end == std::string::npos) ? data.substr(start) : data.substr(start, end - start);
-        
-        if (!hex_byte.empty()) {
-            try {
-                std::stoi(hex_byte, nullptr, 16);
-                byte_count++;
-            } catch (...) {
-                return false;
-            }
-        }
-        
-        if (end == std::string::npos) break;
-        start = end + 1;
-    }
-    
     return true;
 }
 
-int l4_packet::find_open_port(const open_port_vec& open_ports) {
-    for (size_t i = 0; i < open_ports.size(); i++) {
-        if (open_ports[i].src_prt == src_port && open_ports[i].dst_prt == dst_port) {
-            return static_cast<int>(i);
-        }
-    }
-    return -1;
+int l4_packet::find_open_port(const packet_record &rec,
+                              const open_port_vec& open_ports) {
+    return open_ports.find(rec.src_port, rec.dst_port);
 }
 
 bool l4_packet::proccess_packet(open_port_vec &open_ports,
-                               uint8_t ip[IP_V4_SIZE],
-                               uint8_t mask,
+                               uint8_t /* ip */[IP_V4_SIZE],
+                               memory_dest &dst) {
+    if (!parsed) {
+        return false;
+    }
+    return process_record(record, open_ports, dst);
+}
+
+bool l4_packet::process_record(const packet_record &rec,
+                               open_port_vec &open_ports,
                                memory_dest &dst) {
-    // Find the matching open port
-    int port_index = find_open_port(open_ports);
+    NIC_TRACE_SCOPE("l4.process");
+    // Open port found by validate_record
+    int port_index = rec.port_index;
     if (port_index == -1) {
         // No open channel exists - throw the packet
         return false;
     }
     
     // Validate index is within bounds
-    if (index >= DATA_ARR_SIZE) {
+    if (rec.index >= DATA_ARR_SIZE) {
         // Invalid index - kill the packet
         return false;
     }
     
-    // Store content in data[] of open_port starting at the index position
-    // Parse the data string and store it in the open_port struct
-    size_t start = 0, end = 0;
-    int data_index = index; // Start storing at the index position
+    if (rec.payload_len < 0) {
+        return false;
+    }
     
-    while (start < data.size() && data_index < DATA_ARR_SIZE) {
-        while (start < data.size() && data[start] == ' ') ++start;
-        if (start >= data.size()) break;
-        
-        end = data.find(' ', start);
-        std::string hex_byte = (end == std::string::npos) ? data.substr(start) : data.substr(start, end - start);
-        
-        if (!hex_byte.empty()) {
-            try {
-                open_ports[port_index].data[data_index++] = static_cast<unsigned char>(std::stoi(hex_byte, nullptr, 16));
-            } catch (...) {
-                return false;
-            }
-        }
-        
-        if (end == std::string::npos) break;
-        start = end + 1;
+    // Store content in data[] of open_port starting at the index position
+    int count = rec.payload_len;
+    if (count > DATA_ARR_SIZE - rec.index) {
+        count = DATA_ARR_SIZE - rec.index;
+    }
+    {
+        NIC_TRACE_SCOPE("dram.write");
+        std::memcpy(open_ports[port_index].data + rec.index, rec.payload,
+                    static_cast<size_t>(count));
     }
     
     // Set destination to LOCAL_DRAM since we stored data in open_port
     dst = LOCAL_DRAM;
+    common::count(STAT_ROUTE_DRAM);
     return true;
 }
 
 bool l4_packet::as_string(std::string &packet) {
-    packet = std::to_string(src_port) + "|" + std::to_string(dst_port) + "|" + std::to_string(index) + "|" + data;
+    packet.clear();
+    append_uint(packet, record.src_port);
+    packet += '|';
+    append_uint(packet, record.dst_port);
+    packet += '|';
+    if (!record.l4_canonical) {
+        packet.append(record.l4_text.ptr, record.l4_text.len);
+        return true;
+    }
+    append_uint(packet, record.index);
+    packet += '|';
+    append_hex_payload(packet, record.payload, record.payload_len);
     return true;
-} 
\ No newline at end of file
+}
@@ -12,7 +12,7 @@
 #include <cstdint>
 #include "packets.hpp"
 
-class l4_packet : public generic_packet {
+class l4_packet final : public generic_packet {
 public:
     /**
      * @fn l4_packet
@@ -21,21 +21,35 @@ public:
      * @param packet_str - String representation of the L4 packet.
      *
      * @return New L4 packet object.
+     *
+     * @note The packet keeps views into 'packet_str', which must outlive it.
+     */
+    l4_packet(field_view packet_str);
+
+    /**
+     * @fn l4_packet
+     * @brief Constructor for a packet parsed ahead of time, adopts the
+     *        record parsed from 'packet_str' instead of parsing it again.
+     *
+     * @param packet_str - String representation of the L4 packet.
+     * @param rec - The packet's record, nullptr if it didn't parse.
+     *
+     * @return New L4 packet object.
      */
-    l4_packet(const std::string& packet_str);
+    l4_packet(field_view packet_str, const packet_record *rec);
 
     /**
      * @fn validate_packet
      * @brief Validates the L4 packet by checking if communication is open.
      *
-     * @param open_ports - Vector containing all the NIC's open ports.
+     * @param open_ports - Flow table of all the NIC's open ports.
      * @param ip - NIC's IP address.
      * @param mask - NIC's mask.
      * @param mac - NIC's MAC address.
      *
      * @return true if the packet is valid, false otherwise.
      */
-    bool validate_packet(open_port_vec open_ports,
+    bool validate_packet(const open_port_vec &open_ports,
                         uint8_t ip[IP_V4_SIZE],
                         uint8_t mask,
                         uint8_t mac[MAC_SIZE]) override;
@@ -44,16 +58,14 @@ public:
      * @fn proccess_packet
      * @brief Processes the L4 packet by storing data in open_port struct.
      *
-     * @param open_ports - Vector containing all the NIC's open ports.
+     * @param open_ports - Flow table of all the NIC's open ports.
      * @param ip - NIC's IP address.
-     * @param mask - NIC's mask.
      * @param dst - Reference to memory destination enum.
      *
      * @return true on success, false on failure.
      */
     bool proccess_packet(open_port_vec &open_ports,
                         uint8_t ip[IP_V4_SIZE],
-                        uint8_t mask,
                         memory_dest &dst) override;
 
     /**
@@ -66,28 +78,85 @@ public:
      */
     bool as_string(std::string &packet) override;
 
+    /**
+     * @fn parse_payload
+     * @brief Parses the "index|data_bytes" tail shared by L3 and L4 packets
+     *        into 'rec.index' and 'rec.payload', and sets 'rec.l4_text' and
+     *        'rec.l4_canonical'. A malformed index is stored as 0xFFFF and a
+     *        malformed payload as 'payload_len' -1, both rejected by
+     *        'validate_record'.
+     *
+     * @param text - Tail of the packet string.
+     * @param rec - Record to fill.
+     * @param report - Whether to print malformed fields to stderr.
+     *
+     * @return true on success, false if a field is malformed.
+     */
+    static bool parse_payload(field_view text, packet_record &rec, bool report);
+
+    /**
+     * @fn validate_record
+     * @brief validate_packet on an already parsed record, used by the upper
+     *        layers to hand their payload down without building a string.
+     *        Stores the matching open port in 'rec.port_index'.
+     *
+     * @param rec - Parsed packet.
+     * @param open_ports - Flow table of all the NIC's open ports.
+     *
+     * @return true if the packet is valid, false otherwise.
+     */
+    static bool validate_record(packet_record &rec,
+                                const open_port_vec &open_ports);
+
+    /**
+     * @fn process_record
+     * @brief proccess_packet on an already parsed and validated record,
+     *        writes to the open port found by 'validate_record'.
+     *
+     * @param rec - Parsed packet.
+     * @param open_ports - Flow table of all the NIC's open ports.
+     * @param dst - Reference to memory destination enum.
+     *
+     * @return true on success, false on failure.
+     */
+    static bool process_record(const packet_record &rec,
+                               open_port_vec &open_ports,
+                               memory_dest &dst);
+
+    /**
+     * @fn parsed_record
+     * @brief Gives the parsed fields to the ACL.
+     *
+     * @return The packet's record, nullptr if it wasn't parsed.
+     */
+    const packet_record *parsed_record() const {
+        return parsed ? &record : nullptr;
+    }
+
 private:
-    std::string packet_data;
-    uint16_t src_port;
-    uint16_t dst_port;
-    uint16_t index;
-    std::string data;
+    field_view packet_data;
+    packet_record record;
+    bool parsed;
 
     /**
      * @fn parse_packet
      * @brief Parses the packet string to extract L4 fields.
+     *
+     * @return true on success, false if a field is malformed.
      */
-    void parse_packet();
+    bool parse_packet();
 
     /**
      * @fn find_open_port
      * @brief Finds the matching open port for this communication.
      *
-     * @param open_ports - Vector containing all the NIC's open ports.
+     * @param rec - Parsed packet.
+     * @param open_ports - Flow table of all the NIC's open ports.
      *
      * @return Index of matching open port, or -1 if not found.
      */
-    int find_open_port(const open_port_vec& open_ports);
+    static int find_open_port(const packet_record &rec,
+                              const open_port_vec& open_ports);
 };
 
-#endif 
\ No newline at end of file
+#endif
@@ -4,13 +4,23 @@
  */
 
 #include "NIC_sim.hpp"
+#include "trace_reader.hpp"
+#include "flow_trace.hpp"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <iomanip>
 #include <cstdint>
+#include <cstring>
+#include <chrono>
 
-nic_sim::nic_sim(std::string param_file) {
+nic_sim::nic_sim(std::string param_file) : packet_clock(0),
+                                            layer_hint(common::LAYER_AUTO),
+                                            first_line(true),
+                                            checksum_check(common::CHECKSUM_OFF),
+                                            stats_enabled(false),
+                                            stats_elapsed_ns(0),
+                                            latency_enabled(false) {
     // Read NIC parameters from file
     std::ifstream file(param_file);
     if (!file.is_open()) {
@@ -70,14 +80,33 @@ nic_sim::nic_sim(std::string param_file) {
                 std::cerr << "Error: Invalid mask: " << mask_str << std::endl;
                 return;
             }
+
+            // Default routes, the param file's routes are declared later
+            // and replace them
+            routes.add(0, 0, common::ROUTE_NAT);
+            routes.add(common::ip_to_u32(nic_ip), mask > 32 ? 32 : mask,
+                       common::ROUTE_RQ);
+            routes.set_local(common::ip_to_u32(nic_ip), mask > 32 ? 32 : mask);
         } else {
             std::cerr << "Error: IP/mask line missing '/': " << line << std::endl;
             return;
         }
     }
-    // Read open communications
+    // Read open communications and routes
+    static const char route_key[] = "route:";
     while (std::getline(file, line)) {
-        if (line.find("src_prt:") != std::string::npos && line.find("dst_port:") != std::string::npos) {
+        if (line.compare(0, sizeof(route_key) - 1, route_key) == 0) {
+            uint32_t prefix;
+            int len;
+            common::route_action action;
+            if (!common::route_table::parse_route(
+                    common::field_view(line).substr(sizeof(route_key) - 1),
+                    prefix, len, action)) {
+                std::cerr << "Error: Invalid route: " << line << std::endl;
+                continue;
+            }
+            routes.add(prefix, len, action);
+        } else if (line.find("src_prt:") != std::string::npos && line.find("dst_port:") != std::string::npos) {
             size_t src_pos = line.find("src_prt:");
             size_t src_end = line.find(",", src_pos);
             std::string src_str = line.substr(src_pos + 8, src_end - src_pos - 8);
@@ -100,125 +129,488 @@ nic_sim::nic_sim(std::string param_file) {
         }
     }
     file.close();
+    routes.compile();
 }
 
-void nic_sim::nic_flow(std::string packet_file) {
-    std::ifstream file(packet_file);
+bool nic_sim::nic_load_acl(const std::string &acl_file) {
+    std::ifstream file(acl_file);
     if (!file.is_open()) {
-        std::cerr << "Error: Could not open packet file: " << packet_file << std::endl;
-        return;
+        std::cerr << "Error: Could not open ACL file: " << acl_file << std::endl;
+        return false;
     }
-    
+
+    // Rules are declared in file order, the first match wins
+    common::acl_table loaded;
+    bool ok = true;
     std::string line;
     while (std::getline(file, line)) {
-        if (!line.empty()) {
-            // Create packet using factory
-            generic_packet* packet = packet_factory(line);
-            if (packet != nullptr) {
-                // Validate packet
-                if (packet->validate_packet(open_ports, nic_ip, mask, mac)) {
-                    // Process packet
-                    memory_dest dst;
-                    if (packet->proccess_packet(open_ports, nic_ip, mask, dst)) {
-                        // Store packet in appropriate location
-                        std::string packet_str;
-                        if (packet->as_string(packet_str)) {
-                            switch (dst) {
-                                case common::RQ:
-                                    RQ.push_back(packet_str);
-                                    break;
-                                case common::TQ:
-                                    TQ.push_back(packet_str);
-                                    break;
-                                case common::LOCAL_DRAM:
-                                    break;
-                            }
-                        }
-                    }
-                }
-                delete packet;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        common::acl_rule rule;
+        if (!common::acl_table::parse_rule(common::field_view(line), rule)) {
+            std::cerr << "Error: Invalid ACL rule: " << line << std::endl;
+            ok = false;
+            continue;
+        }
+        loaded.add(rule);
+    }
+    if (!ok) {
+        return false;
+    }
+    loaded.compile();
+    acl = std::move(loaded);
+    return true;
+}
+
+void nic_sim::begin_flow(const flow_options &options) {
+    layer_hint = options.layer;
+    first_line = true;
+    checksum_check = options.checksum;
+    stats_enabled = options.stats;
+    latency_enabled = options.latency;
+    nat.set_timeout(options.nat_timeout);
+}
+
+void nic_sim::nic_flow(std::string packet_file, const flow_options &options) {
+    begin_flow(options);
+
+    if (options.ring_depth > 0) {
+        bool sharded = options.shards > 1;
+        rings.reset(new queue_rings(options.ring_depth, options.ring_full,
+                                    sharded ? options.shards : 1,
+                                    sharded ? shard_ring_floors(options.shards) : 0,
+                                    RQ, TQ));
+    }
+
+    // The calling thread reads the trace and, single threaded, runs the
+    // whole packet path
+    common::stats_scope stats_thread(stats, stats_enabled);
+    common::latency_scope latency_thread(latency, latency_enabled);
+    std::unique_ptr<common::stats_reporter> reporter;
+    if (stats_enabled && options.stats_interval_ms > 0) {
+        reporter.reset(new common::stats_reporter(stats, options.stats_interval_ms,
+                                                  std::cerr));
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    NIC_TRACE_THREAD("reader");
+    if (latency_enabled) {
+        latency.begin_flow();
+    }
+
+    bool opened;
+    if (options.shards > 1) {
+        opened = sharded_flow(packet_file, options.ingest, options.shards);
+    } else if (options.threads > 1) {
+        opened = pipelined_flow(packet_file, options.ingest, options.threads);
+    } else {
+        NIC_TRACE_SCOPE("flow");
+        opened = read_trace(packet_file, options.ingest,
+            [this](common::field_view line, bool) {
+                handle_packet(line);
+            },
+            []() {});
+    }
+
+    if (rings) {
+        rings->finish();
+        for (int q = 0; q < 2; q++) {
+            ring_counters flow_stats = rings->counters(q == 0 ? common::RQ : common::TQ);
+            ring_stats[q].full += flow_stats.full;
+            ring_stats[q].dropped += flow_stats.dropped;
+        }
+        rings.reset();
+    }
+
+    reporter.reset();
+    if (latency_enabled) {
+        latency.end_flow();
+    }
+    if (stats_enabled) {
+        stats_elapsed_ns += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+
+    if (!opened) {
+        std::cerr << "Error: Could not open packet file: " << packet_file << std::endl;
+    }
+}
+
+bool nic_sim::take_header(common::field_view line) {
+    // A layer declaration can only appear as the first line of the trace
+    if (!first_line) {
+        return false;
+    }
+    first_line = false;
+
+    common::packet_layer declared;
+    if (!parse_layer_header(line, declared)) {
+        return false;
+    }
+    if (layer_hint == common::LAYER_AUTO) {
+        layer_hint = declared;
+    }
+    return true;
+}
+
+void nic_sim::handle_packet(common::field_view line) {
+    if (take_header(line)) {
+        return;
+    }
+    packet_clock++;
+
+    // Create packet using factory
+    common::latency_probe probe;
+    bool built;
+    {
+        common::stage_timer timer(common::STAGE_PARSE);
+        built = packet_factory(line, layer_hint, slot, &nat);
+    }
+    if (!built) {
+        return;
+    }
+    decide_packet(probe);
+}
+
+void nic_sim::handle_parsed(const parsed_packet &packet) {
+    packet_clock++;
+
+    // Adopt the parsed record, the packet was classified and parsed once
+    // for every NIC of the sweep
+    common::latency_probe probe;
+    {
+        common::stage_timer timer(common::STAGE_PARSE);
+        common::count(common::STAT_PACKETS);
+        if (packet.layer == common::LAYER_AUTO) {
+            common::count(common::STAT_NOT_A_PACKET);
+            return;
+        }
+        slot.emplace_parsed(packet.layer, packet.line,
+                            packet.parsed ? &packet.record : nullptr,
+                            checksum_check, &routes, &nat);
+    }
+    decide_packet(probe);
+}
+
+void nic_sim::decide_packet(common::latency_probe &probe) {
+    // Filter and validate packet
+    common::acl_action verdict;
+    bool valid;
+    {
+        common::stage_timer timer(common::STAGE_VALIDATE);
+        verdict = acl_verdict(slot);
+        valid = verdict != common::ACL_DENY &&
+                (verdict != common::ACL_ALLOW ||
+                 slot.validate_packet(open_ports, nic_ip, mask, mac));
+    }
+    common::latency_outcome outcome = common::LATENCY_DROP;
+    if (valid) {
+        common::stage_timer timer(common::STAGE_PROCESS);
+        memory_dest dst;
+        nat.advance(packet_clock);
+        if (store_packet(slot, verdict, dst)) {
+            outcome = static_cast<common::latency_outcome>(dst);
+        }
+    }
+    probe.finish(slot.held_layer(), outcome);
+    slot.reset();
+}
+
+common::acl_action nic_sim::acl_verdict(packet_slot &slot) const {
+    const common::packet_record *rec;
+    if (acl.empty() || (rec = slot.parsed_record()) == nullptr) {
+        return common::ACL_ALLOW;
+    }
+
+    NIC_TRACE_SCOPE("acl");
+    common::acl_action verdict = acl.classify(*rec, slot.held_layer());
+    if (verdict != common::ACL_ALLOW && verdict != common::ACL_DENY &&
+        slot.held_layer() == common::LAYER_L4) {
+        verdict = common::ACL_DENY;
+    }
+    if (verdict == common::ACL_DENY) {
+        common::count(common::STAT_ACL_DENY);
+    } else if (verdict != common::ACL_ALLOW) {
+        common::count(common::STAT_ACL_REDIRECT);
+    }
+    return verdict;
+}
+
+bool nic_sim::store_packet(packet_slot &slot, common::acl_action verdict,
+                           memory_dest &dst) {
+    // Process packet, redirected ones are stored as they came
+    if (verdict == common::ACL_REDIRECT_RQ) {
+        dst = common::RQ;
+    } else if (verdict == common::ACL_REDIRECT_TQ) {
+        dst = common::TQ;
+    } else if (!slot.proccess_packet(open_ports, nic_ip, dst)) {
+        return false;
+    }
+
+    // Store packet in appropriate location, queued packets are kept binary
+    // and only formatted when printed
+    const common::packet_record *rec = slot.queued_record();
+    if (dst != common::LOCAL_DRAM && rec != nullptr) {
+        enqueue(dst, 0, *rec);
+    }
+    return true;
+}
+
+void nic_sim::process_batch(packet_slot slots[], const bool valid[],
+                            const common::acl_action verdicts[], size_t count,
+                            uint64_t first_clock, common::latency_outcome outcomes[]) {
+    NIC_TRACE_SCOPE("process.batch");
+    // Gather the L3 headers of the packets L3 will process, the source and
+    // ports stay in the records, only the order-dependent steps read them
+    common::header_batch headers;
+    common::packet_record *records[common::header_batch::CAPACITY];
+    size_t header_of[common::header_batch::CAPACITY];
+    for (size_t i = 0; i < count; i++) {
+        records[i] = nullptr;
+        if (!valid[i] || verdicts[i] != common::ACL_ALLOW) {
+            continue;
+        }
+        common::packet_record *rec = slots[i].batch_record();
+        if (rec == nullptr) {
+            continue;
+        }
+        size_t h = headers.count++;
+        headers.dst_ip[h] = common::ip_to_u32(rec->dst_ip);
+        headers.checksum[h] = rec->l3_checksum;
+        headers.ttl[h] = rec->ttl;
+        records[i] = rec;
+        header_of[i] = h;
+    }
+
+    // Independent per-header steps, then the route of every header that
+    // doesn't stop at the NIC
+    headers.rewrite(common::ip_to_u32(nic_ip));
+    common::route_action route[common::header_batch::CAPACITY];
+    for (size_t h = 0; h < headers.count; h++) {
+        route[h] = headers.to_nic[h] ? common::ROUTE_TQ : routes.lookup(headers.dst_ip[h]);
+    }
+
+    // Scatter in trace order, NAT and LOCAL DRAM depend on it
+    for (size_t i = 0; i < count; i++) {
+        if (!valid[i]) {
+            continue;
+        }
+        nat.advance(first_clock + i);
+        memory_dest dst;
+        bool stored;
+        common::packet_record *rec = records[i];
+        if (rec == nullptr) {
+            // L4 packets and redirects take the single packet path
+            stored = store_packet(slots[i], verdicts[i], dst);
+        } else {
+            // L2 packets weren't through the L3 checks yet, and a filtered
+            // header goes through them to be counted
+            size_t h = header_of[i];
+            bool checked = slots[i].held_layer() == common::LAYER_L3 ||
+                           (headers.live[h] && checksum_check == common::CHECKSUM_OFF);
+            stored = false;
+            if (!checked && !l3_packet::validate_record(*rec, checksum_check)) {
+                // Counted by the validation
+            } else if (!headers.live[h]) {
+                // The TTL runs out with the decrement, as in 'process_record'
+                common::count(common::STAT_L3_TTL_EXPIRED);
+            } else {
+                rec->ttl = headers.ttl[h];
+                rec->l3_checksum = headers.checksum[h];
+                stored = l3_packet::forward_record(*rec, open_ports, nic_ip, &routes, &nat,
+                                                   headers.to_nic[h] != 0, route[h], dst);
+            }
+            if (stored && dst != common::LOCAL_DRAM) {
+                enqueue(dst, 0, *rec);
             }
         }
+        outcomes[i] = stored ? static_cast<common::latency_outcome>(dst) :
+                               common::LATENCY_DROP;
     }
-    
-    file.close();
+}
+
+void nic_sim::enqueue(common::memory_dest queue, uint64_t seq,
+                      const common::packet_record &rec) {
+    NIC_TRACE_SCOPE("queue.push");
+    if (rings) {
+        rings->push(0, queue, seq, rec);
+    } else if (queue == common::RQ) {
+        RQ.push(rec);
+    } else {
+        TQ.push(rec);
+    }
+}
+
+ring_counters nic_sim::nic_ring_counters(common::memory_dest queue) const {
+    return ring_stats[queue == common::RQ ? 0 : 1];
+}
+
+void nic_sim::nic_print_latency(std::ostream &out) const {
+    latency.write_json(out);
+}
+
+void nic_sim::nic_print_stats(std::ostream &out) const {
+    common::stats_registry::write_json(out, stats.snapshot(), stats_elapsed_ns,
+                                       "summary");
 }
 
 void nic_sim::nic_print_results() {
+    // Anything already streamed to std::cout must come first
+    std::cout.flush();
+    nic_print_results(1);
+}
+
+bool nic_sim::nic_print_results(int fd) {
+    result_writer out(fd);
+    return print_results(out);
+}
+
+bool nic_sim::nic_print_results(const std::string &path) {
+    result_writer out(path);
+    if (!out.is_open()) {
+        std::cerr << "Error: Could not open output file: " << path << std::endl;
+        return false;
+    }
+    return print_results(out);
+}
+
+bool nic_sim::print_results(result_writer &out) {
     // Print LOCAL DRAM
-    std::cout << "LOCAL DRAM:" << std::endl;
+    out.put("LOCAL DRAM:\n", 12);
     for (const auto& port : open_ports) {
-        std::cout << port.src_prt << " " << port.dst_prt << ": ";
-        for (int i = 0; i < DATA_ARR_SIZE; i++) {
-            if (i > 0) std::cout << " ";
-            port.print_hex_byte(i);
-        }
-        std::cout << std::endl;
+        out.put_uint(port.src_prt);
+        out.put(' ');
+        out.put_uint(port.dst_prt);
+        out.put(": ", 2);
+        out.put_hex_bytes(port.data, DATA_ARR_SIZE);
+        out.put('\n');
     }
-    std::cout << std::endl;
+    out.put('\n');
     
     // Print RQ
-    std::cout << "RQ:" << std::endl;
-    for (const auto& packet : RQ) {
-        std::cout << packet << std::endl;
+    out.put("RQ:\n", 4);
+    for (size_t i = 0; i < RQ.size(); i++) {
+        RQ.write(i, out);
+        out.put('\n');
     }
-    std::cout << std::endl;
+    out.put('\n');
     
     // Print TQ
-    std::cout << "TQ:" << std::endl;
-    for (const auto& packet : TQ) {
-        std::cout << packet << std::endl;
+    out.put("TQ:\n", 4);
+    for (size_t i = 0; i < TQ.size(); i++) {
+        TQ.write(i, out);
+        out.put('\n');
     }
+    return out.flush();
 }
 
 nic_sim::~nic_sim() {
     // Destructor - vectors will be automatically cleaned up
 }
 
-generic_packet* nic_sim::packet_factory(std::string &packet) {
-    // Determine packet type based on format
-    // Count the number of '|' delimiters to determine layer
-    
-    int pipe_count = 0;
-    for (char c : packet) {
-        if (c == '|') pipe_count++;
+bool nic_sim::packet_factory(common::field_view packet,
+                             common::packet_layer layer,
+                             packet_slot &slot,
+                             common::nat_table *nat) {
+    NIC_TRACE_SCOPE("factory");
+    common::count(common::STAT_PACKETS);
+    if (layer == common::LAYER_AUTO) {
+        layer = classify_packet(packet);
+        if (layer == common::LAYER_AUTO) {
+            common::count(common::STAT_NOT_A_PACKET);
+            return false;
+        }
     }
-    
-    // L3 packets have IP addresses (format: src_ip|dst_ip|ttl|checksum|dst_port|src_port|data)
-    // Check if the first two parts contain dots (IP addresses)
-    size_t first_pipe = packet.find('|');
-    if (first_pipe != std::string::npos) {
-        std::string first_part = packet.substr(0, first_pipe);
-        size_t second_pipe = packet.find('|', first_pipe + 1);
-        if (second_pipe != std::string::npos) {
-            std::string second_part = packet.substr(first_pipe + 1, second_pipe - first_pipe - 1);
-            
-            // If both parts contain dots, it's likely an L3 packet
-            if (first_part.find('.') != std::string::npos && second_part.find('.') != std::string::npos) {
-                return new l3_packet(packet);
+
+    slot.emplace(layer, packet, checksum_check, &routes, nat);
+    return !slot.empty();
+}
+
+namespace {
+    /* Character classes used by the packet classifier. */
+    enum char_class {
+        CHAR_OTHER = 0,
+        CHAR_DOT = 1,
+        CHAR_COLON = 2,
+        CHAR_PIPE = 4
+    };
+
+    /**
+     * @brief 256-entry table mapping every character to its 'char_class'.
+     */
+    struct char_class_table {
+        uint8_t cls[256];
+
+        char_class_table() {
+            for (int i = 0; i < 256; i++) {
+                cls[i] = CHAR_OTHER;
             }
+            cls[static_cast<uint8_t>('.')] = CHAR_DOT;
+            cls[static_cast<uint8_t>(':')] = CHAR_COLON;
+            cls[static_cast<uint8_t>('|')] = CHAR_PIPE;
         }
-    }
-    
-    // L2 packets have MAC addresses (format: src_mac|dst_mac|...|checksum)
-    // Check if the first two parts contain colons (MAC addresses)
-    if (first_pipe != std::string::npos) {
-        std::string first_part = packet.substr(0, first_pipe);
-        size_t second_pipe = packet.find('|', first_pipe + 1);
-        if (second_pipe != std::string::npos) {
-            std::string second_part = packet.substr(first_pipe + 1, second_pipe - first_pipe - 1);
-            
-            // If both parts contain colons, it's likely an L2 packet
-            if (first_part.find(':') != std::string::npos && second_part.find(':') != std::string::npos) {
-                return new l2_packet(packet);
+    };
+
+    const char_class_table char_classes;
+}
+
+common::packet_layer nic_sim::classify_packet(common::field_view packet) {
+    // Classes seen in the first and second field
+    uint8_t seen[2] = {0, 0};
+    int pipe_count = 0;
+
+    for (size_t i = 0; i < packet.size(); i++) {
+        uint8_t cls = char_classes.cls[static_cast<uint8_t>(packet[i])];
+        if (cls != CHAR_PIPE) {
+            if (pipe_count < 2) {
+                seen[pipe_count] |= cls;
+            }
+            continue;
+        }
+
+        pipe_count++;
+        if (pipe_count == 2) {
+            // L3 packets have IP addresses (format: src_ip|dst_ip|...)
+            if ((seen[0] & seen[1] & CHAR_DOT) != 0) {
+                return common::LAYER_L3;
+            }
+            // L2 packets have MAC addresses (format: src_mac|dst_mac|...|checksum)
+            if ((seen[0] & seen[1] & CHAR_COLON) != 0) {
+                return common::LAYER_L2;
             }
+        } else if (pipe_count == 3) {
+            // L4 packets have ports (format: src_port|dst_port|index|data_bytes)
+            return common::LAYER_L4;
         }
     }
-    
-    // L4 packets have ports (format: index|src_port|dest_port|data_bytes)
-    if (pipe_count >= 3) {
-        return new l4_packet(packet);
+
+    return common::LAYER_AUTO;
+}
+
+bool nic_sim::parse_layer_header(common::field_view line,
+                                 common::packet_layer &layer) {
+    static const char prefix[] = "#layer ";
+    const size_t prefix_len = sizeof(prefix) - 1;
+
+    if (line.size() != prefix_len + 2 ||
+        std::memcmp(line.ptr, prefix, prefix_len) != 0 ||
+        line[prefix_len] != 'L') {
+        return false;
     }
-    
-    return nullptr;
-} 
\ No newline at end of file
+
+    switch (line[prefix_len + 1]) {
+        case '2':
+            layer = common::LAYER_L2;
+            return true;
+        case '3':
+            layer = common::LAYER_L3;
+            return true;
+        case '4':
+            layer = common::LAYER_L4;
+            return true;
+        default:
+            return false;
+    }
+}
@@ -17,6 +17,78 @@
 #include "L2.h"
 #include "L3.h"
 #include "L4.h"
+#include "packet_slot.hpp"
+#include "result_writer.hpp"
+#include "flow_stats.hpp"
+#include "latency_histogram.hpp"
+#include "packet_queue.hpp"
+#include "route_table.hpp"
+#include "acl_table.hpp"
+#include "header_batch.hpp"
+#include "nat_table.hpp"
+#include "ring_queues.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Options of 'nic_flow'. Most change how packets are fed to the NIC
+ *        and not the result, except 'layer', 'checksum', 'nat_timeout' and
+ *        'ring_full' with RING_DROP.
+ * @param ingest - How the packet file is read.
+ * @param layer - Layer of every packet in the trace, LAYER_AUTO to detect it
+ *        per packet. Overrides a "#layer" header line in the packet file.
+ * @param checksum - Whether L2/L3 checksums are validated.
+ * @param threads - Amount of parse/validate workers, 1 runs the whole flow
+ *        on the calling thread.
+ * @param shards - Amount of flow-affinity shards, more than 1 selects the
+ *        sharded flow (and 'threads' is ignored).
+ * @param ring_depth - Capacity of the RQ/TQ rings, 0 stores queued packets
+ *        straight to host memory without rings.
+ * @param ring_full - What happens to a packet queued to a full ring. With
+ *        RING_DROP the results depend on thread timing.
+ * @param stats - Whether drop/route counters and stage timers are collected,
+ *        see 'nic_print_stats'.
+ * @param stats_interval_ms - Period of the snapshots written to stderr while
+ *        the flow runs, 0 for none. Only used with 'stats'.
+ * @param latency - Whether per-packet latency histograms are recorded, see
+ *        'nic_print_latency'.
+ * @param nat_timeout - Idle packets before a NAT connection is evicted,
+ *        default 65536.
+ */
+struct flow_options {
+    common::ingest_mode ingest;
+    common::packet_layer layer;
+    common::checksum_mode checksum;
+    unsigned threads;
+    unsigned shards;
+    size_t ring_depth;
+    common::ring_policy ring_full;
+    bool stats;
+    unsigned stats_interval_ms;
+    bool latency;
+    uint64_t nat_timeout;
+
+    flow_options() : ingest(common::INGEST_MMAP), layer(common::LAYER_AUTO),
+                     checksum(common::CHECKSUM_OFF), threads(1), shards(1),
+                     ring_depth(0), ring_full(common::RING_BLOCK), stats(false),
+                     stats_interval_ms(0), latency(false), nat_timeout(65536) {}
+};
+
+/**
+ * @brief A line of a trace, classified and parsed ahead of time.
+ * @param line - The line, its views must stay valid while it is used.
+ * @param layer - Layer of the line, LAYER_AUTO if it isn't a packet.
+ * @param parsed - Whether 'record' holds the parsed packet.
+ * @param record - The packet, as parsed by its layer.
+ */
+struct parsed_packet {
+    common::field_view line;
+    common::packet_layer layer;
+    bool parsed;
+    common::packet_record record;
+};
+
+class task_pool;
 
 class nic_sim {
     public:
@@ -30,15 +102,88 @@ class nic_sim {
      */
     nic_sim(std::string param_file);
 
+    /**
+     * @fn nic_load_acl
+     * @brief Loads the rules of an ACL file (see acl_table.hpp), applied to
+     *        every packet of the following flows before validation.
+     *
+     * @param acl_file - Name of the ACL file.
+     *
+     * @return true on success, false if the file can't be read or holds an
+     *         invalid rule, the NIC's rules are then unchanged.
+     */
+    bool nic_load_acl(const std::string &acl_file);
+
     /**
      * @fn nic_flow
      * @brief Process and store to relevant location all packets in packet_file.
      *
      * @param packet_file - Name of file containing packets as strings.
+     * @param options - Ingestion options, see 'flow_options'.
+     *
+     * @return None.
+     *
+     * @note In INGEST_MMAP mode the file is mapped and packets are parsed
+     *       straight from the mapped pages. If the file can't be mapped
+     *       (e.g it's a pipe) the function falls back to INGEST_STREAM.
+     *
+     * @note If the first line of the file is "#layer L2", "#layer L3" or
+     *       "#layer L4", every packet is built as that layer without
+     *       running packet detection.
+     *
+     * @note With more than one thread the flow is pipelined, see
+     *       'pipelined_flow', with more than one shard it is sharded, see
+     *       'sharded_flow'. The results are identical to a single thread.
+     *
+     * @note With a ring depth, queued packets go through bounded RQ/TQ rings
+     *       (one pair per shard when sharded) that a drain thread empties
+     *       into host memory, in trace order, while the flow runs.
+     */
+    void nic_flow(std::string packet_file,
+                  const flow_options &options = flow_options());
+
+    /**
+     * @fn nic_sweep
+     * @brief Runs a single trace through several NICs, reading and parsing
+     *        it only once, see flow_sweep.cpp.
+     *
+     * @param packet_file - Name of file containing packets as strings.
+     * @param sims - The NICs.
+     * @param options - Flow options of every NIC. 'threads', 'shards' and
+     *        the ring options are not used, the pool runs the flow.
+     * @param pool - Threads parsing the trace and running the NICs.
+     *
+     * @return true if the file was read, false if it can't be opened.
+     *
+     * @note Every NIC's results are the same as with 'nic_flow'.
+     */
+    static bool nic_sweep(const std::string &packet_file,
+                          const std::vector<nic_sim *> &sims,
+                          const flow_options &options, task_pool &pool);
+
+    /**
+     * @fn process_batch
+     * @brief Processes and stores a batch of built packets in order, like
+     *        the single packet path, with the L3 headers of the batch laid
+     *        out as arrays (see header_batch.hpp).
+     *
+     * @param [in] slots - The packets, at most header_batch::CAPACITY.
+     * @param [in] valid - Whether every packet passed the ACL and
+     *        validation, the others are skipped.
+     * @param [in] verdicts - ACL action of every valid packet.
+     * @param [in] count - Amount of packets.
+     * @param [in] first_clock - NAT packet clock of the first packet, every
+     *        next packet is one later.
+     * @param [out] outcomes - Final decision of every valid packet.
      *
      * @return None.
+     *
+     * @note Stores to the NIC's memory spaces, a single thread at a time
+     *       may call it.
      */
-    void nic_flow(std::string packet_file);
+    void process_batch(packet_slot slots[], const bool valid[],
+                       const common::acl_action verdicts[], size_t count,
+                       uint64_t first_clock, common::latency_outcome outcomes[]);
 
     /**
      * @fn nic_print_results
@@ -59,6 +204,58 @@ class nic_sim {
      */
     void nic_print_results();
 
+    /**
+     * @fn nic_print_results
+     * @brief Same as nic_print_results(), to an open file descriptor.
+     *
+     * @param fd - File descriptor to write to, it is not closed.
+     *
+     * @return true on success, false on an I/O error.
+     */
+    bool nic_print_results(int fd);
+
+    /**
+     * @fn nic_print_results
+     * @brief Same as nic_print_results(), to a file.
+     *
+     * @param path - File to create (or truncate) and write to.
+     *
+     * @return true on success, false if the file can't be written.
+     */
+    bool nic_print_results(const std::string &path);
+
+    /**
+     * @fn nic_ring_counters
+     * @brief Returns the counters of the RQ or TQ ring, summed over all flows.
+     *
+     * @param queue - common::RQ or common::TQ.
+     *
+     * @return The counters, zero if no flow used rings.
+     */
+    ring_counters nic_ring_counters(common::memory_dest queue) const;
+
+    /**
+     * @fn nic_print_stats
+     * @brief Writes the drop/route counters and stage times of all flows run
+     *        with statistics as a single line JSON object ("kind": "summary").
+     *
+     * @param out - Stream to write to.
+     *
+     * @return None.
+     */
+    void nic_print_stats(std::ostream &out) const;
+
+    /**
+     * @fn nic_print_latency
+     * @brief Writes the latency percentiles of all flows run with latency
+     *        histograms as a single line JSON object ("kind": "latency").
+     *
+     * @param out - Stream to write to.
+     *
+     * @return None.
+     */
+    void nic_print_latency(std::ostream &out) const;
+
     /**
      * @fn ~nic_sim
      * @brief Destructor of the class.
@@ -70,29 +267,247 @@ class nic_sim {
     private:
     /**
      * @fn packet_factory
-     * @brief Gets a string representing a packet, creates the corresponding
-     *        packet type, and returns a pointer to a generic_packet.
+     * @brief Gets a string representing a packet and creates the
+     *        corresponding packet type in 'slot', without allocating.
+     *
+     * @param packet - String representation of a packet.
+     * @param layer - Layer of the packet, LAYER_AUTO to detect it.
+     * @param slot - Storage to build the packet in.
+     * @param nat - Connection tracking the packet translates through.
+     *
+     * @return true if a packet was created, false if 'packet' isn't one.
+     */
+    bool packet_factory(common::field_view packet,
+                        common::packet_layer layer,
+                        packet_slot &slot,
+                        common::nat_table *nat);
+
+    /**
+     * @fn classify_packet
+     * @brief Detects the layer of a packet in a single forward scan of its
+     *        first fields, without allocating.
+     *
+     *        L3 - the first two fields contain '.' (IP addresses).
+     *        L2 - the first two fields contain ':' (MAC addresses).
+     *        L4 - anything else with at least 3 '|' delimiters.
      *
      * @param packet - String representation of a packet.
      *
-     * @return Pointer to a generic_packet object.
+     * @return Layer of the packet, LAYER_AUTO if it isn't a packet.
      */
-    generic_packet *packet_factory(std::string &packet);
+    static common::packet_layer classify_packet(common::field_view packet);
 
     /**
-     * @param open_ports - Vector containing all open communications.
-     * @param RQ - Vector of strings to store packets that sent to RQ.
-     * @param TQ - Vector of strings to store packets that sent to TQ.
+     * @fn parse_layer_header
+     * @brief Parses a "#layer Lx" trace header line.
+     *
+     * @param [in] line - First line of the packet file.
+     * @param [out] layer - Declared layer.
+     *
+     * @return true if 'line' is a layer header, false otherwise.
+     */
+    static bool parse_layer_header(common::field_view line,
+                                   common::packet_layer &layer);
+
+    /**
+     * @fn print_results
+     * @brief Formats all memory spaces into 'out', see nic_print_results().
+     *
+     * @param out - Writer to format into.
+     *
+     * @return true on success, false on an I/O error.
+     */
+    bool print_results(result_writer &out);
+
+    /**
+     * @fn handle_packet
+     * @brief Runs a single packet line through factory, validation, processing
+     *        and storage.
+     *
+     * @param line - Packet line, must stay alive for the duration of the call.
+     *
+     * @return None.
+     */
+    void handle_packet(common::field_view line);
+
+    /**
+     * @fn handle_parsed
+     * @brief Same as 'handle_packet', for a line parsed ahead of time.
+     *
+     * @param packet - The line, must stay alive for the duration of the call.
+     *
+     * @return None.
+     */
+    void handle_parsed(const parsed_packet &packet);
+
+    /**
+     * @fn decide_packet
+     * @brief Runs the packet built in 'slot' through the ACL, validation,
+     *        processing and storage, and empties the slot.
+     *
+     * @param probe - Latency probe of the packet.
+     *
+     * @return None.
+     */
+    void decide_packet(common::latency_probe &probe);
+
+    /**
+     * @fn begin_flow
+     * @brief Applies the options of a new flow to the NIC.
+     *
+     * @return None.
+     */
+    void begin_flow(const flow_options &options);
+
+    /**
+     * @fn take_header
+     * @brief Consumes the "#layer" header if 'line' is the first line of the
+     *        trace and declares one.
+     *
+     * @param line - Line of the packet file.
+     *
+     * @return true if the line was a header and must not be handled as a
+     *         packet, false otherwise.
+     */
+    bool take_header(common::field_view line);
+
+    /**
+     * @fn acl_verdict
+     * @brief Runs the ACL on a built packet, ahead of its validation.
+     *
+     * @param slot - Slot holding the packet.
+     *
+     * @return The action of the packet, ACL_ALLOW without rules or if the
+     *         packet didn't parse. L4 packets can't be queued, a redirect
+     *         denies them.
+     */
+    common::acl_action acl_verdict(packet_slot &slot) const;
+
+    /**
+     * @fn store_packet
+     * @brief Processes a validated packet, or takes the queue an ACL rule
+     *        redirects it to, and stores it in its destination.
+     *
+     * @param [in] slot - Slot holding the validated packet.
+     * @param [in] verdict - ACL action of the packet, never ACL_DENY.
+     * @param [out] dst - Where the packet was stored.
+     *
+     * @return true if the packet was stored, false if processing dropped it.
+     */
+    bool store_packet(packet_slot &slot, common::acl_action verdict,
+                      common::memory_dest &dst);
+
+    /**
+     * @fn enqueue
+     * @brief Stores a formatted packet to RQ or TQ, through the rings if the
+     *        flow has them.
+     *
+     * @param queue - common::RQ or common::TQ.
+     * @param seq - Position of the packet in the trace.
+     * @param rec - The packet, after processing.
+     *
+     * @return None.
+     */
+    void enqueue(common::memory_dest queue, uint64_t seq,
+                 const common::packet_record &rec);
+
+    /**
+     * @fn pipelined_flow
+     * @brief Runs the flow on a pipeline of threads: the calling thread reads
+     *        the trace in batches, 'workers' threads build and validate the
+     *        packets of a batch, and a single commit thread processes and
+     *        stores them in trace order.
+     *
+     * @param packet_file - Name of file containing packets as strings.
+     * @param ingest - How the packet file is read.
+     * @param workers - Amount of parse/validate threads.
+     *
+     * @return true if the file was read, false if it can't be opened.
+     *
+     * @note Validation only reads the NIC parameters and 'open_ports', which
+     *       don't change during a flow, so it is safe to run out of order.
+     *       Everything that writes (TTL/NAT rewrites, DRAM, RQ and TQ) happens
+     *       on the commit thread in the order of the trace.
+     */
+    bool pipelined_flow(const std::string &packet_file,
+                        common::ingest_mode ingest, unsigned workers);
+
+    /**
+     * @fn sharded_flow
+     * @brief Runs the flow on 'shards' threads, each owning the packets whose
+     *        (src_port, dst_port) flow key hashes to it, its part of
+     *        'open_ports' and its own RQ/TQ segments. The calling thread reads
+     *        the trace and dispatches every line to its shard, the results
+     *        are merged back in trace order at the end.
+     *
+     * @param packet_file - Name of file containing packets as strings.
+     * @param ingest - How the packet file is read.
+     * @param shards - Amount of shard threads.
+     *
+     * @return true if the file was read, false if it can't be opened.
+     *
+     * @note The flow key is the only state shared between packets (a port's
+     *       DRAM data), so packets of different shards never interact.
+     */
+    bool sharded_flow(const std::string &packet_file,
+                      common::ingest_mode ingest, unsigned shards);
+
+    /**
+     * @fn shard_ring_floors
+     * @brief Amount of ring floor slots 'sharded_flow' publishes, see
+     *        queue_rings::set_floor.
+     */
+    static size_t shard_ring_floors(unsigned shards);
+
+    /**
+     * @param open_ports - Flow table of all open communications.
+     * @param RQ - Packets that were sent to RQ.
+     * @param TQ - Packets that were sent to TQ.
      * @param mac - NIC's MAC address.
      * @param nic_ip - NIC's IP address.
      * @param mask - NIC's subnet mask.
+     * @param routes - Routing table: the NIC's subnet to RQ, everything else
+     *        to NAT, and the "route:" lines of the param file on top.
+     * @param acl - Rules applied to every packet before validation.
+     * @param nat - Connections of the local endpoints translated by NAT.
+     * @param packet_clock - Packets read over all flows, the clock of 'nat'.
      */
     common::open_port_vec open_ports;
-    std::vector<std::string> RQ;
-    std::vector<std::string> TQ;
+    common::packet_queue RQ;
+    common::packet_queue TQ;
     uint8_t mac[MAC_SIZE];
     uint8_t nic_ip[IP_V4_SIZE];
     uint8_t mask;
+    common::route_table routes;
+    common::acl_table acl;
+    common::nat_table nat;
+    uint64_t packet_clock;
+
+    /**
+     * @param layer_hint - Layer of the packets of the current trace.
+     * @param first_line - true until the first line of the trace is seen.
+     * @param checksum_check - Checksum validation mode of the current trace.
+     * @param slot - Storage reused by every packet of the flow.
+     * @param rings - RQ/TQ rings of the current flow, if it has any.
+     * @param ring_stats - RQ and TQ ring counters of finished flows.
+     * @param stats_enabled - Whether the threads of the current flow count.
+     * @param stats - Counters of all threads of all flows.
+     * @param stats_elapsed_ns - Wall time of the flows run with statistics.
+     * @param latency_enabled - Whether the threads of the current flow record
+     *        packet latency.
+     * @param latency - Latency histograms of all threads of all flows.
+     */
+    common::packet_layer layer_hint;
+    bool first_line;
+    common::checksum_mode checksum_check;
+    packet_slot slot;
+    std::unique_ptr<queue_rings> rings;
+    ring_counters ring_stats[2];
+    bool stats_enabled;
+    common::stats_registry stats;
+    uint64_t stats_elapsed_ns;
+    bool latency_enabled;
+    common::latency_registry latency;
 
     /**
      * @note It is recommended and even encouraged to add new functions or
@@ -0,0 +1,383 @@
+/**
+ * @file acl_table.cpp
+ * @brief Implementation of the ACL packet classifier of the NIC simulation
+ *        project.
+ */
+
+#include "acl_table.hpp"
+#include "route_table.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace {
+    /* Width in bits of every field, in 'acl_field' order. */
+    const int FIELD_BITS[common::ACL_FIELDS] = {48, 48, 32, 32, 16, 16, 8};
+
+    /* Names of the fields in an ACL file, in 'acl_field' order. */
+    const char *const FIELD_NAMES[common::ACL_FIELDS] = {
+        "src_mac", "dst_mac", "src_ip", "dst_ip", "src_port", "dst_port", "ttl"
+    };
+
+    /**
+     * @brief An aligned block of a field's values, 'len' leading bits fixed.
+     */
+    struct field_prefix {
+        uint64_t value;
+        int len;
+    };
+
+    uint64_t field_max(int field) {
+        return (static_cast<uint64_t>(1) << FIELD_BITS[field]) - 1;
+    }
+
+    uint64_t prefix_mask(int field, int len) {
+        if (len == 0) {
+            return 0;
+        }
+        return field_max(field) & ~((static_cast<uint64_t>(1) << (FIELD_BITS[field] - len)) - 1);
+    }
+
+    /**
+     * @fn split_range
+     * @brief Covers [low, high] of a field with the fewest aligned prefixes.
+     *
+     * @return None.
+     */
+    void split_range(int field, uint64_t low, uint64_t high,
+                     std::vector<field_prefix> &out) {
+        int bits = FIELD_BITS[field];
+        for (;;) {
+            // Largest block starting at 'low' that stays inside the range
+            int size = 0;
+            while (size < bits && (low & ((static_cast<uint64_t>(2) << size) - 1)) == 0 &&
+                   low + (static_cast<uint64_t>(2) << size) - 1 <= high) {
+                size++;
+            }
+            field_prefix block = {low, bits - size};
+            out.push_back(block);
+            uint64_t last = low + (static_cast<uint64_t>(1) << size) - 1;
+            if (last >= high) {
+                return;
+            }
+            low = last + 1;
+        }
+    }
+
+    uint64_t mac_to_u64(const uint8_t mac[common::MAC_SIZE]) {
+        uint64_t value = 0;
+        for (int i = 0; i < common::MAC_SIZE; i++) {
+            value = (value << 8) | mac[i];
+        }
+        return value;
+    }
+
+    /**
+     * @fn parse_range
+     * @brief Parses "value" or "low-high", both at most 'max'.
+     */
+    bool parse_range(common::field_view text, uint32_t max, uint64_t &low,
+                     uint64_t &high) {
+        size_t dash = text.find('-');
+        uint32_t first = 0, last = 0;
+        if (common::parse_uint(text.substr(0, dash), max, first) != common::PARSE_OK) {
+            return false;
+        }
+        last = first;
+        if (dash != common::field_view::npos &&
+            common::parse_uint(text.substr(dash + 1), max, last) != common::PARSE_OK) {
+            return false;
+        }
+        if (last < first) {
+            return false;
+        }
+        low = first;
+        high = last;
+        return true;
+    }
+
+    /**
+     * @fn parse_value
+     * @brief Parses the value of a field into the range it matches.
+     */
+    bool parse_value(int field, common::field_view text, uint64_t &low,
+                     uint64_t &high) {
+        switch (field) {
+            case common::ACL_SRC_MAC:
+            case common::ACL_DST_MAC: {
+                uint8_t mac[common::MAC_SIZE];
+                if (common::parse_address(text, ':', 16, mac, common::MAC_SIZE) !=
+                        common::PARSE_OK) {
+                    return false;
+                }
+                low = high = mac_to_u64(mac);
+                return true;
+            }
+            case common::ACL_SRC_IP:
+            case common::ACL_DST_IP: {
+                size_t slash = text.find('/');
+                uint8_t ip[common::IP_V4_SIZE];
+                uint32_t len = 32;
+                if (common::parse_address(text.substr(0, slash), '.', 10, ip,
+                                          common::IP_V4_SIZE) != common::PARSE_OK ||
+                    (slash != common::field_view::npos &&
+                     common::parse_uint(text.substr(slash + 1), 32, len) != common::PARSE_OK)) {
+                    return false;
+                }
+                uint64_t mask = prefix_mask(field, static_cast<int>(len));
+                low = common::ip_to_u32(ip) & mask;
+                high = low | (field_max(field) & ~mask);
+                return true;
+            }
+            case common::ACL_SRC_PORT:
+            case common::ACL_DST_PORT:
+                return parse_range(text, 0xFFFF, low, high);
+            case common::ACL_TTL:
+                return parse_range(text, 0xFF, low, high);
+        }
+        return false;
+    }
+
+    /**
+     * @fn mix
+     * @brief splitmix64 finalizer.
+     */
+    uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+}
+
+namespace common {
+    const uint32_t acl_table::NO_RULE;
+
+    acl_table::acl_table() {}
+
+    void acl_table::add(const acl_rule &rule) {
+        rules.push_back(rule);
+    }
+
+    acl_table::acl_key acl_table::make_key(const uint64_t values[ACL_FIELDS],
+                                           const uint64_t mask[ACL_FIELDS]) {
+        acl_key key;
+        key.src = ((values[ACL_SRC_MAC] & mask[ACL_SRC_MAC]) << 16) |
+                  (values[ACL_SRC_PORT] & mask[ACL_SRC_PORT]);
+        key.dst = ((values[ACL_DST_MAC] & mask[ACL_DST_MAC]) << 16) |
+                  (values[ACL_DST_PORT] & mask[ACL_DST_PORT]);
+        key.ips = ((values[ACL_SRC_IP] & mask[ACL_SRC_IP]) << 32) |
+                  (values[ACL_DST_IP] & mask[ACL_DST_IP]);
+        key.ttl = static_cast<uint8_t>(values[ACL_TTL] & mask[ACL_TTL]);
+        return key;
+    }
+
+    uint64_t acl_table::key_hash(const acl_key &key) {
+        return mix(key.src ^ mix(key.dst ^ mix(key.ips ^ key.ttl)));
+    }
+
+    void acl_table::insert(acl_tuple &tuple, const acl_key &key, uint32_t rule) {
+        uint64_t hash = key_hash(key);
+        size_t first, second;
+        filter_bits(tuple, hash, first, second);
+        tuple.filter[first / 64] |= static_cast<uint64_t>(1) << (first % 64);
+        tuple.filter[second / 64] |= static_cast<uint64_t>(1) << (second % 64);
+
+        size_t mask = tuple.entries.size() - 1;
+        size_t i = hash & mask;
+        while (tuple.entries[i].rule != NO_RULE) {
+            if (tuple.entries[i].key == key) {
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+        tuple.entries[i].key = key;
+        tuple.entries[i].rule = rule;
+    }
+
+    void acl_table::compile() {
+        tuples.clear();
+
+        // Expand every rule into the cross product of its fields' prefixes,
+        // grouped by their prefix lengths and named fields
+        std::map<std::vector<int>, size_t> tuple_of;
+        std::vector<std::vector<std::pair<acl_key, uint32_t> > > keys;
+        for (uint32_t r = 0; r < rules.size(); r++) {
+            const acl_rule &rule = rules[r];
+            std::vector<field_prefix> prefixes[ACL_FIELDS];
+            for (int f = 0; f < ACL_FIELDS; f++) {
+                split_range(f, rule.low[f], rule.high[f], prefixes[f]);
+            }
+
+            size_t pick[ACL_FIELDS] = {0};
+            for (;;) {
+                std::vector<int> lens(ACL_FIELDS + 1);
+                lens[ACL_FIELDS] = static_cast<int>(rule.named);
+                uint64_t values[ACL_FIELDS];
+                uint64_t mask[ACL_FIELDS];
+                for (int f = 0; f < ACL_FIELDS; f++) {
+                    lens[f] = prefixes[f][pick[f]].len;
+                    values[f] = prefixes[f][pick[f]].value;
+                    mask[f] = prefix_mask(f, lens[f]);
+                }
+
+                std::map<std::vector<int>, size_t>::iterator found = tuple_of.find(lens);
+                if (found == tuple_of.end()) {
+                    acl_tuple tuple;
+                    tuple.needs = rule.named;
+                    for (int f = 0; f < ACL_FIELDS; f++) {
+                        tuple.mask[f] = mask[f];
+                    }
+                    tuple.first_rule = r;
+                    found = tuple_of.insert(std::make_pair(lens, tuples.size())).first;
+                    tuples.push_back(tuple);
+                    keys.push_back(std::vector<std::pair<acl_key, uint32_t> >());
+                }
+                keys[found->second].push_back(std::make_pair(make_key(values, mask), r));
+
+                // Next combination, odometer style
+                int f = 0;
+                while (f < ACL_FIELDS && ++pick[f] == prefixes[f].size()) {
+                    pick[f++] = 0;
+                }
+                if (f == ACL_FIELDS) {
+                    break;
+                }
+            }
+        }
+
+        for (size_t t = 0; t < tuples.size(); t++) {
+            size_t size = 16;
+            while (size < keys[t].size() * 2) {
+                size *= 2;
+            }
+            acl_entry empty;
+            std::memset(&empty, 0, sizeof(empty));
+            empty.rule = NO_RULE;
+            tuples[t].entries.assign(size, empty);
+            // 8 filter bits per key, up to 2^20 (see 'filter_bits')
+            size_t words = 1;
+            while (words * 64 < keys[t].size() * 8 && words < (1 << 14)) {
+                words *= 2;
+            }
+            tuples[t].filter.assign(words, 0);
+            // Keys were collected in rule order, the first rule of a key stays
+            for (const std::pair<acl_key, uint32_t> &key : keys[t]) {
+                insert(tuples[t], key.first, key.second);
+            }
+        }
+
+        // Tuples holding earlier rules first, see 'classify'
+        std::stable_sort(tuples.begin(), tuples.end(),
+                         [](const acl_tuple &a, const acl_tuple &b) {
+                             return a.first_rule < b.first_rule;
+                         });
+    }
+
+    acl_action acl_table::classify(const packet_record &rec, packet_layer layer) const {
+        // Fields the packet carries, the others stay 0 and never match
+        uint64_t values[ACL_FIELDS] = {0};
+        unsigned has = (1u << ACL_SRC_PORT) | (1u << ACL_DST_PORT);
+        values[ACL_SRC_PORT] = rec.src_port;
+        values[ACL_DST_PORT] = rec.dst_port;
+        if (layer == LAYER_L2 || layer == LAYER_L3) {
+            has |= (1u << ACL_SRC_IP) | (1u << ACL_DST_IP) | (1u << ACL_TTL);
+            values[ACL_SRC_IP] = ip_to_u32(rec.src_ip);
+            values[ACL_DST_IP] = ip_to_u32(rec.dst_ip);
+            values[ACL_TTL] = rec.ttl;
+        }
+        if (layer == LAYER_L2) {
+            has |= (1u << ACL_SRC_MAC) | (1u << ACL_DST_MAC);
+            values[ACL_SRC_MAC] = mac_to_u64(rec.src_mac);
+            values[ACL_DST_MAC] = mac_to_u64(rec.dst_mac);
+        }
+
+        uint32_t best = NO_RULE;
+        for (const acl_tuple &tuple : tuples) {
+            // Every later tuple only holds later rules than this one
+            if (tuple.first_rule >= best) {
+                break;
+            }
+            if (tuple.needs & ~has) {
+                continue;
+            }
+            acl_key key = make_key(values, tuple.mask);
+            uint64_t hash = key_hash(key);
+            size_t first, second;
+            filter_bits(tuple, hash, first, second);
+            if (!((tuple.filter[first / 64] >> (first % 64)) & 1) ||
+                !((tuple.filter[second / 64] >> (second % 64)) & 1)) {
+                continue;
+            }
+            size_t mask = tuple.entries.size() - 1;
+            for (size_t i = hash & mask; tuple.entries[i].rule != NO_RULE;
+                 i = (i + 1) & mask) {
+                if (tuple.entries[i].key == key) {
+                    best = std::min(best, tuple.entries[i].rule);
+                    break;
+                }
+            }
+        }
+        return best == NO_RULE ? ACL_ALLOW : rules[best].action;
+    }
+
+    bool acl_table::parse_rule(field_view text, acl_rule &rule) {
+        // Format: <action> [field=value ...]
+        while (!text.empty() && (text[text.size() - 1] == ' ' || text[text.size() - 1] == '\r')) {
+            text = text.substr(0, text.size() - 1);
+        }
+        field_tokenizer tokens(text, ' ');
+        field_view token;
+        do {
+            if (!tokens.next(token)) {
+                return false;
+            }
+        } while (token.empty());
+
+        static const struct {
+            const char *name;
+            acl_action action;
+        } ACTIONS[] = {
+            {"allow", ACL_ALLOW}, {"deny", ACL_DENY},
+            {"redirect=RQ", ACL_REDIRECT_RQ}, {"redirect=TQ", ACL_REDIRECT_TQ}
+        };
+        bool known = false;
+        for (const auto &action : ACTIONS) {
+            if (token.size() == std::strlen(action.name) &&
+                std::memcmp(token.ptr, action.name, token.size()) == 0) {
+                rule.action = action.action;
+                known = true;
+            }
+        }
+        if (!known) {
+            return false;
+        }
+
+        for (int f = 0; f < ACL_FIELDS; f++) {
+            rule.low[f] = 0;
+            rule.high[f] = field_max(f);
+        }
+        rule.named = 0;
+        while (tokens.next(token)) {
+            if (token.empty()) {
+                continue;
+            }
+            size_t equals = token.find('=');
+            if (equals == field_view::npos) {
+                return false;
+            }
+            field_view name = token.substr(0, equals);
+            int field = 0;
+            while (field < ACL_FIELDS &&
+                   !(name.size() == std::strlen(FIELD_NAMES[field]) &&
+                     std::memcmp(name.ptr, FIELD_NAMES[field], name.size()) == 0)) {
+                field++;
+            }
+            if (field == ACL_FIELDS ||
+                !parse_value(field, token.substr(equals + 1), rule.low[field], rule.high[field])) {
+                return false;
+            }
+            rule.named |= 1u << field;
+        }
+        return true;
+    }
+}
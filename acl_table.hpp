@@ -0,0 +1,200 @@
+/**
+ * @file acl_table.hpp
+ * @brief This header defines the ACL packet classifier of the NIC simulation
+ *        project.
+ *
+ * An ACL file holds one rule per line, the first matching rule decides:
+ *
+ *     <allow|deny|redirect=RQ|redirect=TQ> [field=value ...]
+ *
+ * Fields are src_mac/dst_mac (a MAC address), src_ip/dst_ip (an address
+ * with an optional /len prefix), src_port/dst_port (a port or a range
+ * "low-high") and ttl (a value or a range). A field left out matches
+ * anything, a field a packet doesn't carry (the MACs of L3/L4 packets, the
+ * IP header of L4 packets) never matches. Lines starting with '#' are
+ * comments. Packets no rule matches are allowed.
+ *
+ * RQ and TQ only hold packets with an IP header, so a redirect that matches
+ * an L4 packet denies it instead (it is counted as acl_deny).
+ *
+ * Rules are compiled for tuple space search: ranges are split into aligned
+ * prefixes, and every combination of prefix lengths (a tuple) gets a hash
+ * table of the masked field values. A packet costs a hash probe per tuple,
+ * and tuples are tried in the order of their first rule so the search stops
+ * at the first tuple that can't beat the match found so far. Rule sets share
+ * a handful of tuples, so thousands of rules cost about as much as a few.
+ * Every tuple also has a Bloom filter of its keys, small enough to stay in
+ * cache, so a tuple a packet doesn't match rarely costs a cache miss.
+ */
+
+#ifndef __ACL_TABLE__
+#define __ACL_TABLE__
+
+#include <cstdint>
+#include <vector>
+#include "common.hpp"
+
+namespace common {
+    /* What happens to a packet before validate_packet. */
+    enum acl_action {
+        ACL_ALLOW = 0,      /* Validate and process the packet as usual. */
+        ACL_DENY,           /* Drop the packet. */
+        ACL_REDIRECT_RQ,    /* Store the packet to RQ as is, deny L4 ones. */
+        ACL_REDIRECT_TQ     /* Store the packet to TQ as is, deny L4 ones. */
+    };
+
+    /* Packet fields a rule can match on. */
+    enum acl_field {
+        ACL_SRC_MAC = 0,
+        ACL_DST_MAC,
+        ACL_SRC_IP,
+        ACL_DST_IP,
+        ACL_SRC_PORT,
+        ACL_DST_PORT,
+        ACL_TTL,
+        ACL_FIELDS
+    };
+
+    /**
+     * @brief A rule as declared, every field a range of values.
+     * @param action - Decision of the packets the rule matches.
+     * @param low, high - Matching range of every field, the whole range of
+     *        the field when it is left out.
+     * @param named - Fields the rule names, as bits. Packets that don't
+     *        carry one of them never match, even for a whole range.
+     */
+    struct acl_rule {
+        acl_action action;
+        uint64_t low[ACL_FIELDS];
+        uint64_t high[ACL_FIELDS];
+        unsigned named;
+    };
+
+    class acl_table {
+        public:
+        /**
+         * @fn acl_table
+         * @brief Constructor of the class, creates a table allowing every
+         *        packet.
+         */
+        acl_table();
+
+        /**
+         * @fn add
+         * @brief Declares a rule after all declared ones, effective after
+         *        'compile'.
+         *
+         * @return None.
+         */
+        void add(const acl_rule &rule);
+
+        /**
+         * @fn compile
+         * @brief Rebuilds the tuples from all declared rules.
+         *
+         * @return None.
+         */
+        void compile();
+
+        /**
+         * @fn classify
+         * @brief Finds the action of the first rule matching a packet.
+         *
+         * @param rec - The parsed packet.
+         * @param layer - Layer of the packet, selects the fields it carries.
+         *
+         * @return The action, ACL_ALLOW if no rule matches.
+         */
+        acl_action classify(const packet_record &rec, packet_layer layer) const;
+
+        /* Whether there are compiled rules at all. */
+        bool empty() const { return tuples.empty(); }
+
+        /**
+         * @fn parse_rule
+         * @brief Parses a line of an ACL file, e.g
+         *        "deny src_ip=10.0.0.0/8 dst_port=0-1023".
+         *
+         * @param [in] text - Text to parse.
+         * @param [out] rule - The rule.
+         *
+         * @return true on success, false if the text is not a valid rule.
+         */
+        static bool parse_rule(field_view text, acl_rule &rule);
+
+        private:
+        /* Value of an empty entry of a tuple's hash table. */
+        static const uint32_t NO_RULE = 0xFFFFFFFFu;
+
+        /**
+         * @brief Masked field values, packed: MAC and port in one word per
+         *        direction, both IPs in one word.
+         */
+        struct acl_key {
+            uint64_t src;
+            uint64_t dst;
+            uint64_t ips;
+            uint8_t ttl;
+
+            bool operator==(const acl_key &other) const {
+                return src == other.src && dst == other.dst &&
+                       ips == other.ips && ttl == other.ttl;
+            }
+        };
+
+        /**
+         * @brief Entry of a tuple's hash table.
+         * @param rule - Index of the first rule with this key, NO_RULE if
+         *        the entry is empty.
+         */
+        struct acl_entry {
+            acl_key key;
+            uint32_t rule;
+        };
+
+        /**
+         * @brief Rules sharing the same prefix length in every field and the
+         *        same named fields.
+         * @param mask - Mask of every field.
+         * @param needs - Fields the rules name, as bits.
+         * @param first_rule - Smallest rule index in 'entries'.
+         * @param entries - Open-addressing hash table, at most half full.
+         * @param filter - Bloom filter of the keys, two bits per key.
+         */
+        struct acl_tuple {
+            uint64_t mask[ACL_FIELDS];
+            unsigned needs;
+            uint32_t first_rule;
+            std::vector<acl_entry> entries;
+            std::vector<uint64_t> filter;
+        };
+
+        static acl_key make_key(const uint64_t values[ACL_FIELDS],
+                                const uint64_t mask[ACL_FIELDS]);
+        static uint64_t key_hash(const acl_key &key);
+
+        /**
+         * @fn filter_bits
+         * @brief The two filter bits of a key hash, taken from the bits the
+         *        hash table index doesn't use.
+         */
+        static void filter_bits(const acl_tuple &tuple, uint64_t hash,
+                                size_t &first, size_t &second) {
+            size_t mask = tuple.filter.size() * 64 - 1;
+            first = static_cast<size_t>(hash >> 44) & mask;
+            second = static_cast<size_t>(hash >> 24) & mask;
+        }
+
+        /**
+         * @fn insert
+         * @brief Adds a key of 'rule' to a tuple, keeping the first rule of
+         *        duplicate keys.
+         */
+        static void insert(acl_tuple &tuple, const acl_key &key, uint32_t rule);
+
+        std::vector<acl_rule> rules;
+        std::vector<acl_tuple> tuples;
+    };
+}
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file alloc_counter.cpp
+ * @brief Implementation of the heap allocation counter for the NIC simulation
+ *        project.
+ */
+
+#include "alloc_counter.hpp"
+
+#ifdef NIC_COUNT_ALLOCS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<uint64_t> allocations(0);
+
+    void *counted_alloc(std::size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        void *ptr = std::malloc(size ? size : 1);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+}
+
+void *operator new(std::size_t size) { return counted_alloc(size); }
+void *operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+#endif
+
+namespace common {
+
+bool alloc_counting_enabled() {
+#ifdef NIC_COUNT_ALLOCS
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t alloc_count() {
+#ifdef NIC_COUNT_ALLOCS
+    return allocations.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+}
@@ -0,0 +1,33 @@
+/**
+ * @file alloc_counter.hpp
+ * @brief This header declares the heap allocation counter of the NIC
+ *        simulation project.
+ *
+ * When the project is built with NIC_COUNT_ALLOCS defined (make
+ * ALLOC_COUNT=1), the global operator new is replaced by a counting hook, so
+ * the allocations made by a piece of code can be measured from the outside.
+ */
+
+#ifndef __ALLOC_COUNTER__
+#define __ALLOC_COUNTER__
+
+#include <cstdint>
+
+namespace common {
+    /**
+     * @fn alloc_counting_enabled
+     * @brief Checks whether the counting hook is compiled in.
+     *
+     * @return true if 'alloc_count' is meaningful.
+     */
+    bool alloc_counting_enabled();
+
+    /**
+     * @fn alloc_count
+     * @brief Returns the amount of heap allocations made so far by all
+     *        threads, or 0 if counting is not compiled in.
+     */
+    uint64_t alloc_count();
+}
+
+#endif
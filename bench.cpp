@@ -0,0 +1,380 @@
+/**
+ * @file bench.cpp
+ * @brief This C++ file contains the benchmark harness of the NIC simulation
+ *        project (make bench).
+ *
+ * Every benchmark case is a synthetic trace of a single packet layer and a
+ * single routing outcome, run against a NIC with a given amount of open
+ * ports. The harness times 'nic_flow' over the trace, keeps the best of a few
+ * runs and reports packets/sec and ns/packet as JSON. With --compare it also
+ * checks the results against a saved report and fails on regressions. The
+ * report records the compiler flags of the harness, and a report of other
+ * flags is refused as a baseline.
+ *
+ * Usage: bench.exe [--packets=N] [--repeat=N] [--seed=N] [--output=path]
+ *                  [--compare=path] [--threshold=percent]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "NIC_sim.hpp"
+#include "result_writer.hpp"
+#include "traffic_gen.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+/* Compiler flags of the harness, set by the Makefile. */
+#ifndef NIC_BENCH_FLAGS
+#define NIC_BENCH_FLAGS "unknown"
+#endif
+
+namespace {
+    /* Open port table sizes every case is run with. */
+    const size_t PORT_TABLE_SIZES[] = {1, 256, 16384};
+
+    /**
+     * @brief Options of the harness.
+     * @param packets - Packets per trace.
+     * @param repeat - Runs per case, the fastest one is reported.
+     * @param seed - Seed of the traffic generator.
+     * @param output - Report file, empty for stdout.
+     * @param baseline - Report to compare against, empty to skip.
+     * @param threshold - Slowdown (percent of ns/packet) flagged as a
+     *        regression.
+     */
+    struct bench_options {
+        uint32_t packets;
+        uint32_t repeat;
+        uint32_t seed;
+        std::string output;
+        std::string baseline;
+        uint32_t threshold;
+
+        bench_options() : packets(100000), repeat(3), seed(1), threshold(10) {}
+    };
+
+    /**
+     * @brief Result of a single benchmark case.
+     */
+    struct bench_result {
+        std::string name;
+        common::packet_layer layer;
+        traffic_outcome outcome;
+        size_t ports;
+        uint32_t packets;
+        double ns_per_packet;
+        double packets_per_sec;
+    };
+
+    /**
+     * @fn temp_path
+     * @brief Creates an empty temporary file.
+     *
+     * @return Path of the file, empty on failure.
+     */
+    std::string temp_path() {
+#if defined(__unix__) || defined(__APPLE__)
+        const char *dir = std::getenv("TMPDIR");
+        std::string path = std::string(dir ? dir : "/tmp") + "/nic_bench_XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+        int fd = mkstemp(&name[0]);
+        if (fd < 0) {
+            return std::string();
+        }
+        close(fd);
+        return std::string(&name[0]);
+#else
+        static int counter = 0;
+        std::ostringstream name;
+        name << "nic_bench_" << counter++ << ".tmp";
+        return name.str();
+#endif
+    }
+
+    /**
+     * @fn write_file
+     * @brief Replaces the content of a file.
+     *
+     * @return true on success, false on an I/O error.
+     */
+    bool write_file(const std::string &path, const std::string &content) {
+        std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @fn parse_number
+     * @brief Parses the value of a "--name=N" option.
+     *
+     * @return true on success, false if the value isn't a number.
+     */
+    bool parse_number(const char *value, uint32_t &out) {
+        return common::parse_uint(common::field_view(value, std::strlen(value)),
+                                  0xFFFFFFFFu, out) == common::PARSE_OK;
+    }
+
+    /**
+     * @fn run_case
+     * @brief Times 'nic_flow' over a trace.
+     *
+     * @return Fastest run in nanoseconds.
+     */
+    double run_case(const std::string &param_path, const std::string &trace_path,
+                    uint32_t repeat) {
+        double best = 0;
+        for (uint32_t r = 0; r < repeat; r++) {
+            nic_sim simulation(param_path);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            simulation.nic_flow(trace_path);
+            std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double, std::nano>(stop - start).count();
+            if (r == 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * @fn put_literal
+     * @brief Writes a string literal.
+     */
+    template <size_t N>
+    void put_literal(result_writer &out, const char (&text)[N]) {
+        out.put(text, N - 1);
+    }
+
+    /**
+     * @fn write_report
+     * @brief Writes the results as JSON.
+     *
+     * @return true on success, false on an I/O error.
+     */
+    bool write_report(result_writer &out, const bench_options &options,
+                      const std::vector<bench_result> &results) {
+        char number[64];
+        put_literal(out, "{\n  \"flags\": \"");
+        put_literal(out, NIC_BENCH_FLAGS);
+        put_literal(out, "\",\n  \"packets\": ");
+        out.put_uint(options.packets);
+        put_literal(out, ",\n  \"repeat\": ");
+        out.put_uint(options.repeat);
+        put_literal(out, ",\n  \"seed\": ");
+        out.put_uint(options.seed);
+        put_literal(out, ",\n  \"results\": [\n");
+        for (size_t i = 0; i < results.size(); i++) {
+            const bench_result &result = results[i];
+            put_literal(out, "    {\"name\": \"");
+            out.put(result.name);
+            put_literal(out, "\", \"layer\": \"");
+            out.put(std::string(traffic_gen::layer_name(result.layer)));
+            put_literal(out, "\", \"outcome\": \"");
+            out.put(std::string(traffic_gen::outcome_name(result.outcome)));
+            put_literal(out, "\", \"ports\": ");
+            out.put_uint(static_cast<uint32_t>(result.ports));
+            put_literal(out, ", \"packets\": ");
+            out.put_uint(result.packets);
+            int len = std::snprintf(number, sizeof(number),
+                                    ", \"ns_per_packet\": %.2f, \"packets_per_sec\": %.0f}",
+                                    result.ns_per_packet, result.packets_per_sec);
+            out.put(number, static_cast<size_t>(len));
+            if (i + 1 < results.size()) {
+                out.put(',');
+            }
+            out.put('\n');
+        }
+        put_literal(out, "  ]\n}\n");
+        return out.flush();
+    }
+
+    /**
+     * @fn baseline_ns
+     * @brief Looks up the ns/packet of a case in a saved report.
+     *
+     * @return true if the case was found, false otherwise.
+     */
+    bool baseline_ns(const std::string &report, const std::string &name, double &ns) {
+        std::string key = "\"name\": \"" + name + "\"";
+        size_t pos = report.find(key);
+        if (pos == std::string::npos) {
+            return false;
+        }
+        size_t end = report.find('}', pos);
+        size_t field = report.find("\"ns_per_packet\": ", pos);
+        if (field == std::string::npos || field > end) {
+            return false;
+        }
+        ns = std::strtod(report.c_str() + field + 17, nullptr);
+        return ns > 0;
+    }
+
+    /**
+     * @fn compare
+     * @brief Prints every case against the baseline report to stderr.
+     *
+     * @return Amount of regressions, -1 if the baseline can't be read.
+     */
+    int compare(const std::string &path, uint32_t threshold,
+                const std::vector<bench_result> &results) {
+        std::ifstream file(path.c_str());
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open baseline: " << path << std::endl;
+            return -1;
+        }
+        std::stringstream content;
+        content << file.rdbuf();
+        std::string report = content.str();
+
+        // Timings of other flags (e.g unoptimized) can't be compared
+        std::string flags = "\"flags\": \"" NIC_BENCH_FLAGS "\"";
+        if (report.find(flags) == std::string::npos) {
+            std::cerr << "Error: Baseline was not built with the flags \""
+                      << NIC_BENCH_FLAGS << "\": " << path << std::endl;
+            return -1;
+        }
+
+        int regressions = 0;
+        char line[160];
+        for (const bench_result &result : results) {
+            double base;
+            if (!baseline_ns(report, result.name, base)) {
+                std::cerr << "  " << result.name << ": not in baseline" << std::endl;
+                continue;
+            }
+            double change = (result.ns_per_packet - base) * 100.0 / base;
+            bool regressed = change > threshold;
+            regressions += regressed ? 1 : 0;
+            std::snprintf(line, sizeof(line), "  %-20s %10.2f -> %10.2f ns/packet (%+.1f%%)%s",
+                          result.name.c_str(), base, result.ns_per_packet, change,
+                          regressed ? "  REGRESSION" : "");
+            std::cerr << line << std::endl;
+        }
+        return regressions;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bench_options options;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool ok;
+        if (std::strncmp(arg, "--packets=", 10) == 0) {
+            ok = parse_number(arg + 10, options.packets) && options.packets > 0;
+        } else if (std::strncmp(arg, "--repeat=", 9) == 0) {
+            ok = parse_number(arg + 9, options.repeat) && options.repeat > 0;
+        } else if (std::strncmp(arg, "--seed=", 7) == 0) {
+            ok = parse_number(arg + 7, options.seed);
+        } else if (std::strncmp(arg, "--threshold=", 12) == 0) {
+            ok = parse_number(arg + 12, options.threshold);
+        } else if (std::strncmp(arg, "--output=", 9) == 0) {
+            options.output = arg + 9;
+            ok = !options.output.empty();
+        } else if (std::strncmp(arg, "--compare=", 10) == 0) {
+            options.baseline = arg + 10;
+            ok = !options.baseline.empty();
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Error: Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::string param_path = temp_path();
+    std::string trace_path = temp_path();
+    if (param_path.empty() || trace_path.empty()) {
+        std::cerr << "Error: Could not create temporary files" << std::endl;
+        return 1;
+    }
+
+    static const common::packet_layer layers[] = {
+        common::LAYER_L2, common::LAYER_L3, common::LAYER_L4
+    };
+    static const traffic_outcome outcomes[] = {
+        OUTCOME_RQ, OUTCOME_TQ, OUTCOME_DRAM, OUTCOME_DROP
+    };
+
+    std::vector<bench_result> results;
+    std::string text;
+    for (size_t ports : PORT_TABLE_SIZES) {
+        nic_params nic = traffic_gen::make_params(ports, options.seed);
+        text.clear();
+        traffic_gen::append_params(nic, text);
+        if (!write_file(param_path, text)) {
+            std::cerr << "Error: Could not write " << param_path << std::endl;
+            return 1;
+        }
+
+        for (common::packet_layer layer : layers) {
+            for (traffic_outcome outcome : outcomes) {
+                traffic_gen gen(nic, options.seed);
+                text.clear();
+                bool possible = true;
+                for (uint32_t p = 0; p < options.packets && possible; p++) {
+                    possible = gen.append_packet(layer, outcome, text);
+                }
+                if (!possible) {
+                    continue;
+                }
+                if (!write_file(trace_path, text)) {
+                    std::cerr << "Error: Could not write " << trace_path << std::endl;
+                    return 1;
+                }
+
+                bench_result result;
+                std::ostringstream name;
+                name << traffic_gen::layer_name(layer) << '/'
+                     << traffic_gen::outcome_name(outcome) << "/ports=" << ports;
+                result.name = name.str();
+                result.layer = layer;
+                result.outcome = outcome;
+                result.ports = ports;
+                result.packets = options.packets;
+                double elapsed = run_case(param_path, trace_path, options.repeat);
+                result.ns_per_packet = elapsed / options.packets;
+                result.packets_per_sec = options.packets * 1e9 / elapsed;
+                results.push_back(result);
+                std::cerr << result.name << ": " << result.ns_per_packet << " ns/packet" << std::endl;
+            }
+        }
+    }
+    std::remove(param_path.c_str());
+    std::remove(trace_path.c_str());
+
+    bool written;
+    if (options.output.empty()) {
+        result_writer out(1);
+        written = write_report(out, options, results);
+    } else {
+        result_writer out(options.output);
+        written = out.is_open() && write_report(out, options, results);
+    }
+    if (!written) {
+        std::cerr << "Error: Could not write the report" << std::endl;
+        return 1;
+    }
+
+    if (!options.baseline.empty()) {
+        int regressions = compare(options.baseline, options.threshold, results);
+        if (regressions != 0) {
+            if (regressions > 0) {
+                std::cerr << regressions << " regression(s) over " << options.threshold
+                          << "%" << std::endl;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
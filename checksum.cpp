@@ -0,0 +1,35 @@
+/**
+ * @file checksum.cpp
+ * @brief Implementation of the byte-sum kernel used by the checksums of the
+ *        NIC simulation project.
+ */
+
+#include "checksum.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace common {
+
+uint32_t checksum_bytes_simd(const uint8_t *bytes, size_t len) {
+    size_t i = 0;
+    uint32_t sum = 0;
+#if defined(__SSE2__)
+    // psadbw against zero adds 8 bytes into each 64-bit half of the register
+    __m128i acc = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+    }
+    sum = static_cast<uint32_t>(_mm_cvtsi128_si32(acc)) +
+          static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc)));
+#endif
+    for (; i < len; i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+}
@@ -0,0 +1,98 @@
+/**
+ * @file checksum.hpp
+ * @brief This header defines the checksum helpers shared by all packet layers
+ *        of the NIC simulation project.
+ *
+ * The simulator's checksum is the 16-bit additive sum of the bytes it covers.
+ * Following RFC 1624, a field rewrite doesn't require summing the packet
+ * again: subtracting the old value of the field and adding the new one gives
+ * the same result in O(1), no matter how large the payload is.
+ */
+
+#ifndef __CHECKSUM__
+#define __CHECKSUM__
+
+#include <cstddef>
+#include <cstdint>
+#include "parse.hpp"
+
+namespace common {
+    /**
+     * @fn checksum_bytes_simd
+     * @brief Sums 'len' bytes, 16 at a time with SSE2 (scalar on other
+     *        targets).
+     *
+     * @return Sum of the bytes (not truncated to 16 bits).
+     */
+    uint32_t checksum_bytes_simd(const uint8_t *bytes, size_t len);
+
+    /**
+     * @fn checksum_bytes
+     * @brief Sums 'len' bytes.
+     *
+     * @return Sum of the bytes (not truncated to 16 bits).
+     */
+    inline uint32_t checksum_bytes(const uint8_t *bytes, size_t len) {
+        // Headers are a handful of bytes, only payloads go through the kernel
+        if (len >= 16) {
+            return checksum_bytes_simd(bytes, len);
+        }
+        uint32_t sum = 0;
+        for (size_t i = 0; i < len; i++) {
+            sum += bytes[i];
+        }
+        return sum;
+    }
+
+    /**
+     * @fn checksum_text
+     * @brief Sums the characters of a text field.
+     *
+     * @return Sum of the characters (not truncated to 16 bits).
+     */
+    inline uint32_t checksum_text(field_view text) {
+        return checksum_bytes(reinterpret_cast<const uint8_t *>(text.ptr), text.size());
+    }
+
+    /**
+     * @fn checksum_update
+     * @brief Incrementally updates a checksum after a field was rewritten.
+     *
+     * @param checksum - Checksum covering the old value of the field.
+     * @param old_bytes - Old value of the field.
+     * @param new_bytes - New value of the field.
+     * @param len - Size of the field in bytes.
+     *
+     * @return Checksum covering the new value of the field.
+     */
+    inline uint16_t checksum_update(uint16_t checksum, const uint8_t *old_bytes,
+                                    const uint8_t *new_bytes, size_t len) {
+        uint32_t sum = checksum;
+        for (size_t i = 0; i < len; i++) {
+            sum += static_cast<uint32_t>(new_bytes[i]) - old_bytes[i];
+        }
+        return static_cast<uint16_t>(sum & 0xFFFF);
+    }
+
+    /**
+     * @fn checksum_update
+     * @brief Incrementally updates a checksum after a single byte was
+     *        rewritten (e.g TTL).
+     */
+    inline uint16_t checksum_update(uint16_t checksum, uint8_t old_byte,
+                                    uint8_t new_byte) {
+        return checksum_update(checksum, &old_byte, &new_byte, 1);
+    }
+
+    /**
+     * @fn checksum_update_word
+     * @brief Incrementally updates a checksum after a field summed as a
+     *        16-bit number (e.g a port) was rewritten.
+     */
+    inline uint16_t checksum_update_word(uint16_t checksum, uint16_t old_value,
+                                         uint16_t new_value) {
+        return static_cast<uint16_t>((static_cast<uint32_t>(checksum) + new_value - old_value) & 0xFFFF);
+    }
+}
+
+#endif
@@ -19,6 +19,7 @@
 #include <iostream>
 #include <iomanip>
 #include <cstdint>
+#include "parse.hpp"
 
 namespace common {
     /* 'open_port' maximum data size. */
@@ -37,6 +38,32 @@ namespace common {
         TQ
     };
 
+    /* Layer of a packet line. LAYER_AUTO means "detect per packet". */
+    enum packet_layer {
+        LAYER_AUTO = 0,
+        LAYER_L2,
+        LAYER_L3,
+        LAYER_L4
+    };
+
+    /* Whether validate_packet checks the L2/L3 checksums. */
+    enum checksum_mode {
+        CHECKSUM_OFF = 0,
+        CHECKSUM_VERIFY
+    };
+
+    /* How 'nic_flow' reads the packet file. */
+    enum ingest_mode {
+        INGEST_MMAP = 0,   /* Map the file and parse lines in place. */
+        INGEST_STREAM      /* Read line by line through std::getline. */
+    };
+
+    /* What a producer does when an RQ/TQ ring is full. */
+    enum ring_policy {
+        RING_BLOCK = 0,    /* Wait for the consumer to make room. */
+        RING_DROP          /* Drop the packet and count it. */
+    };
+
     /**
      * @brief Struct to track open communication and store relevant data.
      * @param dst_prt - Destination port.
@@ -81,7 +108,52 @@ namespace common {
         }
     };
 
-    /* Typedef to create vector of open ports. */
-    typedef std::vector<open_port> open_port_vec;
+    /**
+     * @brief Pre-decoded packet. The parser of the packet's outermost layer
+     *        fills it once, then it flows from L2 down to L4 without being
+     *        turned back into a string.
+     * @param src_mac, dst_mac, l2_checksum - L2 header (L2 packets only).
+     * @param src_ip, dst_ip, ttl, l3_checksum - L3 header (L2/L3 packets).
+     * @param src_port, dst_port, index - L4 header.
+     * @param payload - L5 data as raw bytes, 'payload_len' of them, -1 if
+     *        the data isn't valid hex. At most DATA_ARR_SIZE are decoded.
+     * @param l3_text - Original text covered by the L2 checksum.
+     * @param l4_text - Original "index|data" text covered by the L3 checksum.
+     * @param l4_canonical - Whether formatting 'index' and 'payload' gives
+     *        back 'l4_text' exactly. Packets forwarded to RQ/TQ keep their
+     *        original text otherwise (e.g upper case or long payloads).
+     * @param port_index - Open port of the L4 flow, found by the L4
+     *        validation and reused when the packet is processed, -1 before.
+     *
+     * @note The text views point into the packet line. The checksums are
+     *       defined over the text, and RQ/TQ copy the text of packets that
+     *       are not canonical.
+     */
+    struct packet_record {
+        uint8_t src_mac[MAC_SIZE];
+        uint8_t dst_mac[MAC_SIZE];
+        uint16_t l2_checksum;
+        uint8_t src_ip[IP_V4_SIZE];
+        uint8_t dst_ip[IP_V4_SIZE];
+        uint8_t ttl;
+        uint16_t l3_checksum;
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint16_t index;
+        uint8_t payload[DATA_ARR_SIZE];
+        int payload_len;
+        field_view l3_text;
+        field_view l4_text;
+        bool l4_canonical;
+        int port_index;
+    };
+
+}
+
+#include "flow_table.hpp"
+
+namespace common {
+    /* Typedef to create the table of open ports. */
+    typedef flow_table open_port_vec;
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,250 @@
+/**
+ * @file flow_pipeline.cpp
+ * @brief Implementation of the multi-threaded packet flow of the NIC
+ *        simulator class.
+ *
+ * The trace is cut into batches of lines. A fixed pool of batches circulates
+ * between three stages:
+ *
+ *        reader (calling thread) -> parse/validate workers -> commit thread
+ *
+ * Workers finish batches out of order, the commit thread takes them back in
+ * sequence order, so processing and storage see the packets exactly as the
+ * single threaded flow does.
+ */
+
+#include "NIC_sim.hpp"
+#include "trace_reader.hpp"
+#include "work_queue.hpp"
+#include "flow_trace.hpp"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    /* Amount of lines in a batch. */
+    const size_t BATCH_SIZE = 256;
+
+    static_assert(BATCH_SIZE <= common::header_batch::CAPACITY,
+                  "a batch is committed with process_batch");
+
+    /* Batches in flight per worker. */
+    const size_t BATCHES_PER_WORKER = 4;
+
+    /**
+     * @brief A run of consecutive trace lines and the packets built from them.
+     * @param seq - Position of the batch in the trace.
+     * @param count - Amount of lines in use.
+     * @param lines - The lines, views into the mapping or into 'owned'.
+     * @param owned - Copies of the lines when the trace isn't mapped.
+     * @param slots - Packet built from every line.
+     * @param valid - Whether the packet of every line passed the ACL and
+     *        validation.
+     * @param verdicts - ACL action of every valid packet.
+     * @param cycles - Cycles the worker spent on every valid packet, the
+     *        committer adds its own to the packet's latency.
+     */
+    struct flow_batch {
+        uint64_t seq;
+        size_t count;
+        std::vector<common::field_view> lines;
+        std::vector<std::string> owned;
+        std::unique_ptr<packet_slot[]> slots;
+        std::unique_ptr<bool[]> valid;
+        std::unique_ptr<common::acl_action[]> verdicts;
+        std::unique_ptr<uint64_t[]> cycles;
+
+        flow_batch() : seq(0), count(0), lines(BATCH_SIZE), owned(BATCH_SIZE),
+                       slots(new packet_slot[BATCH_SIZE]),
+                       valid(new bool[BATCH_SIZE]),
+                       verdicts(new common::acl_action[BATCH_SIZE]),
+                       cycles(new uint64_t[BATCH_SIZE]) {}
+    };
+
+    /**
+     * @brief Validated batches waiting for the commit thread, indexed by
+     *        sequence number modulo the amount of batches.
+     */
+    struct commit_order {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::vector<flow_batch *> done;
+        uint64_t total;
+        bool input_done;
+
+        explicit commit_order(size_t batches)
+            : done(batches, nullptr), total(0), input_done(false) {}
+    };
+}
+
+bool nic_sim::pipelined_flow(const std::string &packet_file,
+                             common::ingest_mode ingest, unsigned workers) {
+    const size_t batch_count = BATCHES_PER_WORKER * workers;
+    std::vector<flow_batch> batches(batch_count);
+    work_queue<flow_batch *> free_batches;
+    work_queue<flow_batch *> parse_queue;
+    commit_order order(batch_count);
+
+    for (size_t i = 0; i < batch_count; i++) {
+        free_batches.push(&batches[i]);
+    }
+
+    // Batches are full but the last, so a packet's clock follows from its
+    // batch and position. Only the reader moves 'packet_clock' meanwhile
+    const uint64_t clock_base = packet_clock;
+
+    // Parse/validate stage, reads nothing that the commit stage writes
+    std::vector<std::thread> parsers;
+    for (unsigned w = 0; w < workers; w++) {
+        parsers.push_back(std::thread([&]() {
+            common::stats_scope stats_thread(stats, stats_enabled);
+            common::latency_scope latency_thread(latency, latency_enabled);
+            NIC_TRACE_THREAD("parser");
+            flow_batch *batch;
+            while (parse_queue.pop(batch)) {
+                NIC_TRACE_SCOPE("parse.batch");
+                for (size_t i = 0; i < batch->count; i++) {
+                    packet_slot &packet = batch->slots[i];
+                    common::latency_probe probe;
+                    bool valid;
+                    {
+                        common::stage_timer timer(common::STAGE_PARSE);
+                        valid = packet_factory(batch->lines[i], layer_hint, packet, &nat);
+                    }
+                    common::acl_action verdict = common::ACL_ALLOW;
+                    if (valid) {
+                        common::stage_timer timer(common::STAGE_VALIDATE);
+                        verdict = acl_verdict(packet);
+                        valid = verdict != common::ACL_DENY &&
+                                (verdict != common::ACL_ALLOW ||
+                                 packet.validate_packet(open_ports, nic_ip, mask, mac));
+                    }
+                    batch->valid[i] = valid;
+                    batch->verdicts[i] = verdict;
+                    if (valid) {
+                        batch->cycles[i] = probe.elapsed();
+                    } else {
+                        probe.finish(packet.held_layer(), common::LATENCY_DROP);
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(order.mutex);
+                    order.done[batch->seq % batch_count] = batch;
+                }
+                order.ready.notify_all();
+            }
+        }));
+    }
+
+    // Commit stage, the only thread that touches memory spaces and queues
+    std::thread committer([&]() {
+        common::stats_scope stats_thread(stats, stats_enabled);
+        common::latency_scope latency_thread(latency, latency_enabled);
+        NIC_TRACE_THREAD("committer");
+        for (uint64_t next = 0; ; next++) {
+            flow_batch *batch;
+            {
+                std::unique_lock<std::mutex> lock(order.mutex);
+                flow_batch *&entry = order.done[next % batch_count];
+                while (entry == nullptr &&
+                       !(order.input_done && next == order.total)) {
+                    order.ready.wait(lock);
+                }
+                if (entry == nullptr) {
+                    return;
+                }
+                batch = entry;
+                entry = nullptr;
+            }
+
+            NIC_TRACE_SCOPE("commit.batch");
+            {
+                // A packet's latency runs to the end of its batch
+                common::stage_timer timer(common::STAGE_PROCESS);
+                common::latency_probe probe;
+                common::latency_outcome outcomes[BATCH_SIZE];
+                process_batch(batch->slots.get(), batch->valid.get(), batch->verdicts.get(),
+                              batch->count, clock_base + batch->seq * BATCH_SIZE + 1,
+                              outcomes);
+                for (size_t i = 0; i < batch->count; i++) {
+                    if (batch->valid[i]) {
+                        probe.finish(batch->slots[i].held_layer(), outcomes[i],
+                                     batch->cycles[i]);
+                    }
+                }
+            }
+            for (size_t i = 0; i < batch->count; i++) {
+                batch->slots[i].reset();
+            }
+            free_batches.push(batch);
+        }
+    });
+
+    // Read stage, on the calling thread
+    uint64_t seq = 0;
+    flow_batch *batch = nullptr;
+    bool opened = read_trace(packet_file, ingest,
+        [&](common::field_view line, bool persistent) {
+            if (take_header(line)) {
+                return;
+            }
+            packet_clock++;
+            if (batch == nullptr) {
+                // Waits here while all batches are in flight
+                NIC_TRACE_SCOPE("reader.wait");
+                free_batches.pop(batch);
+                batch->seq = seq++;
+                batch->count = 0;
+            }
+
+            size_t i = batch->count++;
+            if (persistent) {
+                batch->lines[i] = line;
+            } else {
+                batch->owned[i].assign(line.ptr, line.len);
+                batch->lines[i] = common::field_view(batch->owned[i]);
+            }
+
+            if (batch->count == BATCH_SIZE) {
+                NIC_TRACE_INSTANT("batch.dispatch");
+                parse_queue.push(batch);
+                batch = nullptr;
+            }
+        },
+        [&]() {
+            // Mapped lines are only valid until this returns, drain the
+            // pipeline here
+            if (batch != nullptr) {
+                parse_queue.push(batch);
+                batch = nullptr;
+            }
+            parse_queue.close();
+            for (std::thread &parser : parsers) {
+                parser.join();
+            }
+            {
+                std::lock_guard<std::mutex> lock(order.mutex);
+                order.total = seq;
+                order.input_done = true;
+            }
+            order.ready.notify_all();
+            committer.join();
+        });
+
+    if (!opened) {
+        parse_queue.close();
+        for (std::thread &parser : parsers) {
+            parser.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(order.mutex);
+            order.input_done = true;
+        }
+        order.ready.notify_all();
+        committer.join();
+    }
+    return opened;
+}
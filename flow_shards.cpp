@@ -0,0 +1,415 @@
+/**
+ * @file flow_shards.cpp
+ * @brief Implementation of the flow-affinity (RSS-style) sharded packet flow
+ *        of the NIC simulator class.
+ *
+ * Every packet is hashed on its flow key, the (src_port, dst_port) pair that
+ * 'open_ports' is looked up with, and handed to the shard owning that key.
+ * The hash is symmetric, so the replies of a NAT connection reach the shard
+ * that created it. A shard owns a disjoint part of 'open_ports', of the NAT
+ * connections and its own RQ/TQ segments, so it runs the whole packet path
+ * without locks or shared writes. NAT ports come from the port group of the
+ * connection, so the open ports they must not collide with are on the same
+ * shard. After the trace is read the shards are merged back in trace order.
+ *
+ * With rings every shard pushes to its own, and the drain thread merges them
+ * while the flow runs. Every batch publishes a ring floor, the position of
+ * its first line not processed yet, and the reader one past the last line
+ * it read, so a position below all floors can't be pushed anymore.
+ */
+
+#include "NIC_sim.hpp"
+#include "trace_reader.hpp"
+#include "work_queue.hpp"
+#include "flow_trace.hpp"
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+    /* Amount of lines in a shard batch. */
+    const size_t SHARD_BATCH_SIZE = 256;
+
+    /* Batches in flight per shard. */
+    const size_t SHARD_BATCHES = 4;
+
+    /**
+     * @brief Lines of the trace dispatched to a single shard.
+     * @param count - Amount of lines in use.
+     * @param seq - Position of every line in the trace.
+     * @param layers - Layer of every line, detected by the reader.
+     * @param lines - The lines, views into the mapping or into 'owned'.
+     * @param owned - Copies of the lines when the trace isn't mapped.
+     * @param floor_slot - Ring floor slot of the batch, when the flow has
+     *        rings.
+     */
+    struct shard_batch {
+        size_t count;
+        size_t floor_slot;
+        std::vector<uint64_t> seq;
+        std::vector<common::packet_layer> layers;
+        std::vector<common::field_view> lines;
+        std::vector<std::string> owned;
+
+        shard_batch() : count(0), floor_slot(0), seq(SHARD_BATCH_SIZE),
+                        layers(SHARD_BATCH_SIZE), lines(SHARD_BATCH_SIZE),
+                        owned(SHARD_BATCH_SIZE) {}
+    };
+
+    /**
+     * @brief Packets a shard sent to RQ or TQ and their positions in the trace.
+     */
+    struct queue_segment {
+        common::packet_queue packets;
+        std::vector<uint64_t> seq;
+    };
+
+    /**
+     * @brief State owned by a single shard thread.
+     * @param ports - The open ports whose flow key hashes to this shard.
+     * @param origin - Index in the NIC's 'open_ports' of every entry of 'ports'.
+     * @param nat - The NAT connections whose port pair hashes to this shard.
+     * @param rq, tq - Packets this shard sent to RQ/TQ, in trace order
+     *        (unused when the flow has rings).
+     * @param slot - Storage reused by every packet of the shard.
+     * @param batches - Batches of this shard, cycled through 'input' and
+     *        'free_batches'.
+     * @param filling - Batch the reader is filling, nullptr if none.
+     */
+    struct flow_shard {
+        common::open_port_vec ports;
+        std::vector<size_t> origin;
+        common::nat_table nat;
+        queue_segment rq;
+        queue_segment tq;
+        packet_slot slot;
+        std::vector<shard_batch> batches;
+        work_queue<shard_batch *> input;
+        work_queue<shard_batch *> free_batches;
+        shard_batch *filling;
+        std::thread thread;
+
+        flow_shard() : batches(SHARD_BATCHES), filling(nullptr) {
+            for (size_t i = 0; i < SHARD_BATCHES; i++) {
+                free_batches.push(&batches[i]);
+            }
+        }
+    };
+
+    /**
+     * @fn flow_key
+     * @brief Extracts the (src_port, dst_port) flow key of a packet line
+     *        without parsing the rest of it.
+     *
+     * @param [in] packet - String representation of a packet.
+     * @param [in] layer - Layer of the packet.
+     * @param [out] src_port, dst_port - The flow key.
+     *
+     * @return true on success, false if the ports can't be parsed.
+     */
+    bool flow_key(common::field_view packet, common::packet_layer layer,
+                  uint16_t &src_port, uint16_t &dst_port) {
+        // Fields preceding src_port, see the L2/L3/L4 packet formats
+        int skip;
+        switch (layer) {
+            case common::LAYER_L2:
+                skip = 6;
+                break;
+            case common::LAYER_L3:
+                skip = 4;
+                break;
+            case common::LAYER_L4:
+                skip = 0;
+                break;
+            default:
+                return false;
+        }
+
+        common::field_tokenizer tokens(packet, '|');
+        common::field_view field;
+        for (int i = 0; i < skip; i++) {
+            if (!tokens.next(field)) {
+                return false;
+            }
+        }
+
+        if (!tokens.next(field) || common::parse_u16(field, src_port) != common::PARSE_OK ||
+            !tokens.next(field) || common::parse_u16(field, dst_port) != common::PARSE_OK) {
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @fn merge_segments
+     * @brief Appends the queue segments of all shards to 'out' in trace order.
+     *
+     * @param segments - Queue segment of every shard, each in trace order.
+     * @param out - Queue to append to.
+     *
+     * @return None.
+     */
+    void merge_segments(std::vector<queue_segment *> &segments,
+                        common::packet_queue &out) {
+        std::vector<size_t> next(segments.size(), 0);
+        for (;;) {
+            size_t best = segments.size();
+            for (size_t s = 0; s < segments.size(); s++) {
+                if (next[s] < segments[s]->seq.size() &&
+                    (best == segments.size() ||
+                     segments[s]->seq[next[s]] < segments[best]->seq[next[best]])) {
+                    best = s;
+                }
+            }
+            if (best == segments.size()) {
+                return;
+            }
+            out.push_from(segments[best]->packets, next[best]++);
+        }
+    }
+}
+
+size_t nic_sim::shard_ring_floors(unsigned shards) {
+    // The reader's, then every batch's
+    return 1 + shards * SHARD_BATCHES;
+}
+
+bool nic_sim::sharded_flow(const std::string &packet_file,
+                           common::ingest_mode ingest, unsigned shard_count) {
+    std::vector<std::unique_ptr<flow_shard> > shards;
+    for (unsigned s = 0; s < shard_count; s++) {
+        shards.push_back(std::unique_ptr<flow_shard>(new flow_shard()));
+    }
+
+    // Partition the open ports, keeping their order within every shard
+    for (size_t i = 0; i < open_ports.size(); i++) {
+        const common::open_port &port = open_ports[i];
+        flow_shard &shard = *shards[common::port_pair_shard(port.src_prt, port.dst_prt,
+                                                            shard_count)];
+        shard.ports.push_back(port);
+        shard.origin.push_back(i);
+    }
+
+    // Same for the NAT connections, by the port pair of their replies. Every
+    // shard's clock starts where the NIC's is, a packet's clock is then
+    // 'clock_base' plus its position in the trace
+    const uint64_t clock_base = packet_clock;
+    nat.advance(clock_base);
+    std::vector<common::nat_entry> connections;
+    nat.take_all(connections);
+    for (unsigned s = 0; s < shard_count; s++) {
+        common::nat_table &table = shards[s]->nat;
+        table.set_timeout(nat.idle_timeout());
+        table.advance(clock_base);
+    }
+    for (const common::nat_entry &entry : connections) {
+        shards[common::port_pair_shard(entry.remote_port, entry.nat_port, shard_count)]
+            ->nat.insert(entry);
+    }
+
+    if (rings) {
+        for (unsigned s = 0; s < shard_count; s++) {
+            for (size_t b = 0; b < SHARD_BATCHES; b++) {
+                shard_batch &batch = shards[s]->batches[b];
+                batch.floor_slot = 1 + s * SHARD_BATCHES + b;
+                rings->set_floor(batch.floor_slot, queue_rings::NO_FLOOR);
+            }
+        }
+    }
+
+    for (unsigned s = 0; s < shard_count; s++) {
+        flow_shard &shard = *shards[s];
+        shard.thread = std::thread([this, &shard, s, clock_base]() {
+            common::stats_scope stats_thread(stats, stats_enabled);
+            common::latency_scope latency_thread(latency, latency_enabled);
+            NIC_TRACE_THREAD("shard");
+            shard_batch *batch;
+            while (shard.input.pop(batch)) {
+                NIC_TRACE_SCOPE("shard.batch");
+                for (size_t i = 0; i < batch->count; i++) {
+                    if (rings) {
+                        // The lines before this one pushed what they had to
+                        rings->set_floor(batch->floor_slot, batch->seq[i]);
+                    }
+                    common::latency_probe probe;
+                    bool built;
+                    {
+                        common::stage_timer timer(common::STAGE_PARSE);
+                        built = packet_factory(batch->lines[i], batch->layers[i], shard.slot,
+                                               &shard.nat);
+                    }
+                    if (!built) {
+                        continue;
+                    }
+
+                    common::acl_action verdict;
+                    bool valid;
+                    {
+                        common::stage_timer timer(common::STAGE_VALIDATE);
+                        verdict = acl_verdict(shard.slot);
+                        valid = verdict != common::ACL_DENY &&
+                                (verdict != common::ACL_ALLOW ||
+                                 shard.slot.validate_packet(shard.ports, nic_ip, mask, mac));
+                    }
+
+                    common::stage_timer timer(common::STAGE_PROCESS);
+                    common::latency_outcome outcome = common::LATENCY_DROP;
+                    memory_dest dst;
+                    shard.nat.advance(clock_base + batch->seq[i] + 1);
+                    if (verdict == common::ACL_REDIRECT_RQ) {
+                        dst = common::RQ;
+                    } else if (verdict == common::ACL_REDIRECT_TQ) {
+                        dst = common::TQ;
+                    } else if (valid && !shard.slot.proccess_packet(shard.ports, nic_ip, dst)) {
+                        valid = false;
+                    }
+                    if (valid) {
+                        outcome = static_cast<common::latency_outcome>(dst);
+                        const common::packet_record *rec = shard.slot.queued_record();
+                        if (dst != common::LOCAL_DRAM && rec != nullptr) {
+                            if (rings) {
+                                rings->push(s, dst, batch->seq[i], *rec);
+                            } else {
+                                NIC_TRACE_SCOPE("queue.push");
+                                queue_segment &segment = (dst == common::RQ) ? shard.rq : shard.tq;
+                                segment.packets.push(*rec);
+                                segment.seq.push_back(batch->seq[i]);
+                            }
+                        }
+                    }
+                    probe.finish(shard.slot.held_layer(), outcome);
+                    shard.slot.reset();
+                }
+                if (rings) {
+                    rings->set_floor(batch->floor_slot, queue_rings::NO_FLOOR);
+                }
+                shard.free_batches.push(batch);
+            }
+        });
+    }
+
+    // Read and dispatch, on the calling thread
+    uint64_t seq = 0;
+    bool opened = read_trace(packet_file, ingest,
+        [&](common::field_view line, bool persistent) {
+            if (take_header(line)) {
+                return;
+            }
+
+            // Lines of no known layer are rejected (and counted) by the
+            // first shard
+            uint64_t line_seq = seq++;
+            packet_clock++;
+            common::packet_layer layer = layer_hint;
+            if (layer == common::LAYER_AUTO) {
+                layer = classify_packet(line);
+            }
+
+            // Packets without a readable key can't touch any port, the
+            // first shard rejects them
+            uint16_t src_port, dst_port;
+            flow_shard &shard = flow_key(line, layer, src_port, dst_port) ?
+                                *shards[common::port_pair_shard(src_port, dst_port,
+                                                                shard_count)] :
+                                *shards[0];
+            if (shard.filling == nullptr) {
+                if (rings && !shard.free_batches.try_pop(shard.filling)) {
+                    // The shard may wait for the drain thread, which may
+                    // wait for a line still in another shard's partial
+                    // batch, hand those over first
+                    for (unsigned s = 0; s < shard_count; s++) {
+                        if (shards[s]->filling != nullptr) {
+                            shards[s]->input.push(shards[s]->filling);
+                            shards[s]->filling = nullptr;
+                        }
+                    }
+                }
+                if (shard.filling == nullptr) {
+                    // Waits here while all batches of the shard are in flight
+                    NIC_TRACE_SCOPE("reader.wait");
+                    shard.free_batches.pop(shard.filling);
+                }
+                shard.filling->count = 0;
+                if (rings) {
+                    rings->set_floor(shard.filling->floor_slot, line_seq);
+                }
+            }
+
+            shard_batch &batch = *shard.filling;
+            size_t i = batch.count++;
+            batch.seq[i] = line_seq;
+            batch.layers[i] = layer;
+            if (persistent) {
+                batch.lines[i] = line;
+            } else {
+                batch.owned[i].assign(line.ptr, line.len);
+                batch.lines[i] = common::field_view(batch.owned[i]);
+            }
+
+            if (rings) {
+                // Published after the batch's floor, the drain thread reads
+                // this one first
+                rings->set_floor(0, line_seq + 1);
+            }
+
+            if (batch.count == SHARD_BATCH_SIZE) {
+                NIC_TRACE_INSTANT("batch.dispatch");
+                shard.input.push(shard.filling);
+                shard.filling = nullptr;
+            }
+        },
+        [&]() {
+            // Mapped lines are only valid until this returns, drain the
+            // shards here
+            for (unsigned s = 0; s < shard_count; s++) {
+                flow_shard &shard = *shards[s];
+                if (shard.filling != nullptr) {
+                    shard.input.push(shard.filling);
+                    shard.filling = nullptr;
+                }
+                shard.input.close();
+            }
+            for (unsigned s = 0; s < shard_count; s++) {
+                shards[s]->thread.join();
+            }
+        });
+
+    if (!opened) {
+        for (unsigned s = 0; s < shard_count; s++) {
+            shards[s]->input.close();
+            shards[s]->thread.join();
+        }
+    }
+
+    // Hand the connections back to the NIC, whichever way the flow ended
+    nat.advance(packet_clock);
+    for (unsigned s = 0; s < shard_count; s++) {
+        connections.clear();
+        shards[s]->nat.take_all(connections);
+        for (const common::nat_entry &entry : connections) {
+            nat.insert(entry);
+        }
+    }
+    if (!opened) {
+        return false;
+    }
+
+    // Deterministic merge back into the NIC's memory spaces
+    std::vector<queue_segment *> rq_segments;
+    std::vector<queue_segment *> tq_segments;
+    for (unsigned s = 0; s < shard_count; s++) {
+        flow_shard &shard = *shards[s];
+        for (size_t i = 0; i < shard.ports.size(); i++) {
+            std::memcpy(open_ports[shard.origin[i]].data, shard.ports[i].data,
+                        DATA_ARR_SIZE);
+        }
+        rq_segments.push_back(&shard.rq);
+        tq_segments.push_back(&shard.tq);
+    }
+    // With rings the drain thread already stores and orders the queues
+    merge_segments(rq_segments, RQ);
+    merge_segments(tq_segments, TQ);
+    return true;
+}
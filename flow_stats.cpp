@@ -0,0 +1,145 @@
+/**
+ * @file flow_stats.cpp
+ * @brief Implementation of the drop/route counters of the NIC simulation
+ *        project.
+ */
+
+#include "flow_stats.hpp"
+
+namespace {
+    /* JSON names of the counters, in 'stat_counter' order. */
+    const char *const COUNTER_NAMES[common::STAT_COUNTERS] = {
+        "packets",
+        "not_a_packet",
+        "parse_error",
+        "acl_deny",
+        "acl_redirect",
+        "l2_mac_mismatch",
+        "l2_bad_checksum",
+        "l3_ttl_expired",
+        "l3_bad_checksum",
+        "l3_to_nic",
+        "l3_nat",
+        "nat_new",
+        "nat_reverse",
+        "nat_evicted",
+        "nat_exhausted",
+        "l4_unknown_flow",
+        "l4_bad_index",
+        "l4_empty_payload",
+        "route_rq",
+        "route_tq",
+        "route_dram",
+        "route_drop"
+    };
+
+    /* JSON names of the stages, in 'stat_stage' order. */
+    const char *const STAGE_NAMES[common::STAT_STAGES] = {
+        "parse",
+        "validate",
+        "process"
+    };
+}
+
+namespace common {
+    thread_local stats_block *thread_stats = nullptr;
+
+    stats_block::stats_block() {
+        for (int i = 0; i < STAT_COUNTERS; i++) {
+            counters[i].store(0, std::memory_order_relaxed);
+        }
+        for (int i = 0; i < STAT_STAGES; i++) {
+            stage_ns[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void stats_registry::attach() {
+        thread_stats = add_block();
+    }
+
+    stats_block *stats_registry::add_block() {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.push_back(std::unique_ptr<stats_block>(new stats_block()));
+        return blocks.back().get();
+    }
+
+    void stats_registry::detach() {
+        thread_stats = nullptr;
+    }
+
+    stats_totals stats_registry::snapshot() const {
+        stats_totals totals;
+        for (int i = 0; i < STAT_COUNTERS; i++) {
+            totals.counters[i] = 0;
+        }
+        for (int i = 0; i < STAT_STAGES; i++) {
+            totals.stage_ns[i] = 0;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::unique_ptr<stats_block> &block : blocks) {
+            for (int i = 0; i < STAT_COUNTERS; i++) {
+                totals.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+            }
+            for (int i = 0; i < STAT_STAGES; i++) {
+                totals.stage_ns[i] += block->stage_ns[i].load(std::memory_order_relaxed);
+            }
+        }
+        return totals;
+    }
+
+    void stats_registry::write_json(std::ostream &out, const stats_totals &totals,
+                                    uint64_t elapsed_ns, const char *kind) {
+        uint64_t packets = totals.counters[STAT_PACKETS];
+        out << "{\"kind\": \"" << kind << "\", \"elapsed_ns\": " << elapsed_ns;
+        out << ", \"packets_per_sec\": "
+            << (elapsed_ns > 0 ? static_cast<uint64_t>(packets * 1e9 / elapsed_ns) : 0);
+
+        out << ", \"counters\": {";
+        for (int i = 0; i < STAT_COUNTERS; i++) {
+            out << (i > 0 ? ", \"" : "\"") << COUNTER_NAMES[i] << "\": " << totals.counters[i];
+        }
+
+        // Stage time is summed over threads, ns/packet is per thread time
+        out << "}, \"stage_ns\": {";
+        for (int i = 0; i < STAT_STAGES; i++) {
+            out << (i > 0 ? ", \"" : "\"") << STAGE_NAMES[i] << "\": " << totals.stage_ns[i];
+        }
+        out << "}, \"stage_ns_per_packet\": {";
+        for (int i = 0; i < STAT_STAGES; i++) {
+            double per_packet = packets > 0 ?
+                                static_cast<double>(totals.stage_ns[i]) / packets : 0;
+            out << (i > 0 ? ", \"" : "\"") << STAGE_NAMES[i] << "\": "
+                << static_cast<uint64_t>(per_packet + 0.5);
+        }
+        out << "}}" << std::endl;
+    }
+
+    stats_reporter::stats_reporter(const stats_registry &registry,
+                                   unsigned interval_ms, std::ostream &out)
+        : registry(registry), interval(interval_ms), out(out),
+          start(std::chrono::steady_clock::now()), stopping(false),
+          thread(&stats_reporter::run, this) {}
+
+    stats_reporter::~stats_reporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        thread.join();
+    }
+
+    void stats_reporter::run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            if (wake.wait_for(lock, interval, [this]() { return stopping; })) {
+                return;
+            }
+            uint64_t elapsed = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+            stats_registry::write_json(out, registry.snapshot(), elapsed, "snapshot");
+        }
+    }
+}
@@ -0,0 +1,253 @@
+/**
+ * @file flow_stats.hpp
+ * @brief This header defines the drop/route counters and stage timers of the
+ *        NIC simulation project.
+ *
+ * Every thread of a flow attaches its own 'stats_block' and only that thread
+ * writes to it, so counting is a plain load/add/store with no locked
+ * instruction and no shared cache line. Readers (the periodic snapshot and
+ * the summary) sum all blocks with relaxed loads. When statistics are off no
+ * block is attached and every counting point is a single branch.
+ */
+
+#ifndef __FLOW_STATS__
+#define __FLOW_STATS__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace common {
+    /* Decision points counted by the packet layers and the flow. */
+    enum stat_counter {
+        STAT_PACKETS = 0,       /* Lines handed to the packet factory. */
+        STAT_NOT_A_PACKET,      /* Lines whose layer can't be detected. */
+        STAT_PARSE_ERROR,       /* Packets that failed to parse. */
+        STAT_ACL_DENY,          /* Packets dropped by an ACL rule. */
+        STAT_ACL_REDIRECT,      /* Packets stored as is by an ACL rule. */
+        STAT_L2_MAC_MISMATCH,   /* L2 packets for another MAC. */
+        STAT_L2_BAD_CHECKSUM,   /* L2 packets with a wrong checksum. */
+        STAT_L3_TTL_EXPIRED,    /* L3 packets with TTL 0, or 1 before the decrement. */
+        STAT_L3_BAD_CHECKSUM,   /* L3 packets with a wrong checksum. */
+        STAT_L3_TO_NIC,         /* L3 packets targeted to the NIC. */
+        STAT_L3_NAT,            /* L3 packets whose source was translated. */
+        STAT_NAT_NEW,           /* NAT connections created. */
+        STAT_NAT_REVERSE,       /* Replies translated back to a local host. */
+        STAT_NAT_EVICTED,       /* NAT connections evicted after idling. */
+        STAT_NAT_EXHAUSTED,     /* Packets dropped with no free NAT port. */
+        STAT_L4_UNKNOWN_FLOW,   /* L4 packets of no open communication. */
+        STAT_L4_BAD_INDEX,      /* L4 packets with an out-of-range index. */
+        STAT_L4_EMPTY_PAYLOAD,  /* L4 packets without data. */
+        STAT_ROUTE_RQ,          /* Packets sent to RQ. */
+        STAT_ROUTE_TQ,          /* Packets sent to TQ. */
+        STAT_ROUTE_DRAM,        /* Packets written to LOCAL DRAM. */
+        STAT_ROUTE_DROP,        /* L3 packets dropped by a route. */
+        STAT_COUNTERS
+    };
+
+    /* Stages of the packet path timed by the flow. */
+    enum stat_stage {
+        STAGE_PARSE = 0,        /* Packet detection and parsing. */
+        STAGE_VALIDATE,         /* validate_packet. */
+        STAGE_PROCESS,          /* proccess_packet and storage. */
+        STAT_STAGES
+    };
+
+    /**
+     * @brief Counters and stage times of a single thread.
+     */
+    struct stats_block {
+        std::atomic<uint64_t> counters[STAT_COUNTERS];
+        std::atomic<uint64_t> stage_ns[STAT_STAGES];
+
+        stats_block();
+    };
+
+    /**
+     * @brief Sum of all blocks at some point in time.
+     */
+    struct stats_totals {
+        uint64_t counters[STAT_COUNTERS];
+        uint64_t stage_ns[STAT_STAGES];
+    };
+
+    /* Block of the calling thread, nullptr if statistics are off. */
+    extern thread_local stats_block *thread_stats;
+
+    /**
+     * @fn count
+     * @brief Counts a decision on the calling thread's block.
+     *
+     * @return None.
+     */
+    inline void count(stat_counter counter) {
+        stats_block *block = thread_stats;
+        if (block != nullptr) {
+            // Single writer, no read-modify-write instruction needed
+            std::atomic<uint64_t> &value = block->counters[counter];
+            value.store(value.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Adds the time spent in its scope to a stage of the calling
+     *        thread's block.
+     */
+    class stage_timer {
+        public:
+        explicit stage_timer(stat_stage stage) : stage(stage), block(thread_stats) {
+            if (block != nullptr) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~stage_timer() {
+            if (block != nullptr) {
+                uint64_t elapsed = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+                std::atomic<uint64_t> &value = block->stage_ns[stage];
+                value.store(value.load(std::memory_order_relaxed) + elapsed,
+                            std::memory_order_relaxed);
+            }
+        }
+
+        private:
+        stat_stage stage;
+        stats_block *block;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * @brief Blocks of all threads that counted, summed on demand.
+     */
+    class stats_registry {
+        public:
+        /**
+         * @fn attach
+         * @brief Gives the calling thread a new block, until 'detach'.
+         *
+         * @return None.
+         */
+        void attach();
+
+        /**
+         * @fn add_block
+         * @brief Creates a block for work that moves between threads, see
+         *        'attach(stats_block *)'.
+         *
+         * @return The block, owned by the registry.
+         */
+        stats_block *add_block();
+
+        /**
+         * @fn attach
+         * @brief Gives the calling thread 'block', until 'detach'. The
+         *        threads sharing a block must take turns.
+         *
+         * @return None.
+         */
+        static void attach(stats_block *block) { thread_stats = block; }
+
+        /**
+         * @fn detach
+         * @brief Stops counting on the calling thread, its counts are kept.
+         *
+         * @return None.
+         */
+        static void detach();
+
+        /**
+         * @fn snapshot
+         * @brief Sums all blocks, may run while threads are counting.
+         *
+         * @return The totals.
+         */
+        stats_totals snapshot() const;
+
+        /**
+         * @fn write_json
+         * @brief Writes totals as a single line JSON object.
+         *
+         * @param out - Stream to write to.
+         * @param totals - Totals to write.
+         * @param elapsed_ns - Wall time the totals were collected over.
+         * @param kind - Value of the "kind" field, e.g "summary".
+         *
+         * @return None.
+         */
+        static void write_json(std::ostream &out, const stats_totals &totals,
+                               uint64_t elapsed_ns, const char *kind);
+
+        private:
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<stats_block> > blocks;
+    };
+
+    /**
+     * @brief Attaches the calling thread to a registry for its scope.
+     */
+    class stats_scope {
+        public:
+        stats_scope(stats_registry &registry, bool enabled) : attached(enabled) {
+            if (attached) {
+                registry.attach();
+            }
+        }
+
+        ~stats_scope() {
+            if (attached) {
+                stats_registry::detach();
+            }
+        }
+
+        private:
+        bool attached;
+    };
+
+    /**
+     * @brief Thread writing a "snapshot" line of a registry's totals every
+     *        interval, for as long as the object lives.
+     */
+    class stats_reporter {
+        public:
+        /**
+         * @fn stats_reporter
+         * @brief Constructor of the class, starts the reporting thread.
+         *
+         * @param registry - Registry to report, must outlive the reporter.
+         * @param interval_ms - Time between snapshots.
+         * @param out - Stream to write to, only used by the reporting thread
+         *        until the reporter is destroyed.
+         */
+        stats_reporter(const stats_registry &registry, unsigned interval_ms,
+                       std::ostream &out);
+
+        /**
+         * @fn ~stats_reporter
+         * @brief Destructor of the class, stops the reporting thread.
+         */
+        ~stats_reporter();
+
+        private:
+        void run();
+
+        const stats_registry &registry;
+        std::chrono::milliseconds interval;
+        std::ostream &out;
+        std::chrono::steady_clock::time_point start;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping;
+        std::thread thread;
+    };
+}
+
+#endif
@@ -0,0 +1,180 @@
+/**
+ * @file flow_sweep.cpp
+ * @brief Implementation of the parameter sweep of the NIC simulator class, a
+ *        single trace run through several NIC configurations.
+ *
+ * The calling thread reads the trace into chunks. Every chunk is classified
+ * and parsed once, by the L2/L3/L4 parsers, in tasks of a few lines each,
+ * and then every NIC runs the parsed chunk through its own ACL, validation,
+ * processing and storage as a task of its own. The chunks overlap: while
+ * the NICs run a chunk, the next one is parsed and the one after it read.
+ * A sweep of K NICs costs one pass of I/O and parsing and K passes of the
+ * decisions.
+ */
+
+#include "NIC_sim.hpp"
+#include "task_pool.hpp"
+#include "trace_reader.hpp"
+#include "flow_trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+    /* Amount of lines in a chunk. */
+    const size_t SWEEP_CHUNK_SIZE = 16384;
+
+    /* Amount of lines a parse task takes. */
+    const size_t SWEEP_PARSE_LINES = 1024;
+
+    /* Chunks in flight: read, parsed and run by the NICs. */
+    const size_t SWEEP_CHUNKS = 3;
+
+    /**
+     * @brief Lines of the trace parsed and run together.
+     * @param count - Amount of lines in use.
+     * @param packets - The lines, views into the mapping or into 'owned'.
+     * @param owned - Copies of the lines when the trace isn't mapped.
+     */
+    struct sweep_chunk {
+        size_t count;
+        std::vector<parsed_packet> packets;
+        std::vector<std::string> owned;
+
+        sweep_chunk() : count(0), packets(SWEEP_CHUNK_SIZE),
+                        owned(SWEEP_CHUNK_SIZE) {}
+    };
+}
+
+bool nic_sim::nic_sweep(const std::string &packet_file,
+                        const std::vector<nic_sim *> &sims,
+                        const flow_options &options, task_pool &pool) {
+    // Every NIC counts on its own block whichever worker runs it, a NIC
+    // runs a single chunk at a time
+    std::vector<common::stats_block *> blocks(sims.size(), nullptr);
+    std::vector<common::latency_set *> sets(sims.size(), nullptr);
+    for (size_t k = 0; k < sims.size(); k++) {
+        sims[k]->begin_flow(options);
+        if (options.stats) {
+            blocks[k] = sims[k]->stats.add_block();
+        }
+        if (options.latency) {
+            sets[k] = sims[k]->latency.add_set();
+            sims[k]->latency.begin_flow();
+        }
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    NIC_TRACE_THREAD("reader");
+
+    common::packet_layer layer = options.layer;
+    sweep_chunk chunks[SWEEP_CHUNKS];
+    size_t filling = 0;
+    bool first_line = true;
+    sweep_chunk *parsing = nullptr;
+
+    // Hands the parsed chunk to the NICs and 'next' to the parsers, once
+    // the previous step is done with both
+    auto step = [&](sweep_chunk *next) {
+        {
+            NIC_TRACE_SCOPE("reader.wait");
+            pool.wait();
+        }
+        if (parsing != nullptr) {
+            sweep_chunk *chunk = parsing;
+            for (size_t k = 0; k < sims.size(); k++) {
+                nic_sim *sim = sims[k];
+                common::stats_block *block = blocks[k];
+                common::latency_set *set = sets[k];
+                pool.submit([sim, block, set, chunk]() {
+                    NIC_TRACE_SCOPE("sweep.run");
+                    common::stats_registry::attach(block);
+                    common::latency_registry::attach(set);
+                    for (size_t i = 0; i < chunk->count; i++) {
+                        sim->handle_parsed(chunk->packets[i]);
+                    }
+                    common::stats_registry::detach();
+                    common::latency_registry::detach();
+                });
+            }
+        }
+        if (next != nullptr) {
+            for (size_t first = 0; first < next->count; first += SWEEP_PARSE_LINES) {
+                size_t last = std::min(first + SWEEP_PARSE_LINES, next->count);
+                pool.submit([next, first, last, layer]() {
+                    NIC_TRACE_SCOPE("sweep.parse");
+                    packet_slot slot;
+                    for (size_t i = first; i < last; i++) {
+                        parsed_packet &packet = next->packets[i];
+                        packet.layer = layer == common::LAYER_AUTO
+                                     ? classify_packet(packet.line) : layer;
+                        packet.parsed = false;
+                        if (packet.layer == common::LAYER_AUTO) {
+                            continue;
+                        }
+                        slot.emplace(packet.layer, packet.line, common::CHECKSUM_OFF,
+                                     nullptr, nullptr);
+                        const common::packet_record *rec = slot.parsed_record();
+                        if (rec != nullptr) {
+                            packet.record = *rec;
+                            packet.parsed = true;
+                        }
+                        slot.reset();
+                    }
+                });
+            }
+        }
+        parsing = next;
+    };
+
+    bool opened = read_trace(packet_file, options.ingest,
+        [&](common::field_view line, bool persistent) {
+            if (first_line) {
+                first_line = false;
+                common::packet_layer declared;
+                if (parse_layer_header(line, declared)) {
+                    if (layer == common::LAYER_AUTO) {
+                        layer = declared;
+                    }
+                    return;
+                }
+            }
+
+            sweep_chunk &chunk = chunks[filling];
+            size_t i = chunk.count++;
+            if (persistent) {
+                chunk.packets[i].line = line;
+            } else {
+                chunk.owned[i].assign(line.ptr, line.len);
+                chunk.packets[i].line = common::field_view(chunk.owned[i]);
+            }
+
+            // The chunk after the next one was run by the NICs once 'step'
+            // returns
+            if (chunk.count == SWEEP_CHUNK_SIZE) {
+                step(&chunk);
+                filling = (filling + 1) % SWEEP_CHUNKS;
+                chunks[filling].count = 0;
+            }
+        },
+        [&]() {
+            // Mapped lines are only valid until this returns
+            if (chunks[filling].count > 0) {
+                step(&chunks[filling]);
+            }
+            step(nullptr);
+            pool.wait();
+        });
+
+    for (size_t k = 0; k < sims.size(); k++) {
+        if (options.latency) {
+            sims[k]->latency.end_flow();
+        }
+        if (options.stats) {
+            sims[k]->stats_elapsed_ns += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    return opened;
+}
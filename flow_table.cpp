@@ -0,0 +1,56 @@
+/**
+ * @file flow_table.cpp
+ * @brief Implementation of the flow table for the NIC simulation project.
+ */
+
+#include "common.hpp"
+#include "flow_table.hpp"
+
+namespace common {
+
+const int32_t flow_table::EMPTY_SLOT;
+
+/* Initial amount of hash index slots, must be a power of two. */
+static const size_t INITIAL_SLOTS = 16;
+
+flow_table::flow_table() : keys(INITIAL_SLOTS, 0),
+                           slots(INITIAL_SLOTS, EMPTY_SLOT),
+                           slot_mask(INITIAL_SLOTS - 1),
+                           hash_shift(32 - 4) {
+}
+
+void flow_table::push_back(const open_port &port) {
+    // Keep the index at most half full
+    if ((ports.size() + 1) * 2 > slots.size()) {
+        grow();
+    }
+    ports.push_back(port);
+    insert_index(make_key(port.src_prt, port.dst_prt),
+                 static_cast<int32_t>(ports.size() - 1));
+}
+
+void flow_table::insert_index(uint32_t key, int32_t port_index) {
+    size_t slot = hash(key);
+    while (slots[slot] != EMPTY_SLOT) {
+        if (keys[slot] == key) {
+            return;
+        }
+        slot = (slot + 1) & slot_mask;
+    }
+    keys[slot] = key;
+    slots[slot] = port_index;
+}
+
+void flow_table::grow() {
+    size_t capacity = slots.size() * 2;
+    keys.assign(capacity, 0);
+    slots.assign(capacity, EMPTY_SLOT);
+    slot_mask = capacity - 1;
+    hash_shift--;
+    for (size_t i = 0; i < ports.size(); i++) {
+        insert_index(make_key(ports[i].src_prt, ports[i].dst_prt),
+                     static_cast<int32_t>(i));
+    }
+}
+
+}
@@ -0,0 +1,114 @@
+/**
+ * @file flow_table.hpp
+ * @brief This header defines the flow table holding the NIC's open
+ *        communications.
+ *
+ * Ports are kept in insertion order (the order they are printed in) and are
+ * never moved, so an index returned by 'find' stays valid for the lifetime of
+ * the table. Lookups go through an open addressing hash index keyed on
+ * (src_prt, dst_prt), so their cost doesn't depend on the amount of ports.
+ *
+ * This header is included by common.hpp right after 'open_port' is defined.
+ */
+
+#ifndef __FLOW_TABLE__
+#define __FLOW_TABLE__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* 'open_port' must be complete here, include this header through common.hpp. */
+namespace common {
+    class flow_table {
+        public:
+        typedef std::vector<open_port>::iterator iterator;
+        typedef std::vector<open_port>::const_iterator const_iterator;
+
+        /**
+         * @fn flow_table
+         * @brief Constructor of the class, creates an empty table.
+         */
+        flow_table();
+
+        /**
+         * @fn push_back
+         * @brief Adds an open communication at the end of the table.
+         *
+         * @param port - Communication to add.
+         *
+         * @return None.
+         *
+         * @note If (src_prt, dst_prt) is already open, lookups keep returning
+         *       the first entry, like a linear scan would.
+         */
+        void push_back(const open_port &port);
+
+        /**
+         * @fn find
+         * @brief Finds the entry of the communication src_prt -> dst_prt.
+         *
+         * @param src_prt - Source port.
+         * @param dst_prt - Destination port.
+         *
+         * @return Index of the entry, or -1 if the communication isn't open.
+         */
+        int find(uint16_t src_prt, uint16_t dst_prt) const {
+            if (ports.empty()) {
+                return -1;
+            }
+            uint32_t key = make_key(src_prt, dst_prt);
+            size_t slot = hash(key);
+            // The index is at most half full, so probing always ends on an empty slot
+            while (slots[slot] != EMPTY_SLOT) {
+                if (keys[slot] == key) {
+                    return slots[slot];
+                }
+                slot = (slot + 1) & slot_mask;
+            }
+            return -1;
+        }
+
+        size_t size() const { return ports.size(); }
+        bool empty() const { return ports.empty(); }
+        open_port &operator[](size_t i) { return ports[i]; }
+        const open_port &operator[](size_t i) const { return ports[i]; }
+        iterator begin() { return ports.begin(); }
+        iterator end() { return ports.end(); }
+        const_iterator begin() const { return ports.begin(); }
+        const_iterator end() const { return ports.end(); }
+
+        private:
+        static const int32_t EMPTY_SLOT = -1;
+
+        static uint32_t make_key(uint16_t src_prt, uint16_t dst_prt) {
+            return (static_cast<uint32_t>(src_prt) << 16) | dst_prt;
+        }
+
+        size_t hash(uint32_t key) const {
+            // Fibonacci hashing, the top bits are the best mixed
+            return static_cast<size_t>((key * 0x9E3779B1u) >> hash_shift) & slot_mask;
+        }
+
+        /**
+         * @fn grow
+         * @brief Doubles the hash index and re-inserts every port.
+         */
+        void grow();
+
+        /**
+         * @fn insert_index
+         * @brief Adds 'key' -> 'port_index' to the hash index, unless the key
+         *        is already there.
+         */
+        void insert_index(uint32_t key, int32_t port_index);
+
+        std::vector<open_port> ports;
+        std::vector<uint32_t> keys;
+        std::vector<int32_t> slots;
+        size_t slot_mask;
+        unsigned hash_shift;
+    };
+}
+
+#endif
@@ -0,0 +1,215 @@
+/**
+ * @file flow_trace.cpp
+ * @brief Implementation of the tracepoint recorder for the NIC simulation
+ *        project.
+ */
+
+#include "flow_trace.hpp"
+
+#ifdef NIC_TRACE
+#include "result_writer.hpp"
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    /* Events kept per thread, older ones are overwritten. */
+    const size_t TRACE_BUFFER_EVENTS = 1 << 18;
+
+    /* 'dur_ns' of an instant event. */
+    const uint64_t TRACE_INSTANT = ~static_cast<uint64_t>(0);
+
+    /**
+     * @brief A single recorded event.
+     */
+    struct trace_event {
+        const char *name;
+        uint64_t start_ns;
+        uint64_t dur_ns;
+    };
+
+    /**
+     * @brief Ring buffer of a single thread.
+     * @param tid - Thread id written to the dump, in order of first event.
+     * @param name - Name given by NIC_TRACE_THREAD, nullptr if none.
+     * @param recorded - Amount of events ever recorded, the next one goes to
+     *        'recorded % TRACE_BUFFER_EVENTS'.
+     */
+    struct trace_buffer {
+        unsigned tid;
+        const char *name;
+        uint64_t recorded;
+        std::vector<trace_event> events;
+
+        explicit trace_buffer(unsigned id) : tid(id), name(nullptr), recorded(0),
+                                             events(TRACE_BUFFER_EVENTS) {}
+    };
+
+    /**
+     * @brief Buffers of all threads that recorded, kept after they exit.
+     */
+    struct trace_registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<trace_buffer> > buffers;
+        std::chrono::steady_clock::time_point epoch;
+
+        trace_registry() : epoch(std::chrono::steady_clock::now()) {}
+    };
+
+    trace_registry &registry() {
+        static trace_registry instance;
+        return instance;
+    }
+
+    thread_local trace_buffer *thread_buffer = nullptr;
+
+    trace_buffer &local_buffer() {
+        if (thread_buffer == nullptr) {
+            trace_registry &reg = registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            unsigned tid = static_cast<unsigned>(reg.buffers.size()) + 1;
+            reg.buffers.push_back(std::unique_ptr<trace_buffer>(new trace_buffer(tid)));
+            thread_buffer = reg.buffers.back().get();
+        }
+        return *thread_buffer;
+    }
+
+    void append(const char *name, uint64_t start_ns, uint64_t dur_ns) {
+        trace_buffer &buffer = local_buffer();
+        trace_event &event = buffer.events[buffer.recorded++ % TRACE_BUFFER_EVENTS];
+        event.name = name;
+        event.start_ns = start_ns;
+        event.dur_ns = dur_ns;
+    }
+
+    /**
+     * @fn put_literal
+     * @brief Writes a string literal.
+     */
+    template <size_t N>
+    void put_literal(result_writer &out, const char (&text)[N]) {
+        out.put(text, N - 1);
+    }
+
+    /**
+     * @fn put_us
+     * @brief Writes nanoseconds as microseconds with 3 decimals, the unit
+     *        of Chrome trace timestamps.
+     */
+    void put_us(result_writer &out, uint64_t ns) {
+        uint32_t seconds = static_cast<uint32_t>(ns / 1000000000);
+        uint32_t rest = static_cast<uint32_t>(ns % 1000000000);
+        char digits[9];
+        for (int i = 8; i >= 0; i--) {
+            digits[i] = static_cast<char>('0' + rest % 10);
+            rest /= 10;
+        }
+        // Whole microseconds without leading zeros, then 3 decimals
+        if (seconds > 0) {
+            out.put_uint(seconds);
+            out.put(digits, 6);
+        } else {
+            out.put_uint(static_cast<uint32_t>(ns / 1000));
+        }
+        out.put('.');
+        out.put(digits + 6, 3);
+    }
+
+    void put_event_head(result_writer &out, bool &first, const char *name,
+                        const char *phase, unsigned tid) {
+        if (!first) {
+            out.put(',');
+        }
+        first = false;
+        put_literal(out, "\n{\"name\": \"");
+        out.put(name, std::strlen(name));
+        put_literal(out, "\", \"ph\": \"");
+        out.put(phase, std::strlen(phase));
+        put_literal(out, "\", \"pid\": 1, \"tid\": ");
+        out.put_uint(tid);
+    }
+}
+
+namespace common {
+
+bool tracing_enabled() {
+    return true;
+}
+
+uint64_t trace_now() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - registry().epoch).count());
+}
+
+void trace_record(const char *name, uint64_t start_ns, uint64_t dur_ns) {
+    append(name, start_ns, dur_ns);
+}
+
+void trace_instant(const char *name) {
+    append(name, trace_now(), TRACE_INSTANT);
+}
+
+void trace_thread_name(const char *name) {
+    local_buffer().name = name;
+}
+
+bool trace_dump(const std::string &path) {
+    result_writer out(path);
+    if (!out.is_open()) {
+        return false;
+    }
+
+    trace_registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    bool first = true;
+    put_literal(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (const std::unique_ptr<trace_buffer> &buffer : reg.buffers) {
+        if (buffer->name != nullptr) {
+            put_event_head(out, first, "thread_name", "M", buffer->tid);
+            put_literal(out, ", \"args\": {\"name\": \"");
+            out.put(buffer->name, std::strlen(buffer->name));
+            put_literal(out, "\"}}");
+        }
+
+        // Oldest surviving event first
+        uint64_t begin = buffer->recorded > TRACE_BUFFER_EVENTS ?
+                         buffer->recorded - TRACE_BUFFER_EVENTS : 0;
+        for (uint64_t i = begin; i < buffer->recorded; i++) {
+            const trace_event &event = buffer->events[i % TRACE_BUFFER_EVENTS];
+            bool instant = event.dur_ns == TRACE_INSTANT;
+            put_event_head(out, first, event.name, instant ? "i" : "X", buffer->tid);
+            put_literal(out, ", \"ts\": ");
+            put_us(out, event.start_ns);
+            if (instant) {
+                put_literal(out, ", \"s\": \"t\"}");
+            } else {
+                put_literal(out, ", \"dur\": ");
+                put_us(out, event.dur_ns);
+                out.put('}');
+            }
+        }
+    }
+    put_literal(out, "\n]}\n");
+    return out.flush();
+}
+
+}
+
+#else
+
+namespace common {
+
+bool tracing_enabled() {
+    return false;
+}
+
+bool trace_dump(const std::string &) {
+    return false;
+}
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file flow_trace.hpp
+ * @brief This header defines the tracepoints of the NIC simulation project.
+ *
+ * The NIC_TRACE_* macros mark the boundaries of the packet path. Unless the
+ * project is built with NIC_TRACE defined (make TRACE=1) they expand to
+ * nothing. When enabled, every thread records its events into its own
+ * fixed size ring buffer (the oldest events are overwritten), and
+ * 'trace_dump' writes all buffers as a Chrome/Perfetto "traceEvents" JSON
+ * timeline, to be opened in chrome://tracing or ui.perfetto.dev.
+ *
+ * Event names must be string literals, only their address is recorded.
+ */
+
+#ifndef __FLOW_TRACE__
+#define __FLOW_TRACE__
+
+#include <cstdint>
+#include <string>
+
+#ifdef NIC_TRACE
+#define NIC_TRACE_JOIN2(a, b) a##b
+#define NIC_TRACE_JOIN(a, b) NIC_TRACE_JOIN2(a, b)
+/* Records the rest of the enclosing scope as a "name" slice. */
+#define NIC_TRACE_SCOPE(name) \
+    common::trace_scope NIC_TRACE_JOIN(nic_trace_scope_, __LINE__)(name)
+/* Records a point in time. */
+#define NIC_TRACE_INSTANT(name) common::trace_instant(name)
+/* Names the calling thread in the timeline. */
+#define NIC_TRACE_THREAD(name) common::trace_thread_name(name)
+#else
+#define NIC_TRACE_SCOPE(name) do {} while (0)
+#define NIC_TRACE_INSTANT(name) do {} while (0)
+#define NIC_TRACE_THREAD(name) do {} while (0)
+#endif
+
+namespace common {
+    /**
+     * @fn tracing_enabled
+     * @brief Checks whether the tracepoints are compiled in.
+     *
+     * @return true if 'trace_dump' has anything to write.
+     */
+    bool tracing_enabled();
+
+    /**
+     * @fn trace_dump
+     * @brief Writes the events of all threads as a Chrome trace JSON file.
+     *
+     * @param path - File to write.
+     *
+     * @return true on success, false if the file can't be written or the
+     *         tracepoints are not compiled in.
+     *
+     * @note Must not run while traced threads are recording.
+     */
+    bool trace_dump(const std::string &path);
+
+#ifdef NIC_TRACE
+    /**
+     * @fn trace_now
+     * @brief Nanoseconds since the first traced event of the process.
+     */
+    uint64_t trace_now();
+
+    /**
+     * @fn trace_record
+     * @brief Appends a finished slice to the calling thread's buffer.
+     *
+     * @param name - Name of the event, a string literal.
+     * @param start_ns - Start time, from 'trace_now'.
+     * @param dur_ns - Duration.
+     *
+     * @return None.
+     */
+    void trace_record(const char *name, uint64_t start_ns, uint64_t dur_ns);
+
+    /**
+     * @fn trace_instant
+     * @brief Appends a point in time to the calling thread's buffer.
+     *
+     * @return None.
+     */
+    void trace_instant(const char *name);
+
+    /**
+     * @fn trace_thread_name
+     * @brief Names the calling thread in the dump.
+     *
+     * @return None.
+     */
+    void trace_thread_name(const char *name);
+
+    /**
+     * @brief Records its own lifetime as a slice.
+     */
+    class trace_scope {
+        public:
+        explicit trace_scope(const char *name) : name(name), start(trace_now()) {}
+
+        ~trace_scope() {
+            trace_record(name, start, trace_now() - start);
+        }
+
+        private:
+        const char *name;
+        uint64_t start;
+    };
+#endif
+}
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file header_batch.cpp
+ * @brief Implementation of the structure-of-arrays L3 header batch of the
+ *        NIC simulation project.
+ */
+
+#include "header_batch.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace common {
+
+void header_batch::rewrite_scalar(uint32_t nic_ip, size_t first) {
+    for (size_t i = first; i < count; i++) {
+        live[i] = ttl[i] > 1 ? 0xFF : 0;
+        if (live[i]) {
+            // The checksum is an additive sum, the TTL byte lost 1
+            ttl[i]--;
+            checksum[i]--;
+        }
+        to_nic[i] = dst_ip[i] == nic_ip ? 0xFF : 0;
+    }
+}
+
+void header_batch::rewrite(uint32_t nic_ip) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i nic = _mm_set1_epi32(static_cast<int>(nic_ip));
+    for (; i + 16 <= count; i += 16) {
+        // TTL: 16 lanes, live where the decremented TTL is not 0. Filtered
+        // lanes keep their TTL
+        __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ttl + i));
+        __m128i alive = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(t, one), zero),
+                                         _mm_set1_epi8(-1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(live + i), alive);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(ttl + i),
+                         _mm_add_epi8(t, alive));
+
+        // Checksum: 8 lanes twice, adding the widened live mask subtracts 1
+        // from the live lanes only
+        __m128i *sums = reinterpret_cast<__m128i *>(checksum + i);
+        __m128i low = _mm_loadu_si128(sums);
+        __m128i high = _mm_loadu_si128(sums + 1);
+        _mm_storeu_si128(sums, _mm_add_epi16(low, _mm_unpacklo_epi8(alive, alive)));
+        _mm_storeu_si128(sums + 1, _mm_add_epi16(high, _mm_unpackhi_epi8(alive, alive)));
+
+        // Destination: 4 lanes four times, narrowed back to a byte per header
+        const __m128i *dsts = reinterpret_cast<const __m128i *>(dst_ip + i);
+        __m128i d0 = _mm_cmpeq_epi32(_mm_loadu_si128(dsts), nic);
+        __m128i d1 = _mm_cmpeq_epi32(_mm_loadu_si128(dsts + 1), nic);
+        __m128i d2 = _mm_cmpeq_epi32(_mm_loadu_si128(dsts + 2), nic);
+        __m128i d3 = _mm_cmpeq_epi32(_mm_loadu_si128(dsts + 3), nic);
+        __m128i hits = _mm_packs_epi16(_mm_packs_epi32(d0, d1), _mm_packs_epi32(d2, d3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(to_nic + i), hits);
+    }
+#endif
+    rewrite_scalar(nic_ip, i);
+}
+
+}
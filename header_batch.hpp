@@ -0,0 +1,67 @@
+/**
+ * @file header_batch.hpp
+ * @brief This header defines the structure-of-arrays L3 header batch of the
+ *        NIC simulation project.
+ *
+ * nic_sim::process_batch gathers the L3 headers of a batch of packets into
+ * one array per field, so the per-header steps that don't depend on the
+ * other packets of the flow (TTL decrement, TTL-zero filtering, the
+ * checksum adjustment and the NIC address test) run 16 headers at a time
+ * with SSE2 instead of a packet and a byte at a time.
+ */
+
+#ifndef __HEADER_BATCH__
+#define __HEADER_BATCH__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace common {
+    /**
+     * @brief L3 headers of a batch, one array per field.
+     * @param count - Amount of headers in use.
+     * @param dst_ip - Destination addresses, see 'ip_to_u32'.
+     * @param checksum - L3 checksums.
+     * @param ttl - TTLs.
+     * @param live - 0xFF where the TTL is still above zero after the
+     *        decrement (set by 'rewrite').
+     * @param to_nic - 0xFF where the destination is the NIC (set by
+     *        'rewrite').
+     */
+    struct header_batch {
+        /* Most headers in a batch, a multiple of 16. */
+        static const size_t CAPACITY = 256;
+
+        size_t count;
+        uint32_t dst_ip[CAPACITY];
+        uint16_t checksum[CAPACITY];
+        uint8_t ttl[CAPACITY];
+        uint8_t live[CAPACITY];
+        uint8_t to_nic[CAPACITY];
+
+        header_batch() : count(0) {}
+
+        /**
+         * @fn rewrite
+         * @brief Filters the headers whose TTL is 0 or runs out with the
+         *        decrement, decrements the TTL of the others and adjusts
+         *        their checksum, and tests their destination against the
+         *        NIC's address.
+         *
+         * @param nic_ip - The NIC's address, see 'ip_to_u32'.
+         *
+         * @return None.
+         */
+        void rewrite(uint32_t nic_ip);
+
+        /**
+         * @fn rewrite_scalar
+         * @brief Same as 'rewrite', for headers [first, count) one at a time.
+         *
+         * @return None.
+         */
+        void rewrite_scalar(uint32_t nic_ip, size_t first);
+    };
+}
+
+#endif
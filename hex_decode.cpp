@@ -0,0 +1,280 @@
+/**
+ * @file hex_decode.cpp
+ * @brief Implementation of the hex payload decoder for the NIC simulation
+ *        project.
+ *
+ * The SIMD kernels work on the canonical layout "xx xx ... xx", where byte k
+ * occupies characters [3k, 3k + 2) and character 3k + 2 is a space. A group of
+ * 48 characters (three 16-byte lanes) holds exactly 16 bytes, so each lane has
+ * a fixed pattern of high digits, low digits and separators. The kernels check
+ * the pattern, turn every digit into its nibble value and use byte shuffles to
+ * gather the high and low nibbles of the 16 bytes.
+ */
+
+#include <cstring>
+#include "common.hpp"
+#include "hex_decode.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HEX_DECODE_HAS_SIMD 1
+#endif
+
+namespace common {
+
+int decode_hex_payload_scalar(field_view text, uint8_t *out, int max_bytes) {
+    field_tokenizer bytes(text, ' ');
+    field_view hex_byte;
+    int count = 0;
+    while (count < max_bytes && bytes.next(hex_byte)) {
+        if (hex_byte.empty()) {
+            continue;
+        }
+        if (parse_u8(hex_byte, out[count], 16) != PARSE_OK) {
+            return -1;
+        }
+        count++;
+    }
+    return count;
+}
+
+#ifdef HEX_DECODE_HAS_SIMD
+namespace {
+    /* Characters and bytes handled by one group of three 16-byte lanes. */
+    const int GROUP_CHARS = 48;
+    const int GROUP_BYTES = 16;
+
+    /* Separator positions (bit per character) of lanes 0, 1 and 2 of a group. */
+    const int SEP_BITS[3] = { 0x4924, 0x2492, 0x9249 };
+
+    /* Shuffle masks gathering the high/low digit of byte j from lane k. */
+    const int8_t HI_SHUFFLE[3][16] = {
+        {  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13 }
+    };
+    const int8_t LO_SHUFFLE[3][16] = {
+        {  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14 }
+    };
+
+    typedef bool (*hex_kernel)(const char *text, uint8_t *out, int groups);
+
+    /**
+     * @fn nibbles_ssse3
+     * @brief Converts 16 characters to nibble values.
+     *
+     * @param [in] v - Characters.
+     * @param [in] sep_bits - Positions that must hold a space.
+     * @param [in,out] ok - Cleared if a character doesn't fit the pattern.
+     *
+     * @return Nibble value of every digit position.
+     */
+    __attribute__((target("ssse3")))
+    inline __m128i nibbles_ssse3(__m128i v, int sep_bits, bool &ok) {
+        const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                               _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+        const __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                               _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+        const __m128i is_space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+
+        int hex_bits = _mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha));
+        int space_bits = _mm_movemask_epi8(is_space);
+        ok = ok && space_bits == sep_bits && hex_bits == (~sep_bits & 0xFFFF);
+
+        return _mm_or_si128(
+            _mm_and_si128(is_digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+            _mm_and_si128(is_alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    }
+
+    /**
+     * @fn decode_ssse3
+     * @brief Decodes 'groups' groups of 48 characters into 16 bytes each.
+     *
+     * @return true if every group has the canonical layout.
+     */
+    __attribute__((target("ssse3")))
+    bool decode_ssse3(const char *text, uint8_t *out, int groups) {
+        bool ok = true;
+        for (int g = 0; g < groups; ++g) {
+            __m128i hi = _mm_setzero_si128();
+            __m128i lo = _mm_setzero_si128();
+            for (int k = 0; k < 3; ++k) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                    text + g * GROUP_CHARS + k * 16));
+                __m128i nib = nibbles_ssse3(v, SEP_BITS[k], ok);
+                hi = _mm_or_si128(hi, _mm_shuffle_epi8(nib,
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(HI_SHUFFLE[k]))));
+                lo = _mm_or_si128(lo, _mm_shuffle_epi8(nib,
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(LO_SHUFFLE[k]))));
+            }
+            // Nibbles are < 16, so the 16-bit shift never crosses a byte
+            __m128i bytes = _mm_or_si128(_mm_slli_epi16(hi, 4), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + g * GROUP_BYTES), bytes);
+        }
+        return ok;
+    }
+
+    /**
+     * @fn nibbles_avx2
+     * @brief Converts 32 characters (two lanes with the same pattern) to
+     *        nibble values, see 'nibbles_ssse3'.
+     */
+    __attribute__((target("avx2")))
+    inline __m256i nibbles_avx2(__m256i v, int sep_bits, bool &ok) {
+        const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        const __m256i is_digit = _mm256_andnot_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('9')),
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)));
+        const __m256i is_alpha = _mm256_andnot_si256(
+            _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('f')),
+            _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)));
+        const __m256i is_space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+
+        uint32_t sep = static_cast<uint32_t>(sep_bits) | (static_cast<uint32_t>(sep_bits) << 16);
+        uint32_t hex_bits = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha)));
+        uint32_t space_bits = static_cast<uint32_t>(_mm256_movemask_epi8(is_space));
+        ok = ok && space_bits == sep && hex_bits == ~sep;
+
+        return _mm256_or_si256(
+            _mm256_and_si256(is_digit, _mm256_sub_epi8(v, _mm256_set1_epi8('0'))),
+            _mm256_and_si256(is_alpha, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+    }
+
+    /**
+     * @fn decode_avx2
+     * @brief Decodes pairs of 48-character groups (96 characters, 32 bytes)
+     *        per iteration.
+     *
+     * The six 16-byte lanes of two groups are regrouped so that lane k of the
+     * first group and lane k of the second group share a 256-bit register,
+     * then the 128-bit shuffle masks apply to both halves at once.
+     *
+     * @return true if every group has the canonical layout.
+     */
+    __attribute__((target("avx2")))
+    bool decode_avx2(const char *text, uint8_t *out, int groups) {
+        bool ok = true;
+        int g = 0;
+        for (; g + 1 < groups; g += 2) {
+            const char *base = text + g * GROUP_CHARS;
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base + 32));
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base + 64));
+            __m256i lanes[3] = {
+                _mm256_permute2x128_si256(a, b, 0x30),
+                _mm256_permute2x128_si256(a, c, 0x21),
+                _mm256_permute2x128_si256(b, c, 0x30)
+            };
+            __m256i hi = _mm256_setzero_si256();
+            __m256i lo = _mm256_setzero_si256();
+            for (int k = 0; k < 3; ++k) {
+                __m256i nib = nibbles_avx2(lanes[k], SEP_BITS[k], ok);
+                __m256i hi_mask = _mm256_broadcastsi128_si256(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(HI_SHUFFLE[k])));
+                __m256i lo_mask = _mm256_broadcastsi128_si256(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(LO_SHUFFLE[k])));
+                hi = _mm256_or_si256(hi, _mm256_shuffle_epi8(nib, hi_mask));
+                lo = _mm256_or_si256(lo, _mm256_shuffle_epi8(nib, lo_mask));
+            }
+            __m256i bytes = _mm256_or_si256(_mm256_slli_epi16(hi, 4), lo);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + g * GROUP_BYTES), bytes);
+        }
+        // Odd group count, finish with the 128-bit kernel
+        if (g < groups) {
+            ok = decode_ssse3(text + g * GROUP_CHARS, out + g * GROUP_BYTES, 1) && ok;
+        }
+        return ok;
+    }
+
+    /**
+     * @fn select_kernel
+     * @brief Picks the widest kernel the running CPU supports.
+     *
+     * @return Kernel, or nullptr if only the scalar decoder can be used.
+     */
+    hex_kernel select_kernel() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return decode_avx2;
+        if (__builtin_cpu_supports("ssse3")) return decode_ssse3;
+        return nullptr;
+    }
+
+    /**
+     * @fn padding_pattern
+     * @brief Canonical "00 00 ..." text used to pad a payload to whole groups.
+     */
+    const char *padding_pattern() {
+        static char pattern[DATA_ARR_SIZE * 3];
+        static bool filled = false;
+        if (!filled) {
+            for (int i = 0; i < DATA_ARR_SIZE * 3; ++i) {
+                pattern[i] = (i % 3 == 2) ? ' ' : '0';
+            }
+            filled = true;
+        }
+        return pattern;
+    }
+
+    const hex_kernel kernel = select_kernel();
+    const char *const padding = padding_pattern();
+}
+#endif
+
+void append_hex_payload(std::string &out, const uint8_t *bytes, int count) {
+    static const char digits[] = "0123456789abcdef";
+    if (count <= 0) {
+        return;
+    }
+    size_t pos = out.size();
+    out.resize(pos + static_cast<size_t>(count) * 3 - 1);
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) out[pos++] = ' ';
+        out[pos++] = digits[bytes[i] >> 4];
+        out[pos++] = digits[bytes[i] & 0x0F];
+    }
+}
+
+bool hex_payload_matches(field_view text, const uint8_t *bytes, int count) {
+    static const char digits[] = "0123456789abcdef";
+    if (count <= 0) {
+        return count == 0 && text.empty();
+    }
+    if (text.size() != static_cast<size_t>(count) * 3 - 1) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        const char *c = text.ptr + i * 3;
+        if (c[0] != digits[bytes[i] >> 4] || c[1] != digits[bytes[i] & 0x0F] ||
+            (i > 0 && c[-1] != ' ')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int decode_hex_payload(field_view text, uint8_t *out, int max_bytes) {
+#ifdef HEX_DECODE_HAS_SIMD
+    // Canonical layout: n bytes take exactly 3n - 1 characters
+    int n = static_cast<int>((text.size() + 1) / 3);
+    if (kernel != nullptr && text.size() % 3 == 2 && n <= max_bytes &&
+        max_bytes <= DATA_ARR_SIZE) {
+        char buf[DATA_ARR_SIZE * 3];
+        uint8_t bytes[DATA_ARR_SIZE];
+        int groups = (n + GROUP_BYTES - 1) / GROUP_BYTES;
+        std::memcpy(buf, padding, static_cast<size_t>(groups * GROUP_CHARS));
+        std::memcpy(buf, text.ptr, text.size());
+        if (kernel(buf, bytes, groups)) {
+            std::memcpy(out, bytes, static_cast<size_t>(n));
+            return n;
+        }
+    }
+#endif
+    // Irregular spacing, single digit bytes or invalid input
+    return decode_hex_payload_scalar(text, out, max_bytes);
+}
+
+}
@@ -0,0 +1,72 @@
+/**
+ * @file hex_decode.hpp
+ * @brief This header declares the decoder of the space separated hex payload
+ *        ("08 c9 3a ...") carried by L4 packets.
+ *
+ * The canonical layout (two hex digits per byte, single spaces between bytes)
+ * is validated and converted with SIMD kernels when the CPU supports them,
+ * anything else goes through a scalar decoder with the same semantics. The
+ * reverse direction, used when a packet is turned back into a string, lives
+ * here as well.
+ */
+
+#ifndef __HEX_DECODE__
+#define __HEX_DECODE__
+
+#include <cstdint>
+#include <string>
+#include "parse.hpp"
+
+namespace common {
+    /**
+     * @fn decode_hex_payload
+     * @brief Validates and decodes a space separated run of hex bytes.
+     *
+     * Bytes are separated by one or more spaces and are made of one or two hex
+     * digits. Decoding stops after 'max_bytes' bytes, the rest of the text is
+     * ignored.
+     *
+     * @param [in] text - Payload text.
+     * @param [out] out - Array of at least 'max_bytes' bytes.
+     * @param [in] max_bytes - Maximum amount of bytes to decode, at most
+     *             DATA_ARR_SIZE.
+     *
+     * @return Amount of bytes written to 'out', or -1 if a byte is malformed.
+     */
+    int decode_hex_payload(field_view text, uint8_t *out, int max_bytes);
+
+    /**
+     * @fn decode_hex_payload_scalar
+     * @brief Reference implementation of 'decode_hex_payload', one byte at a
+     *        time.
+     */
+    int decode_hex_payload_scalar(field_view text, uint8_t *out, int max_bytes);
+
+    /**
+     * @fn append_hex_payload
+     * @brief Appends bytes in the canonical payload format ("08 c9 3a").
+     *
+     * @param [out] out - String to append to.
+     * @param [in] bytes - Bytes to format.
+     * @param [in] count - Amount of bytes.
+     *
+     * @return None.
+     */
+    void append_hex_payload(std::string &out, const uint8_t *bytes, int count);
+
+    /**
+     * @fn hex_payload_matches
+     * @brief Checks whether 'text' is exactly what 'append_hex_payload'
+     *        gives for the bytes, i.e whether the payload text can be
+     *        rebuilt from the decoded bytes.
+     *
+     * @param [in] text - Payload text.
+     * @param [in] bytes - Decoded bytes.
+     * @param [in] count - Amount of decoded bytes.
+     *
+     * @return true if the text is canonical.
+     */
+    bool hex_payload_matches(field_view text, const uint8_t *bytes, int count);
+}
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * @file latency_histogram.cpp
+ * @brief Implementation of the per-packet latency histograms of the NIC
+ *        simulation project.
+ */
+
+#include "latency_histogram.hpp"
+
+namespace {
+    /* JSON names of the outcomes, in 'latency_outcome' order. */
+    const char *const OUTCOME_NAMES[common::LATENCY_OUTCOMES] = {
+        "dram",
+        "rq",
+        "tq",
+        "drop"
+    };
+
+    /* JSON names of the layers, L2 to L4. */
+    const char *const LAYER_NAMES[common::LATENCY_LAYERS] = {
+        "L2",
+        "L3",
+        "L4"
+    };
+}
+
+namespace common {
+    thread_local latency_set *thread_latency = nullptr;
+
+    latency_histogram::latency_histogram() : total(0), largest(0) {
+        for (int i = 0; i < BUCKETS; i++) {
+            counts[i] = 0;
+        }
+    }
+
+    void latency_histogram::merge(const latency_histogram &other) {
+        for (int i = 0; i < BUCKETS; i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        if (other.largest > largest) {
+            largest = other.largest;
+        }
+    }
+
+    uint64_t latency_histogram::bucket_end(int bucket) {
+        if (bucket < (2 << SUB_BITS)) {
+            return static_cast<uint64_t>(bucket);
+        }
+        int shift = (bucket >> SUB_BITS) - 1;
+        uint64_t first = static_cast<uint64_t>((bucket & ((1 << SUB_BITS) - 1)) +
+                                               (1 << SUB_BITS)) << shift;
+        return first + ((static_cast<uint64_t>(1) << shift) - 1);
+    }
+
+    uint64_t latency_histogram::value_at(double percentile) const {
+        if (total == 0) {
+            return 0;
+        }
+
+        // Rank of the value, counting from 1
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * total + 0.999999);
+        if (rank < 1) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                uint64_t end = bucket_end(i);
+                return end < largest ? end : largest;
+            }
+        }
+        return largest;
+    }
+
+    latency_registry::latency_registry() : flow_cycles(0), flow_ns(0),
+                                           start_cycles(0) {}
+
+    void latency_registry::attach() {
+        thread_latency = add_set();
+    }
+
+    latency_set *latency_registry::add_set() {
+        std::lock_guard<std::mutex> lock(mutex);
+        sets.push_back(std::unique_ptr<latency_set>(new latency_set()));
+        return sets.back().get();
+    }
+
+    void latency_registry::detach() {
+        thread_latency = nullptr;
+    }
+
+    void latency_registry::begin_flow() {
+        start_time = std::chrono::steady_clock::now();
+        start_cycles = cycle_now();
+    }
+
+    void latency_registry::end_flow() {
+        flow_cycles += cycle_now() - start_cycles;
+        flow_ns += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_time).count());
+    }
+
+    void latency_registry::write_json(std::ostream &out) const {
+        double ns_per_cycle = flow_cycles > 0 ?
+                              static_cast<double>(flow_ns) / flow_cycles : 1.0;
+
+        out << "{\"kind\": \"latency\", \"unit\": \"ns\", \"ns_per_cycle\": "
+            << ns_per_cycle << ", \"histograms\": [";
+        bool first = true;
+        for (int layer = 0; layer < LATENCY_LAYERS; layer++) {
+            for (int outcome = 0; outcome < LATENCY_OUTCOMES; outcome++) {
+                latency_histogram merged;
+                for (const std::unique_ptr<latency_set> &set : sets) {
+                    merged.merge(set->histograms[layer][outcome]);
+                }
+                if (merged.count() == 0) {
+                    continue;
+                }
+
+                out << (first ? "" : ", ") << "{\"layer\": \"" << LAYER_NAMES[layer]
+                    << "\", \"outcome\": \"" << OUTCOME_NAMES[outcome]
+                    << "\", \"count\": " << merged.count();
+                static const double PERCENTILES[] = {50.0, 99.0, 99.9};
+                static const char *const PERCENTILE_NAMES[] = {"p50", "p99", "p999"};
+                for (int p = 0; p < 3; p++) {
+                    out << ", \"" << PERCENTILE_NAMES[p] << "\": "
+                        << static_cast<uint64_t>(merged.value_at(PERCENTILES[p]) *
+                                                 ns_per_cycle + 0.5);
+                }
+                out << ", \"max\": "
+                    << static_cast<uint64_t>(merged.max() * ns_per_cycle + 0.5) << "}";
+                first = false;
+            }
+        }
+        out << "]}" << std::endl;
+    }
+}
@@ -0,0 +1,275 @@
+/**
+ * @file latency_histogram.hpp
+ * @brief This header defines the per-packet latency histograms of the NIC
+ *        simulation project.
+ *
+ * A packet's latency is the time from the packet factory to its final
+ * decision (stored to RQ/TQ/LOCAL DRAM or dropped), measured with the CPU
+ * cycle counter and kept per packet layer and outcome. The histograms are
+ * log-linear (HDR-style): every power of two is split into 32 buckets, so a
+ * recorded value is off by at most ~3% at any magnitude, and recording is a
+ * count-leading-zeros and an increment.
+ *
+ * Like the counters of flow_stats.hpp, every thread of a flow records into
+ * its own set, attached for the flow, and the sets are only read after the
+ * flow's threads are joined.
+ */
+
+#ifndef __LATENCY_HISTOGRAM__
+#define __LATENCY_HISTOGRAM__
+
+#include "common.hpp"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace common {
+    /* Final decision of a packet. The stored ones match 'memory_dest'. */
+    enum latency_outcome {
+        LATENCY_DRAM = LOCAL_DRAM,
+        LATENCY_RQ = RQ,
+        LATENCY_TQ = TQ,
+        LATENCY_DROP,
+        LATENCY_OUTCOMES
+    };
+
+    /* Packet layers with a histogram set, L2 to L4. */
+    const int LATENCY_LAYERS = 3;
+
+    /**
+     * @fn cycle_now
+     * @brief Reads the cycle counter, or a nanosecond clock on targets
+     *        without one.
+     */
+    inline uint64_t cycle_now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    /**
+     * @brief Log-linear histogram of cycle counts.
+     */
+    class latency_histogram {
+        public:
+        /* Linear buckets per power of two, as a shift. */
+        static const int SUB_BITS = 5;
+        /* Buckets needed to cover all 64-bit values. */
+        static const int BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+        latency_histogram();
+
+        /**
+         * @fn record
+         * @brief Counts a single value.
+         *
+         * @return None.
+         */
+        void record(uint64_t value) {
+            counts[bucket_of(value)]++;
+            total++;
+            if (value > largest) {
+                largest = value;
+            }
+        }
+
+        /**
+         * @fn merge
+         * @brief Adds all values of 'other' to this histogram.
+         *
+         * @return None.
+         */
+        void merge(const latency_histogram &other);
+
+        /**
+         * @fn value_at
+         * @brief Returns the value below or at which 'percentile' percent of
+         *        the recorded values are, rounded up to its bucket's end.
+         *
+         * @param percentile - 0 to 100.
+         *
+         * @return The value, 0 if nothing was recorded.
+         */
+        uint64_t value_at(double percentile) const;
+
+        uint64_t count() const { return total; }
+        uint64_t max() const { return largest; }
+
+        private:
+        static int bucket_of(uint64_t value) {
+            // Values below 2^(SUB_BITS + 1) have a bucket each, above that
+            // the SUB_BITS bits after the leading one select the bucket
+            int msb = 63 - __builtin_clzll(value | 1);
+            int shift = msb > SUB_BITS ? msb - SUB_BITS : 0;
+            return (shift << SUB_BITS) + static_cast<int>(value >> shift);
+        }
+
+        static uint64_t bucket_end(int bucket);
+
+        uint64_t counts[BUCKETS];
+        uint64_t total;
+        uint64_t largest;
+    };
+
+    /**
+     * @brief Histograms of a single thread, per layer and outcome.
+     */
+    struct latency_set {
+        latency_histogram histograms[LATENCY_LAYERS][LATENCY_OUTCOMES];
+    };
+
+    /* Set of the calling thread, nullptr if latency isn't recorded. */
+    extern thread_local latency_set *thread_latency;
+
+    /**
+     * @brief Measures a single packet on the calling thread's set.
+     */
+    class latency_probe {
+        public:
+        latency_probe() : set(thread_latency), start(set != nullptr ? cycle_now() : 0) {}
+
+        /**
+         * @fn elapsed
+         * @brief Cycles since the probe was created, for a packet whose path
+         *        continues on another thread.
+         */
+        uint64_t elapsed() const {
+            return set != nullptr ? cycle_now() - start : 0;
+        }
+
+        /**
+         * @fn finish
+         * @brief Records the packet.
+         *
+         * @param layer - Layer of the packet, L2 to L4.
+         * @param outcome - Final decision of the packet.
+         * @param carried - Cycles the packet already spent on other threads.
+         *
+         * @return None.
+         */
+        void finish(packet_layer layer, latency_outcome outcome, uint64_t carried = 0) {
+            if (set != nullptr && layer != LAYER_AUTO) {
+                set->histograms[layer - LAYER_L2][outcome].record(
+                    carried + cycle_now() - start);
+            }
+        }
+
+        private:
+        latency_set *set;
+        uint64_t start;
+    };
+
+    /**
+     * @brief Sets of all threads that recorded, and the cycle counter rate
+     *        measured over the flows.
+     */
+    class latency_registry {
+        public:
+        latency_registry();
+
+        /**
+         * @fn attach
+         * @brief Gives the calling thread a new set, until 'detach'.
+         *
+         * @return None.
+         */
+        void attach();
+
+        /**
+         * @fn add_set
+         * @brief Creates a set for work that moves between threads, see
+         *        'attach(latency_set *)'.
+         *
+         * @return The set, owned by the registry.
+         */
+        latency_set *add_set();
+
+        /**
+         * @fn attach
+         * @brief Gives the calling thread 'set', until 'detach'. The threads
+         *        sharing a set must take turns.
+         *
+         * @return None.
+         */
+        static void attach(latency_set *set) { thread_latency = set; }
+
+        /**
+         * @fn detach
+         * @brief Stops recording on the calling thread, its values are kept.
+         *
+         * @return None.
+         */
+        static void detach();
+
+        /**
+         * @fn begin_flow
+         * @brief Starts measuring the cycle counter against the wall clock.
+         *
+         * @return None.
+         */
+        void begin_flow();
+
+        /**
+         * @fn end_flow
+         * @brief Ends the measurement started by 'begin_flow'.
+         *
+         * @return None.
+         */
+        void end_flow();
+
+        /**
+         * @fn write_json
+         * @brief Writes p50/p99/p99.9/max in nanoseconds of every layer and
+         *        outcome with packets, as a single line JSON object.
+         *
+         * @param out - Stream to write to.
+         *
+         * @return None.
+         *
+         * @note Must not run while threads are recording.
+         */
+        void write_json(std::ostream &out) const;
+
+        private:
+        std::mutex mutex;
+        std::vector<std::unique_ptr<latency_set> > sets;
+        uint64_t flow_cycles;
+        uint64_t flow_ns;
+        uint64_t start_cycles;
+        std::chrono::steady_clock::time_point start_time;
+    };
+
+    /**
+     * @brief Attaches the calling thread to a registry for its scope.
+     */
+    class latency_scope {
+        public:
+        latency_scope(latency_registry &registry, bool enabled) : attached(enabled) {
+            if (attached) {
+                registry.attach();
+            }
+        }
+
+        ~latency_scope() {
+            if (attached) {
+                latency_registry::detach();
+            }
+        }
+
+        private:
+        bool attached;
+    };
+}
+
+#endif
@@ -5,27 +5,484 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstring>
 #include <fstream>
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
 #include "NIC_sim.hpp"
 #include "packets.hpp"
+#include "alloc_counter.hpp"
+#include "flow_trace.hpp"
+#include "manifest.hpp"
+#include "task_pool.hpp"
+
+/**
+ * @fn parse_count
+ * @brief Parses the value of a thread count option (1 to 1024).
+ *
+ * @param [in] value - Text after the '='.
+ * @param [out] count - Parsed count, untouched on failure.
+ *
+ * @return true on success, false if the value is invalid.
+ */
+static bool parse_count(const char *value, unsigned &count) {
+    uint32_t parsed = 0;
+    if (common::parse_uint(common::field_view(value, std::strlen(value)),
+                           1024, parsed) != common::PARSE_OK || parsed == 0) {
+        return false;
+    }
+    count = parsed;
+    return true;
+}
+
+/**
+ * @brief Command line options that aren't flow options.
+ * @param output - Results file, empty for stdout.
+ * @param alloc_report - Set by --alloc-report.
+ * @param trace - Chrome trace file of --trace, empty for none.
+ * @param acl - ACL file of --acl, empty for none.
+ * @param manifest - Manifest of --manifest, empty for a single NIC.
+ * @param sweep - Sweep file of --sweep, empty for a single NIC.
+ * @param jobs - Worker threads of --jobs, 0 for one per hardware thread.
+ */
+struct run_options {
+    std::string output;
+    bool alloc_report;
+    std::string trace;
+    std::string acl;
+    std::string manifest;
+    std::string sweep;
+    unsigned jobs;
+
+    run_options() : alloc_report(false), jobs(0) {}
+};
+
+/**
+ * @fn parse_option
+ * @brief Applies a single "--name=value" command line option.
+ *
+ * @param [in] arg - The option as given on the command line.
+ * @param [out] options - Flow options to update.
+ * @param [out] run - Other options to update.
+ *
+ * @return true if the option is known and valid, false otherwise.
+ */
+static bool parse_option(const char *arg, flow_options &options, run_options &run) {
+    if (std::strcmp(arg, "--alloc-report") == 0) {
+        run.alloc_report = true;
+        return true;
+    }
+    if (std::strncmp(arg, "--output=", 9) == 0 && arg[9] != '\0') {
+        run.output = arg + 9;
+        return true;
+    }
+    if (std::strncmp(arg, "--manifest=", 11) == 0 && arg[11] != '\0') {
+        run.manifest = arg + 11;
+        return true;
+    }
+    if (std::strncmp(arg, "--sweep=", 8) == 0 && arg[8] != '\0') {
+        run.sweep = arg + 8;
+        return true;
+    }
+    if (std::strncmp(arg, "--jobs=", 7) == 0) {
+        return parse_count(arg + 7, run.jobs);
+    }
+    if (std::strncmp(arg, "--acl=", 6) == 0 && arg[6] != '\0') {
+        run.acl = arg + 6;
+        return true;
+    }
+    if (std::strncmp(arg, "--trace=", 8) == 0 && arg[8] != '\0') {
+        run.trace = arg + 8;
+        return true;
+    }
+    if (std::strcmp(arg, "--ingest=mmap") == 0) {
+        options.ingest = common::INGEST_MMAP;
+        return true;
+    }
+    if (std::strcmp(arg, "--ingest=stream") == 0) {
+        options.ingest = common::INGEST_STREAM;
+        return true;
+    }
+    if (std::strcmp(arg, "--checksum=off") == 0) {
+        options.checksum = common::CHECKSUM_OFF;
+        return true;
+    }
+    if (std::strcmp(arg, "--checksum=verify") == 0) {
+        options.checksum = common::CHECKSUM_VERIFY;
+        return true;
+    }
+    if (std::strncmp(arg, "--threads=", 10) == 0) {
+        return parse_count(arg + 10, options.threads);
+    }
+    if (std::strncmp(arg, "--shards=", 9) == 0) {
+        return parse_count(arg + 9, options.shards);
+    }
+    if (std::strncmp(arg, "--ring-depth=", 13) == 0) {
+        uint32_t depth = 0;
+        if (common::parse_uint(common::field_view(arg + 13, std::strlen(arg + 13)),
+                               1u << 24, depth) != common::PARSE_OK) {
+            return false;
+        }
+        options.ring_depth = depth;
+        return true;
+    }
+    if (std::strncmp(arg, "--nat-timeout=", 14) == 0) {
+        // Idle packets after which a NAT connection is evicted
+        uint32_t timeout = 0;
+        if (common::parse_uint(common::field_view(arg + 14, std::strlen(arg + 14)),
+                               0xFFFFFFFFu, timeout) != common::PARSE_OK || timeout == 0) {
+            return false;
+        }
+        options.nat_timeout = timeout;
+        return true;
+    }
+    if (std::strcmp(arg, "--latency") == 0) {
+        options.latency = true;
+        return true;
+    }
+    if (std::strcmp(arg, "--stats") == 0) {
+        options.stats = true;
+        return true;
+    }
+    if (std::strncmp(arg, "--stats-interval=", 17) == 0) {
+        uint32_t interval = 0;
+        if (common::parse_uint(common::field_view(arg + 17, std::strlen(arg + 17)),
+                               3600000, interval) != common::PARSE_OK || interval == 0) {
+            return false;
+        }
+        options.stats = true;
+        options.stats_interval_ms = interval;
+        return true;
+    }
+    if (std::strcmp(arg, "--ring-full=block") == 0) {
+        options.ring_full = common::RING_BLOCK;
+        return true;
+    }
+    if (std::strcmp(arg, "--ring-full=drop") == 0) {
+        options.ring_full = common::RING_DROP;
+        return true;
+    }
+    if (std::strcmp(arg, "--layer=auto") == 0) {
+        options.layer = common::LAYER_AUTO;
+        return true;
+    }
+    if (std::strcmp(arg, "--layer=L2") == 0) {
+        options.layer = common::LAYER_L2;
+        return true;
+    }
+    if (std::strcmp(arg, "--layer=L3") == 0) {
+        options.layer = common::LAYER_L3;
+        return true;
+    }
+    if (std::strcmp(arg, "--layer=L4") == 0) {
+        options.layer = common::LAYER_L4;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @fn report_flow
+ * @brief Writes the ring counters, statistics and latency of a NIC's flow
+ *        to stderr, as far as the options collected them.
+ *
+ * @return None.
+ */
+static void report_flow(const nic_sim &simulation, const flow_options &options) {
+    if (options.ring_depth > 0) {
+        ring_counters rq = simulation.nic_ring_counters(common::RQ);
+        ring_counters tq = simulation.nic_ring_counters(common::TQ);
+        if (rq.full + tq.full > 0) {
+            std::cerr << "RQ ring: " << rq.full << " full, " << rq.dropped << " dropped; "
+                      << "TQ ring: " << tq.full << " full, " << tq.dropped << " dropped" << std::endl;
+        }
+    }
+    if (options.stats) {
+        simulation.nic_print_stats(std::cerr);
+    }
+    if (options.latency) {
+        simulation.nic_print_latency(std::cerr);
+    }
+}
+
+/**
+ * @fn report_allocs
+ * @brief Writes the heap allocations made since 'allocs_before' to stderr.
+ *
+ * @return None.
+ */
+static void report_allocs(uint64_t allocs_before) {
+    if (common::alloc_counting_enabled()) {
+        std::cerr << "nic_flow heap allocations: "
+                  << common::alloc_count() - allocs_before << std::endl;
+    } else {
+        std::cerr << "nic_flow heap allocations: not counted (build with ALLOC_COUNT=1)" << std::endl;
+    }
+}
+
+/**
+ * @fn file_size
+ * @brief Size of a file in bytes, 0 if it can't be read.
+ */
+static uint64_t file_size(const std::string &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::streamoff size = file.is_open() ? static_cast<std::streamoff>(file.tellg()) : 0;
+    return size > 0 ? static_cast<uint64_t>(size) : 0;
+}
+
+/**
+ * @brief A NIC of a manifest run.
+ * @param entry - Its manifest line.
+ * @param simulation - The NIC, until its results are reported.
+ * @param ok - false if its ACL, its output file or its task failed.
+ * @param done - Set once its flow ran and its output file is written, or
+ *        holds the exception its task threw.
+ */
+struct nic_job {
+    manifest_entry entry;
+    std::unique_ptr<nic_sim> simulation;
+    bool ok;
+    std::promise<void> done;
+
+    nic_job() : ok(true) {}
+};
+
+/**
+ * @fn run_manifest
+ * @brief Simulates every NIC of a manifest as a task of a work-stealing
+ *        pool, see manifest.hpp.
+ *
+ * @param options - Flow options of every NIC.
+ * @param run - Other options, 'manifest' and 'jobs' select the NICs and the
+ *        pool, 'acl' applies to every NIC.
+ *
+ * @return Exit code of the program.
+ *
+ * @note The NICs share nothing, so every NIC's results are the same as
+ *       when it runs alone. Results and reports are written in manifest
+ *       order, while the later NICs may still be running.
+ */
+static int run_manifest(const flow_options &options, const run_options &run) {
+    std::vector<manifest_entry> entries;
+    if (!load_manifest(run.manifest, entries)) {
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<nic_job> > jobs;
+    std::vector<std::pair<uint64_t, size_t> > by_size;
+    std::vector<std::future<void> > finished;
+    for (size_t i = 0; i < entries.size(); i++) {
+        jobs.push_back(std::unique_ptr<nic_job>(new nic_job()));
+        jobs[i]->entry = entries[i];
+        finished.push_back(jobs[i]->done.get_future());
+        by_size.push_back(std::make_pair(file_size(entries[i].packet_file), i));
+    }
+
+    // Largest traces start first, so the last NIC to finish is a small one.
+    // Outside submissions are dealt round-robin and every worker runs its
+    // newest task first, so they are submitted smallest first
+    std::stable_sort(by_size.begin(), by_size.end());
+    uint64_t allocs_before = common::alloc_count();
+    task_pool pool(run.jobs);
+    for (size_t k = 0; k < by_size.size(); k++) {
+        nic_job *job = jobs[by_size[k].second].get();
+        pool.submit([job, &options, &run]() {
+            // The promise is always satisfied, an exception is handed to
+            // the reporting loop instead of leaving it waiting
+            try {
+                job->simulation.reset(new nic_sim(job->entry.param_file));
+                if (!run.acl.empty() && !job->simulation->nic_load_acl(run.acl)) {
+                    job->ok = false;
+                } else {
+                    job->simulation->nic_flow(job->entry.packet_file, options);
+                    if (!job->entry.output.empty() &&
+                        !job->simulation->nic_print_results(job->entry.output)) {
+                        job->ok = false;
+                    }
+                }
+            } catch (...) {
+                job->ok = false;
+                job->done.set_exception(std::current_exception());
+                return;
+            }
+            job->done.set_value();
+        });
+    }
+
+    // Report in manifest order as the NICs finish, freeing each one
+    int status = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        nic_job &job = *jobs[i];
+        try {
+            finished[i].get();
+        } catch (const std::exception &e) {
+            std::cerr << "Error: NIC " << job.entry.param_file << ' '
+                      << job.entry.packet_file << " failed: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "Error: NIC " << job.entry.param_file << ' '
+                      << job.entry.packet_file << " failed" << std::endl;
+        }
+        if (job.ok) {
+            report_flow(*job.simulation, options);
+            if (job.entry.output.empty()) {
+                std::cout << "NIC " << job.entry.param_file << ' '
+                          << job.entry.packet_file << ":\n";
+                job.simulation->nic_print_results();
+            }
+        } else {
+            status = 1;
+        }
+        job.simulation.reset();
+    }
+    pool.wait();
+
+    if (!run.trace.empty() && !common::trace_dump(run.trace)) {
+        std::cerr << "Error: Could not write trace file: " << run.trace << std::endl;
+    }
+    if (run.alloc_report) {
+        report_allocs(allocs_before);
+    }
+    return status;
+}
+
+/**
+ * @fn run_sweep
+ * @brief Runs a single trace through every NIC configuration of a sweep
+ *        file, see nic_sim::nic_sweep.
+ *
+ * @param options - Flow options of every NIC.
+ * @param run - Other options, 'sweep' and 'jobs' select the NICs and the
+ *        pool, 'acl' applies to every NIC.
+ * @param packet_file - The trace.
+ *
+ * @return Exit code of the program.
+ */
+static int run_sweep(const flow_options &options, const run_options &run,
+                     const std::string &packet_file) {
+    std::vector<manifest_entry> entries;
+    if (!load_sweep(run.sweep, entries)) {
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<nic_sim> > simulations;
+    std::vector<nic_sim *> sims;
+    for (const manifest_entry &entry : entries) {
+        simulations.push_back(std::unique_ptr<nic_sim>(new nic_sim(entry.param_file)));
+        if (!run.acl.empty() && !simulations.back()->nic_load_acl(run.acl)) {
+            return 1;
+        }
+        sims.push_back(simulations.back().get());
+    }
+
+    uint64_t allocs_before = common::alloc_count();
+    task_pool pool(run.jobs);
+    if (!nic_sim::nic_sweep(packet_file, sims, options, pool)) {
+        std::cerr << "Error: Could not open packet file: " << packet_file << std::endl;
+        return 1;
+    }
+
+    // Output files are written by the pool, the rest in sweep file order
+    std::vector<char> written(entries.size(), 1);
+    for (size_t k = 0; k < entries.size(); k++) {
+        if (!entries[k].output.empty()) {
+            nic_sim *sim = sims[k];
+            const std::string *output = &entries[k].output;
+            char *ok = &written[k];
+            pool.submit([sim, output, ok]() {
+                *ok = sim->nic_print_results(*output);
+            });
+        }
+    }
+    pool.wait();
+
+    int status = 0;
+    for (size_t k = 0; k < entries.size(); k++) {
+        report_flow(*sims[k], options);
+        if (entries[k].output.empty()) {
+            std::cout << "NIC " << entries[k].param_file << ":\n";
+            sims[k]->nic_print_results();
+        } else if (!written[k]) {
+            status = 1;
+        }
+    }
+
+    if (!run.trace.empty() && !common::trace_dump(run.trace)) {
+        std::cerr << "Error: Could not write trace file: " << run.trace << std::endl;
+    }
+    if (run.alloc_report) {
+        report_allocs(allocs_before);
+    }
+    return status;
+}
 
 int main(int argc, char *argv[]) {
     std::string param_file;
     std::string packet_file;
-    
-    assert((argc == 3) && "Expected 2 arguments: <param_file> <packet_file>");
+    std::vector<std::string> positional;
+    run_options run;
+    flow_options options;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--", 2) != 0) {
+            positional.push_back(argv[i]);
+        } else if (!parse_option(argv[i], options, run)) {
+            std::cerr << "Error: Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if (!run.trace.empty() && !common::tracing_enabled()) {
+        std::cerr << "Error: --trace needs a build with the tracepoints (make TRACE=1)" << std::endl;
+        return 1;
+    }
+
+    /* Simulate a rack of NICs. */
+    if (!run.manifest.empty()) {
+        assert(positional.empty() && run.output.empty() &&
+               "Expected no arguments with --manifest, outputs are set per NIC");
+        return run_manifest(options, run);
+    }
+
+    /* Run a trace through many NIC configurations. */
+    if (!run.sweep.empty()) {
+        assert(positional.size() == 1 && run.output.empty() &&
+               "Expected 1 argument with --sweep: [options] <packet_file>");
+        return run_sweep(options, run, positional[0]);
+    }
+
+    assert((positional.size() == 2) &&
+           "Expected 2 arguments: [options] <param_file> <packet_file>");
 
-    param_file = argv[1];
-    packet_file = argv[2];
+    param_file = positional[0];
+    packet_file = positional[1];
 
     /* Updating simulation parameters. */ 
     nic_sim simulation(param_file);
+    if (!run.acl.empty() && !simulation.nic_load_acl(run.acl)) {
+        return 1;
+    }
 
     /* Proccess all packets. */ 
-    simulation.nic_flow(packet_file);
+    uint64_t allocs_before = common::alloc_count();
+    simulation.nic_flow(packet_file, options);
+    report_flow(simulation, options);
+    if (!run.trace.empty() && !common::trace_dump(run.trace)) {
+        std::cerr << "Error: Could not write trace file: " << run.trace << std::endl;
+    }
+    if (run.alloc_report) {
+        report_allocs(allocs_before);
+    }
 
     /* Print all memory spaces. */
-    simulation.nic_print_results();
+    if (run.output.empty()) {
+        simulation.nic_print_results();
+    } else if (!simulation.nic_print_results(run.output)) {
+        return 1;
+    }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,63 @@
+/**
+ * @file manifest.cpp
+ * @brief Implementation of the NIC manifest of the NIC simulation project.
+ */
+
+#include "manifest.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+    /**
+     * @fn load_lines
+     * @brief Reads the entries of a manifest or sweep file.
+     *
+     * @param [in] path - Name of the file.
+     * @param [in] kind - Name of the file kind in error messages.
+     * @param [in] packets - Whether lines have a packet file column.
+     * @param [out] entries - The entries, in file order.
+     *
+     * @return true on success, false if the file can't be read or holds an
+     *         invalid line.
+     */
+    bool load_lines(const std::string &path, const char *kind, bool packets,
+                    std::vector<manifest_entry> &entries) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open " << kind << " file: " << path << std::endl;
+            return false;
+        }
+
+        bool ok = true;
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') {
+                continue;
+            }
+
+            // The output column is optional, anything after it is an error
+            std::istringstream columns(line);
+            manifest_entry entry;
+            std::string extra;
+            if (!(columns >> entry.param_file) ||
+                (packets && !(columns >> entry.packet_file)) ||
+                ((columns >> entry.output) && (columns >> extra))) {
+                std::cerr << "Error: Invalid " << kind << " line: " << line << std::endl;
+                ok = false;
+                continue;
+            }
+            entries.push_back(entry);
+        }
+        return ok;
+    }
+}
+
+bool load_manifest(const std::string &path, std::vector<manifest_entry> &entries) {
+    return load_lines(path, "manifest", true, entries);
+}
+
+bool load_sweep(const std::string &path, std::vector<manifest_entry> &entries) {
+    return load_lines(path, "sweep", false, entries);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file manifest.hpp
+ * @brief This header defines the NIC manifest of the NIC simulation project.
+ *
+ * A manifest lists the NICs of a rack, one per line:
+ *
+ *     <param_file> <packet_file> [output_file]
+ *
+ * Every NIC is simulated on its own, see '--manifest'. Its results go to
+ * 'output_file', or to stdout in manifest order when it is left out. Empty
+ * lines and lines starting with '#' are skipped.
+ *
+ * A sweep file lists NIC configurations that all run the same trace, see
+ * '--sweep', one per line:
+ *
+ *     <param_file> [output_file]
+ */
+
+#ifndef __MANIFEST__
+#define __MANIFEST__
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief A NIC of a manifest.
+ * @param param_file - NIC parameters file.
+ * @param packet_file - Trace of the NIC, empty in a sweep.
+ * @param output - Results file, empty for stdout.
+ */
+struct manifest_entry {
+    std::string param_file;
+    std::string packet_file;
+    std::string output;
+};
+
+/**
+ * @fn load_manifest
+ * @brief Reads the NICs of a manifest file.
+ *
+ * @param [in] path - Name of the manifest file.
+ * @param [out] entries - The NICs, in file order.
+ *
+ * @return true on success, false if the file can't be read or holds an
+ *         invalid line (reported to stderr).
+ */
+bool load_manifest(const std::string &path, std::vector<manifest_entry> &entries);
+
+/**
+ * @fn load_sweep
+ * @brief Reads the NIC configurations of a sweep file.
+ *
+ * @param [in] path - Name of the sweep file.
+ * @param [out] entries - The configurations, in file order.
+ *
+ * @return true on success, false if the file can't be read or holds an
+ *         invalid line (reported to stderr).
+ */
+bool load_sweep(const std::string &path, std::vector<manifest_entry> &entries);
+
+#endif
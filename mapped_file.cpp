@@ -0,0 +1,54 @@
+/**
+ * @file mapped_file.cpp
+ * @brief Implementation of the read-only file mapping for the NIC simulation
+ *        project.
+ */
+
+#include "mapped_file.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_HAS_MMAP 1
+#endif
+
+mapped_file::mapped_file(const std::string &path) : base(nullptr), length(0) {
+#ifdef MAPPED_FILE_HAS_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
+        return;
+    }
+
+    void *addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return;
+    }
+
+    // Packets are consumed front to back, let the kernel read ahead
+    madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    base = addr;
+    length = static_cast<size_t>(st.st_size);
+#else
+    (void)path;
+#endif
+}
+
+mapped_file::~mapped_file() {
+#ifdef MAPPED_FILE_HAS_MMAP
+    if (base != nullptr) {
+        munmap(base, length);
+    }
+#endif
+}
@@ -0,0 +1,90 @@
+/**
+ * @file mapped_file.hpp
+ * @brief This header defines a read-only memory mapping of a trace file.
+ *
+ * The purpose of this class is to let the simulator parse packets directly
+ * from the mapped pages of the packet file, without copying every line into
+ * a string first.
+ */
+
+#ifndef __MAPPED_FILE__
+#define __MAPPED_FILE__
+
+#include <cstddef>
+#include <string>
+#include "parse.hpp"
+
+class mapped_file {
+    public:
+    /**
+     * @fn mapped_file
+     * @brief Constructor of the class, maps the whole file read-only.
+     *
+     * @param path - Name of the file to map.
+     *
+     * @return New mapping object, check 'is_mapped' before use.
+     */
+    explicit mapped_file(const std::string &path);
+
+    /**
+     * @fn is_mapped
+     * @brief Checks whether the mapping succeeded.
+     *
+     * @return true if 'contents' can be used, false otherwise (e.g the file
+     *         is missing, empty, not a regular file or mmap isn't available).
+     */
+    bool is_mapped() const { return base != nullptr; }
+
+    /**
+     * @fn contents
+     * @brief Returns a view of the whole mapped file.
+     */
+    common::field_view contents() const {
+        return common::field_view(static_cast<const char *>(base), length);
+    }
+
+    /**
+     * @fn ~mapped_file
+     * @brief Destructor of the class, unmaps the file.
+     *
+     * @return None.
+     */
+    ~mapped_file();
+
+    private:
+    /* Mappings own a kernel resource, copying them makes no sense. */
+    mapped_file(const mapped_file &);
+    mapped_file &operator=(const mapped_file &);
+
+    void *base;
+    size_t length;
+};
+
+/**
+ * @fn for_each_line
+ * @brief Walks the line boundaries of 'text' in place and calls 'fn' with a
+ *        view of every non-empty line (a trailing '\r' is dropped).
+ *
+ * @param text - Text to split.
+ * @param fn - Callable taking a 'common::field_view'.
+ *
+ * @return None.
+ */
+template <typename Fn>
+void for_each_line(common::field_view text, Fn fn) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == common::field_view::npos) end = text.size();
+        common::field_view line = text.substr(pos, end - pos);
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line = line.substr(0, line.size() - 1);
+        }
+        if (!line.empty()) {
+            fn(line);
+        }
+        pos = end + 1;
+    }
+}
+
+#endif
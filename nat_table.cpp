@@ -0,0 +1,465 @@
+/**
+ * @file nat_table.cpp
+ * @brief Implementation of the connection-tracking NAT table of the NIC
+ *        simulation project.
+ */
+
+#include "nat_table.hpp"
+#include "flow_stats.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    /* Initial size of the hash indexes, kept at most half full. */
+    const size_t INITIAL_INDEX_SIZE = 1024;
+
+    /* First port handed out when the source port is taken. */
+    const uint32_t FIRST_NAT_PORT = 1024;
+
+    /**
+     * @fn mix
+     * @brief splitmix64 finalizer.
+     */
+    uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+}
+
+namespace common {
+    const size_t nat_table::WHEEL_SLOTS;
+    const size_t nat_table::POOL_WORDS;
+    const uint64_t nat_table::FREE_POOL;
+    const uint32_t nat_table::NONE;
+    const uint32_t nat_table::FREE_CELL;
+
+    nat_table::nat_table(uint64_t timeout) : free_head(NONE), live(0),
+                                             out_index(INITIAL_INDEX_SIZE, NONE),
+                                             in_index(INITIAL_INDEX_SIZE, NONE),
+                                             pool_index(INITIAL_INDEX_SIZE, NONE),
+                                             wheel(WHEEL_SLOTS, NONE), timeout(0),
+                                             granularity(1), now(0), ticks(0) {
+        set_timeout(timeout);
+    }
+
+    void nat_table::set_timeout(uint64_t idle) {
+        if (idle == 0) {
+            idle = 1;
+        }
+        if (idle == timeout) {
+            return;
+        }
+        timeout = idle;
+        granularity = timeout / WHEEL_SLOTS + 1;
+        ticks = now / granularity;
+
+        // Re-bucket every connection for the new granularity
+        std::fill(wheel.begin(), wheel.end(), NONE);
+        for (uint32_t id = 0; id < cells.size(); id++) {
+            if (cells[id].slot != FREE_CELL) {
+                cells[id].slot = NONE;
+                wheel_link(id);
+            }
+        }
+    }
+
+    uint64_t nat_table::out_key_hash(uint32_t local_ip, uint16_t local_port,
+                                     uint32_t remote_ip, uint16_t remote_port) {
+        uint64_t ips = (static_cast<uint64_t>(local_ip) << 32) | remote_ip;
+        uint64_t ports = (static_cast<uint64_t>(local_port) << 16) | remote_port;
+        return mix(ips ^ mix(ports));
+    }
+
+    uint64_t nat_table::in_key_hash(uint32_t remote_ip, uint16_t remote_port,
+                                    uint16_t nat_port) {
+        return mix((static_cast<uint64_t>(remote_ip) << 32) |
+                   (static_cast<uint64_t>(remote_port) << 16) | nat_port);
+    }
+
+    uint64_t nat_table::index_hash(index_kind kind, uint32_t id) const {
+        if (kind == POOL_INDEX) {
+            return mix(pools[id].key);
+        }
+        const nat_entry &e = cells[id].entry;
+        return kind == OUT_INDEX ? out_key_hash(e.local_ip, e.local_port, e.remote_ip, e.remote_port)
+                                 : in_key_hash(e.remote_ip, e.remote_port, e.nat_port);
+    }
+
+    uint32_t nat_table::find_out(uint32_t local_ip, uint16_t local_port,
+                                 uint32_t remote_ip, uint16_t remote_port) {
+        size_t mask = out_index.size() - 1;
+        size_t i = out_key_hash(local_ip, local_port, remote_ip, remote_port) & mask;
+        for (uint32_t id; (id = out_index[i]) != NONE; i = (i + 1) & mask) {
+            const nat_entry &e = cells[id].entry;
+            if (e.local_ip == local_ip && e.local_port == local_port &&
+                e.remote_ip == remote_ip && e.remote_port == remote_port) {
+                // Idle connections are gone even if the wheel didn't get
+                // to them yet
+                if (now - e.last_seen > timeout) {
+                    evict(id);
+                    return NONE;
+                }
+                return id;
+            }
+        }
+        return NONE;
+    }
+
+    uint32_t nat_table::find_in(uint32_t remote_ip, uint16_t remote_port,
+                                uint16_t nat_port) {
+        size_t mask = in_index.size() - 1;
+        size_t i = in_key_hash(remote_ip, remote_port, nat_port) & mask;
+        for (uint32_t id; (id = in_index[i]) != NONE; i = (i + 1) & mask) {
+            const nat_entry &e = cells[id].entry;
+            if (e.remote_ip == remote_ip && e.remote_port == remote_port &&
+                e.nat_port == nat_port) {
+                if (now - e.last_seen > timeout) {
+                    evict(id);
+                    return NONE;
+                }
+                return id;
+            }
+        }
+        return NONE;
+    }
+
+    bool nat_table::port_free(uint32_t remote_ip, uint16_t remote_port,
+                              uint16_t nat_port, const flow_table &open_ports) {
+        // Replies to an open communication are stored, not translated
+        if (open_ports.find(remote_port, nat_port) != -1) {
+            return false;
+        }
+        return find_in(remote_ip, remote_port, nat_port) == NONE;
+    }
+
+    uint64_t nat_table::pool_key(uint32_t remote_ip, uint16_t remote_port, size_t group) {
+        return (static_cast<uint64_t>(remote_ip) << 24) |
+               (static_cast<uint64_t>(remote_port) << 8) | group;
+    }
+
+    uint32_t nat_table::pool_find(uint64_t key) const {
+        size_t mask = pool_index.size() - 1;
+        size_t i = mix(key) & mask;
+        for (uint32_t id; (id = pool_index[i]) != NONE; i = (i + 1) & mask) {
+            if (pools[id].key == key) {
+                return id;
+            }
+        }
+        return NONE;
+    }
+
+    uint32_t nat_table::pool_get(uint64_t key) {
+        uint32_t id = pool_find(key);
+        if (id != NONE) {
+            return id;
+        }
+        // Pools are reused from the free list, there are at most as many as
+        // connections (plus the one being allocated), so the index stays
+        // about as full as the connection indexes
+        if (!free_pools.empty()) {
+            id = free_pools.back();
+            free_pools.pop_back();
+        } else {
+            id = static_cast<uint32_t>(pools.size());
+            pools.push_back(port_pool());
+        }
+        port_pool &pool = pools[id];
+        std::memset(&pool, 0, sizeof(pool));
+        pool.key = key;
+        index_insert(POOL_INDEX, id);
+        return id;
+    }
+
+    void nat_table::pool_drop(uint32_t id) {
+        index_erase(POOL_INDEX, id);
+        pools[id].key = FREE_POOL;
+        free_pools.push_back(id);
+    }
+
+    bool nat_table::pool_alloc(uint32_t remote_ip, uint16_t remote_port, size_t group,
+                               size_t start, const flow_table &open_ports,
+                               uint16_t &port) {
+        uint32_t id = pool_get(pool_key(remote_ip, remote_port, group));
+        port_pool &pool = pools[id];
+        for (;;) {
+            // First slot at or after 'start' that is neither used nor
+            // blocked, the start word is visited again for the wrap around
+            size_t word = start / 64;
+            uint64_t free = ~(pool.used[word] | pool.blocked[word]) &
+                            (~static_cast<uint64_t>(0) << (start % 64));
+            size_t visited = 0;
+            while (free == 0 && visited < POOL_WORDS) {
+                word = (word + 1) % POOL_WORDS;
+                free = ~(pool.used[word] | pool.blocked[word]);
+                visited++;
+            }
+            if (free == 0) {
+                if (pool.connections == 0) {
+                    pool_drop(id);
+                }
+                return false;
+            }
+            size_t slot = word * 64 + static_cast<size_t>(__builtin_ctzll(free));
+
+            // A slot is blocked at most once per pool, so this loops a
+            // bounded amount of times
+            uint16_t candidate = port_of_code(remote_port,
+                                              static_cast<uint32_t>(group << 8 | slot));
+            if (candidate >= FIRST_NAT_PORT &&
+                open_ports.find(remote_port, candidate) == -1) {
+                port = candidate;
+                return true;
+            }
+            pool.blocked[slot / 64] |= static_cast<uint64_t>(1) << (slot % 64);
+        }
+    }
+
+    void nat_table::pool_take(const nat_entry &entry) {
+        uint32_t code = port_pair_code(entry.remote_port, entry.nat_port);
+        port_pool &pool = pools[pool_get(pool_key(entry.remote_ip, entry.remote_port,
+                                                  code >> 8))];
+        size_t slot = code & 0xFF;
+        pool.used[slot / 64] |= static_cast<uint64_t>(1) << (slot % 64);
+        pool.connections++;
+    }
+
+    void nat_table::pool_release(const nat_entry &entry) {
+        uint32_t code = port_pair_code(entry.remote_port, entry.nat_port);
+        uint32_t id = pool_find(pool_key(entry.remote_ip, entry.remote_port, code >> 8));
+        port_pool &pool = pools[id];
+        if (--pool.connections == 0) {
+            pool_drop(id);
+            return;
+        }
+        size_t slot = code & 0xFF;
+        pool.used[slot / 64] &= ~(static_cast<uint64_t>(1) << (slot % 64));
+    }
+
+    bool nat_table::translate_out(uint32_t local_ip, uint16_t local_port,
+                                  uint32_t remote_ip, uint16_t remote_port,
+                                  const flow_table &open_ports, uint16_t &nat_port) {
+        uint32_t id = find_out(local_ip, local_port, remote_ip, remote_port);
+        if (id != NONE) {
+            cells[id].entry.last_seen = now;
+            nat_port = cells[id].entry.nat_port;
+            return true;
+        }
+
+        // Keep the source port if it's free towards the remote endpoint,
+        // otherwise take a free port of the same group from the pool, from
+        // a slot picked by the 5-tuple
+        uint16_t port = local_port;
+        if (!port_free(remote_ip, remote_port, port, open_ports)) {
+            size_t start = static_cast<size_t>(
+                out_key_hash(local_ip, local_port, remote_ip, remote_port) & 0xFF);
+            if (!pool_alloc(remote_ip, remote_port,
+                            port_pair_group(local_port, remote_port), start,
+                            open_ports, port)) {
+                return false;
+            }
+        }
+
+        nat_entry entry;
+        entry.local_ip = local_ip;
+        entry.local_port = local_port;
+        entry.remote_ip = remote_ip;
+        entry.remote_port = remote_port;
+        entry.nat_port = port;
+        entry.last_seen = now;
+        add(entry);
+        count(STAT_NAT_NEW);
+        nat_port = entry.nat_port;
+        return true;
+    }
+
+    bool nat_table::translate_in(uint32_t remote_ip, uint16_t remote_port,
+                                 uint16_t nat_port, uint32_t &local_ip,
+                                 uint16_t &local_port) {
+        uint32_t id = find_in(remote_ip, remote_port, nat_port);
+        if (id == NONE) {
+            return false;
+        }
+        nat_entry &entry = cells[id].entry;
+        entry.last_seen = now;
+        local_ip = entry.local_ip;
+        local_port = entry.local_port;
+        return true;
+    }
+
+    void nat_table::take_all(std::vector<nat_entry> &out) {
+        for (const cell &c : cells) {
+            if (c.slot != FREE_CELL) {
+                out.push_back(c.entry);
+            }
+        }
+        cells.clear();
+        free_head = NONE;
+        live = 0;
+        std::fill(out_index.begin(), out_index.end(), NONE);
+        std::fill(in_index.begin(), in_index.end(), NONE);
+        std::fill(wheel.begin(), wheel.end(), NONE);
+        pools.clear();
+        free_pools.clear();
+        std::fill(pool_index.begin(), pool_index.end(), NONE);
+    }
+
+    void nat_table::insert(const nat_entry &entry) {
+        add(entry);
+    }
+
+    uint32_t nat_table::add(const nat_entry &entry) {
+        if ((live + 1) * 2 > out_index.size()) {
+            grow();
+        }
+
+        uint32_t id;
+        if (free_head != NONE) {
+            id = free_head;
+            free_head = cells[id].next;
+        } else {
+            id = static_cast<uint32_t>(cells.size());
+            cells.push_back(cell());
+        }
+        cells[id].entry = entry;
+        cells[id].slot = NONE;
+        live++;
+
+        index_insert(OUT_INDEX, id);
+        index_insert(IN_INDEX, id);
+        wheel_link(id);
+        pool_take(entry);
+        return id;
+    }
+
+    void nat_table::evict(uint32_t id) {
+        index_erase(OUT_INDEX, id);
+        index_erase(IN_INDEX, id);
+        wheel_unlink(id);
+        pool_release(cells[id].entry);
+        cells[id].slot = FREE_CELL;
+        cells[id].next = free_head;
+        free_head = id;
+        live--;
+        count(STAT_NAT_EVICTED);
+    }
+
+    std::vector<uint32_t> &nat_table::index_of(index_kind kind) {
+        return kind == OUT_INDEX ? out_index : kind == IN_INDEX ? in_index : pool_index;
+    }
+
+    void nat_table::index_insert(index_kind kind, uint32_t id) {
+        std::vector<uint32_t> &index = index_of(kind);
+        size_t mask = index.size() - 1;
+        size_t i = index_hash(kind, id) & mask;
+        while (index[i] != NONE) {
+            i = (i + 1) & mask;
+        }
+        index[i] = id;
+    }
+
+    void nat_table::index_erase(index_kind kind, uint32_t id) {
+        std::vector<uint32_t> &index = index_of(kind);
+        size_t mask = index.size() - 1;
+        size_t hole = index_hash(kind, id) & mask;
+        while (index[hole] != id) {
+            hole = (hole + 1) & mask;
+        }
+
+        // Backward-shift deletion: pull up every following entry whose home
+        // slot is not between the hole and itself, no tombstones needed
+        for (size_t next = (hole + 1) & mask; index[next] != NONE; next = (next + 1) & mask) {
+            size_t home = index_hash(kind, index[next]) & mask;
+            bool stays = hole <= next ? (hole < home && home <= next)
+                                      : (hole < home || home <= next);
+            if (!stays) {
+                index[hole] = index[next];
+                hole = next;
+            }
+        }
+        index[hole] = NONE;
+    }
+
+    void nat_table::grow() {
+        size_t size = out_index.size() * 2;
+        out_index.assign(size, NONE);
+        in_index.assign(size, NONE);
+        pool_index.assign(size, NONE);
+        for (uint32_t id = 0; id < cells.size(); id++) {
+            if (cells[id].slot != FREE_CELL) {
+                index_insert(OUT_INDEX, id);
+                index_insert(IN_INDEX, id);
+            }
+        }
+        for (uint32_t id = 0; id < pools.size(); id++) {
+            if (pools[id].key != FREE_POOL) {
+                index_insert(POOL_INDEX, id);
+            }
+        }
+    }
+
+    void nat_table::wheel_link(uint32_t id) {
+        // The slot right after the connection's expiry tick. A visit a lap
+        // early just links the connection again
+        cell &c = cells[id];
+        uint32_t slot = static_cast<uint32_t>(
+            ((c.entry.last_seen + timeout) / granularity + 1) % WHEEL_SLOTS);
+        c.slot = slot;
+        c.prev = NONE;
+        c.next = wheel[slot];
+        if (c.next != NONE) {
+            cells[c.next].prev = id;
+        }
+        wheel[slot] = id;
+    }
+
+    void nat_table::wheel_unlink(uint32_t id) {
+        cell &c = cells[id];
+        if (c.slot == NONE) {
+            return;
+        }
+        if (c.prev != NONE) {
+            cells[c.prev].next = c.next;
+        } else {
+            wheel[c.slot] = c.next;
+        }
+        if (c.next != NONE) {
+            cells[c.next].prev = c.prev;
+        }
+        c.slot = NONE;
+    }
+
+    void nat_table::wheel_tick(size_t slot) {
+        // Detach the slot first, connections still in use are linked again,
+        // possibly to this same slot for the next lap
+        uint32_t id = wheel[slot];
+        wheel[slot] = NONE;
+        while (id != NONE) {
+            uint32_t next = cells[id].next;
+            cells[id].slot = NONE;
+            if (now - cells[id].entry.last_seen > timeout) {
+                evict(id);
+            } else {
+                wheel_link(id);
+            }
+            id = next;
+        }
+    }
+
+    void nat_table::advance(uint64_t clock) {
+        now = clock;
+        uint64_t target = now / granularity;
+        if (target - ticks >= WHEEL_SLOTS) {
+            // A jump of a whole lap or more visits every slot once
+            for (size_t i = 1; i <= WHEEL_SLOTS; i++) {
+                wheel_tick((ticks + i) % WHEEL_SLOTS);
+            }
+            ticks = target;
+            return;
+        }
+        while (ticks < target) {
+            ticks++;
+            wheel_tick(ticks % WHEEL_SLOTS);
+        }
+    }
+}
@@ -0,0 +1,279 @@
+/**
+ * @file nat_table.hpp
+ * @brief This header defines the connection-tracking NAT table of the NIC
+ *        simulation project.
+ *
+ * Every local source that L3 translates to the NIC's IP gets a connection,
+ * keyed on its 5-tuple (the protocol is implicit, there is only one), and a
+ * NAT port. The source port is kept when it is free towards the same remote
+ * endpoint and another port is allocated otherwise. A port is not free when
+ * another connection uses it towards that endpoint, or when (remote port,
+ * port) is an open communication of the NIC, whose packets belong in LOCAL
+ * DRAM. Replies sent to the NIC's IP and a NAT port are translated back to
+ * the local endpoint.
+ *
+ * A NAT port other than the source port is always taken from the port group
+ * of the connection's own port pair (see 'port_pair_group'), so its replies
+ * hash like the connection does and the table allocates the same ports
+ * whatever the amount of shards. Towards one remote endpoint, every group
+ * has 256 ports, kept in a pool of used and blocked bitmaps: allocating one
+ * is a scan of four words, whatever the amount of connections. A group
+ * holds 256 connections to an endpoint at most, fewer for the ports below
+ * 1024 and the open communications among them.
+ *
+ * Connections are found through two open-addressing hash indexes (outbound
+ * 5-tuple and inbound remote endpoint + NAT port) that grow with the table,
+ * so lookups and inserts stay O(1). Pools live in a free-listed array with
+ * a third such index, so once the table has grown to its working size,
+ * connections come and go without heap allocations. Idle connections are evicted by a
+ * hashed timer wheel driven by the packet clock of the flow: a connection
+ * is idle once 'timeout' packets of the trace went by without it.
+ */
+
+#ifndef __NAT_TABLE__
+#define __NAT_TABLE__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.hpp"
+
+namespace common {
+    /* Amount of port groups, the most shards a flow can use. */
+    const size_t PORT_GROUPS = 256;
+
+    /* Odd multiplier of 'port_pair_code' and its inverse modulo 2^16. */
+    const uint32_t PORT_PAIR_MUL = 0x9E37;
+    const uint32_t PORT_PAIR_INV = 0x7787;
+
+    /**
+     * @fn port_pair_code
+     * @brief Mixes a port pair into 16 bits, the same way in both directions.
+     *        For a fixed port it is a bijection of the other one, see
+     *        'port_of_code'.
+     */
+    inline uint32_t port_pair_code(uint16_t port_a, uint16_t port_b) {
+        return (static_cast<uint32_t>(port_a ^ port_b) * PORT_PAIR_MUL) & 0xFFFF;
+    }
+
+    /**
+     * @fn port_of_code
+     * @brief The port whose pair with 'port' has the code 'code'.
+     */
+    inline uint16_t port_of_code(uint16_t port, uint32_t code) {
+        return static_cast<uint16_t>(((code * PORT_PAIR_INV) & 0xFFFF) ^ port);
+    }
+
+    /**
+     * @fn port_pair_group
+     * @brief Maps a port pair to one of PORT_GROUPS groups, the same way in
+     *        both directions: the top byte of its code.
+     */
+    inline size_t port_pair_group(uint16_t port_a, uint16_t port_b) {
+        return static_cast<size_t>(port_pair_code(port_a, port_b) >> 8);
+    }
+
+    /**
+     * @fn port_pair_shard
+     * @brief Maps a port pair to one of 'shards' shards, so a flow and its
+     *        replies meet on one shard.
+     */
+    inline size_t port_pair_shard(uint16_t port_a, uint16_t port_b, size_t shards) {
+        return port_pair_group(port_a, port_b) % shards;
+    }
+
+    /**
+     * @brief A tracked connection.
+     * @param local_ip, local_port - Endpoint behind the NAT.
+     * @param remote_ip, remote_port - Endpoint outside.
+     * @param nat_port - Source port of the connection outside.
+     * @param last_seen - Packet clock of the last packet of the connection.
+     */
+    struct nat_entry {
+        uint32_t local_ip;
+        uint32_t remote_ip;
+        uint16_t local_port;
+        uint16_t remote_port;
+        uint16_t nat_port;
+        uint64_t last_seen;
+    };
+
+    class nat_table {
+        public:
+        /**
+         * @fn nat_table
+         * @brief Constructor of the class, creates an empty table.
+         *
+         * @param timeout - Idle packets after which a connection is evicted.
+         */
+        explicit nat_table(uint64_t timeout = 65536);
+
+        /**
+         * @fn set_timeout
+         * @brief Changes the idle timeout of all connections.
+         *
+         * @return None.
+         */
+        void set_timeout(uint64_t timeout);
+
+        /**
+         * @fn advance
+         * @brief Moves the packet clock forward and evicts the connections
+         *        that became idle.
+         *
+         * @param now - Packet clock, never smaller than in the previous call.
+         *
+         * @return None.
+         */
+        void advance(uint64_t now);
+
+        /**
+         * @fn translate_out
+         * @brief Finds or creates the connection of an outbound packet.
+         *
+         * @param [in] local_ip, local_port - Source of the packet.
+         * @param [in] remote_ip, remote_port - Destination of the packet.
+         * @param [in] open_ports - Open communications of the NIC, never
+         *             handed out as NAT ports.
+         * @param [out] nat_port - Source port to send the packet with.
+         *
+         * @return true on success, false if no NAT port is free.
+         */
+        bool translate_out(uint32_t local_ip, uint16_t local_port,
+                           uint32_t remote_ip, uint16_t remote_port,
+                           const flow_table &open_ports, uint16_t &nat_port);
+
+        /**
+         * @fn translate_in
+         * @brief Finds the connection of a packet sent to the NIC's IP.
+         *
+         * @param [in] remote_ip, remote_port - Source of the packet.
+         * @param [in] nat_port - Destination port of the packet.
+         * @param [out] local_ip, local_port - Endpoint to deliver to.
+         *
+         * @return true if the packet belongs to a connection, false otherwise.
+         */
+        bool translate_in(uint32_t remote_ip, uint16_t remote_port,
+                          uint16_t nat_port, uint32_t &local_ip,
+                          uint16_t &local_port);
+
+        /**
+         * @fn take_all
+         * @brief Moves all live connections to 'out' and empties the table.
+         *
+         * @return None.
+         */
+        void take_all(std::vector<nat_entry> &out);
+
+        /**
+         * @fn insert
+         * @brief Adds a connection taken from another table.
+         *
+         * @return None.
+         */
+        void insert(const nat_entry &entry);
+
+        size_t size() const { return live; }
+        uint64_t idle_timeout() const { return timeout; }
+
+        private:
+        /* Slots of the timer wheel. */
+        static const size_t WHEEL_SLOTS = 1024;
+        /* End of a list, empty index cell, or a cell out of the wheel. */
+        static const uint32_t NONE = 0xFFFFFFFFu;
+        /* 'slot' of a cell on the free list. */
+        static const uint32_t FREE_CELL = 0xFFFFFFFEu;
+
+        /* Ports of a pool, one bit each. */
+        static const size_t POOL_WORDS = 4;
+        /* 'key' of a pool on the free list, wider than any 'pool_key'. */
+        static const uint64_t FREE_POOL = ~static_cast<uint64_t>(0);
+
+        /**
+         * @brief NAT ports of one remote endpoint and port group. Slot k is
+         *        the port whose pair with the remote port has the code
+         *        (group << 8 | k).
+         * @param key - Remote endpoint and group, see 'pool_key'.
+         * @param used - Slots that are the NAT port of a connection.
+         * @param blocked - Slots found below the NAT port range or colliding
+         *        with an open communication, never allocated.
+         * @param connections - Amount of 'used' slots, the pool is dropped
+         *        when it reaches 0.
+         */
+        struct port_pool {
+            uint64_t key;
+            uint64_t used[POOL_WORDS];
+            uint64_t blocked[POOL_WORDS];
+            uint32_t connections;
+        };
+
+        /**
+         * @brief A pool cell: a connection and its timer wheel links.
+         * @param next, prev - Neighbours in the wheel slot (or free list).
+         * @param slot - Wheel slot of the cell, NONE or FREE_CELL.
+         */
+        struct cell {
+            nat_entry entry;
+            uint32_t next;
+            uint32_t prev;
+            uint32_t slot;
+        };
+
+        static uint64_t out_key_hash(uint32_t local_ip, uint16_t local_port,
+                                     uint32_t remote_ip, uint16_t remote_port);
+        static uint64_t in_key_hash(uint32_t remote_ip, uint16_t remote_port,
+                                    uint16_t nat_port);
+
+        uint32_t find_out(uint32_t local_ip, uint16_t local_port,
+                          uint32_t remote_ip, uint16_t remote_port);
+        uint32_t find_in(uint32_t remote_ip, uint16_t remote_port,
+                         uint16_t nat_port);
+        bool port_free(uint32_t remote_ip, uint16_t remote_port,
+                       uint16_t nat_port, const flow_table &open_ports);
+
+        /* Hash indexes of the table, see 'index_insert'. */
+        enum index_kind {
+            OUT_INDEX,      /* Connections by outbound 5-tuple. */
+            IN_INDEX,       /* Connections by remote endpoint and NAT port. */
+            POOL_INDEX      /* Pools by remote endpoint and group. */
+        };
+
+        static uint64_t pool_key(uint32_t remote_ip, uint16_t remote_port, size_t group);
+        uint32_t pool_find(uint64_t key) const;
+        uint32_t pool_get(uint64_t key);
+        void pool_drop(uint32_t pool);
+        bool pool_alloc(uint32_t remote_ip, uint16_t remote_port, size_t group,
+                        size_t start, const flow_table &open_ports, uint16_t &port);
+        void pool_take(const nat_entry &entry);
+        void pool_release(const nat_entry &entry);
+
+        uint32_t add(const nat_entry &entry);
+        void evict(uint32_t id);
+        uint64_t index_hash(index_kind kind, uint32_t id) const;
+        std::vector<uint32_t> &index_of(index_kind kind);
+        void index_insert(index_kind kind, uint32_t id);
+        void index_erase(index_kind kind, uint32_t id);
+        void grow();
+
+        void wheel_link(uint32_t id);
+        void wheel_unlink(uint32_t id);
+        void wheel_tick(size_t slot);
+
+        std::vector<cell> cells;
+        uint32_t free_head;
+        size_t live;
+        std::vector<uint32_t> out_index;
+        std::vector<uint32_t> in_index;
+        std::vector<port_pool> pools;
+        std::vector<uint32_t> free_pools;
+        std::vector<uint32_t> pool_index;
+
+        std::vector<uint32_t> wheel;
+        uint64_t timeout;
+        uint64_t granularity;
+        uint64_t now;
+        uint64_t ticks;
+    };
+}
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * @file packet_queue.cpp
+ * @brief Implementation of the RQ/TQ storage of the NIC simulation project.
+ */
+
+#include "packet_queue.hpp"
+#include <cstring>
+
+namespace {
+    /**
+     * @fn pack_ip
+     * @brief Packs an IP address into a uint32, first octet in the high byte.
+     */
+    uint32_t pack_ip(const uint8_t ip[common::IP_V4_SIZE]) {
+        return (static_cast<uint32_t>(ip[0]) << 24) |
+               (static_cast<uint32_t>(ip[1]) << 16) |
+               (static_cast<uint32_t>(ip[2]) << 8) |
+               static_cast<uint32_t>(ip[3]);
+    }
+
+    /**
+     * @fn put_ip
+     * @brief Writes a packed IP address in dotted decimal.
+     */
+    void put_ip(result_writer &out, uint32_t ip) {
+        out.put_uint(ip >> 24);
+        out.put('.');
+        out.put_uint((ip >> 16) & 0xFF);
+        out.put('.');
+        out.put_uint((ip >> 8) & 0xFF);
+        out.put('.');
+        out.put_uint(ip & 0xFF);
+    }
+}
+
+namespace common {
+    void packet_queue::push(const packet_record &rec) {
+        queue_entry entry;
+        entry.src_ip = pack_ip(rec.src_ip);
+        entry.dst_ip = pack_ip(rec.dst_ip);
+        entry.checksum = rec.l3_checksum;
+        entry.src_port = rec.src_port;
+        entry.dst_port = rec.dst_port;
+        entry.index = rec.index;
+        entry.ttl = rec.ttl;
+        if (!rec.l4_canonical) {
+            // Forwarded as it came, the text goes to the spill pool
+            entry.payload_len = 0;
+            entry.verbatim = 1;
+            entry.text_len = static_cast<uint32_t>(rec.l4_text.size());
+            push_entry(entry, reinterpret_cast<const uint8_t *>(rec.l4_text.ptr));
+            return;
+        }
+        entry.payload_len = static_cast<uint8_t>(rec.payload_len);
+        entry.verbatim = 0;
+        entry.text_len = 0;
+        size_t inline_len = (rec.payload_len < PACKET_DATA_SIZE) ?
+                            static_cast<size_t>(rec.payload_len) : PACKET_DATA_SIZE;
+        std::memcpy(entry.payload, rec.payload, inline_len);
+        push_entry(entry, rec.payload + PACKET_DATA_SIZE);
+    }
+
+    void packet_queue::push_from(const packet_queue &other, size_t i) {
+        const queue_entry &entry = other.entries[i];
+        const uint8_t *tail = spill_size(entry) > 0 ? &other.spill[entry.spill] : nullptr;
+        push_entry(entry, tail);
+    }
+
+    size_t packet_queue::spill_size(const queue_entry &entry) {
+        if (entry.verbatim) {
+            return entry.text_len;
+        }
+        return entry.payload_len > PACKET_DATA_SIZE ?
+               static_cast<size_t>(entry.payload_len - PACKET_DATA_SIZE) : 0;
+    }
+
+    void packet_queue::push_entry(const queue_entry &entry, const uint8_t *tail) {
+        entries.push_back(entry);
+        size_t size = spill_size(entry);
+        if (size > 0) {
+            // Long payloads and original texts live in the spill pool
+            entries.back().spill = static_cast<uint32_t>(spill.size());
+            spill.insert(spill.end(), tail, tail + size);
+        }
+    }
+
+    void packet_queue::write(size_t i, result_writer &out) const {
+        // Format: src_ip|dst_ip|ttl|checksum|src_port|dst_port|index|data
+        const queue_entry &entry = entries[i];
+        put_ip(out, entry.src_ip);
+        out.put('|');
+        put_ip(out, entry.dst_ip);
+        out.put('|');
+        out.put_uint(entry.ttl);
+        out.put('|');
+        out.put_uint(entry.checksum);
+        out.put('|');
+        out.put_uint(entry.src_port);
+        out.put('|');
+        out.put_uint(entry.dst_port);
+        out.put('|');
+        if (entry.verbatim) {
+            out.put(reinterpret_cast<const char *>(spill.data() + entry.spill),
+                    entry.text_len);
+            return;
+        }
+        out.put_uint(entry.index);
+        out.put('|');
+        if (entry.payload_len <= PACKET_DATA_SIZE) {
+            out.put_hex_bytes(entry.payload, entry.payload_len);
+            return;
+        }
+        out.put_hex_bytes(entry.payload, PACKET_DATA_SIZE);
+        out.put(' ');
+        out.put_hex_bytes(&spill[entry.spill], entry.payload_len - PACKET_DATA_SIZE);
+    }
+
+    void packet_queue::clear() {
+        entries.clear();
+        spill.clear();
+    }
+}
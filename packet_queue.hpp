@@ -0,0 +1,107 @@
+/**
+ * @file packet_queue.hpp
+ * @brief This header defines the storage of the NIC's RQ and TQ.
+ *
+ * Queued packets are kept as compact fixed-size binary entries and are only
+ * turned into text when the queue is printed. A payload longer than
+ * PACKET_DATA_SIZE bytes keeps its first bytes in the entry and the rest in
+ * a side pool of the queue. A packet whose "index|data" text isn't what
+ * formatting its fields gives back keeps that text in the side pool
+ * instead, and is printed with it.
+ */
+
+#ifndef __PACKET_QUEUE__
+#define __PACKET_QUEUE__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.hpp"
+#include "result_writer.hpp"
+
+namespace common {
+    /**
+     * @brief A queued L3 packet.
+     * @param src_ip, dst_ip - IP addresses, first octet in the high byte.
+     * @param checksum - L3 checksum.
+     * @param src_port, dst_port, index - L4 header.
+     * @param ttl - Time to live.
+     * @param payload_len - Amount of payload bytes.
+     * @param verbatim - Whether the packet is printed with its original
+     *        "index|data" text rather than 'index' and 'payload'.
+     * @param payload - First PACKET_DATA_SIZE payload bytes.
+     * @param spill - Offset of the remaining payload bytes, or of the
+     *        original text, in the queue's spill pool. Unused if
+     *        'payload_len' <= PACKET_DATA_SIZE and the entry isn't verbatim.
+     * @param text_len - Length of the original text of a verbatim entry.
+     */
+    struct queue_entry {
+        uint32_t src_ip;
+        uint32_t dst_ip;
+        uint16_t checksum;
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint16_t index;
+        uint8_t ttl;
+        uint8_t payload_len;
+        uint8_t verbatim;
+        uint8_t payload[PACKET_DATA_SIZE];
+        uint32_t spill;
+        uint32_t text_len;
+    };
+
+    class packet_queue {
+        public:
+        /**
+         * @fn push
+         * @brief Adds a packet at the end of the queue.
+         *
+         * @param rec - The packet, after processing.
+         *
+         * @return None.
+         */
+        void push(const packet_record &rec);
+
+        /**
+         * @fn push_from
+         * @brief Adds an entry of another queue at the end of the queue.
+         *
+         * @param other - Queue holding the entry.
+         * @param i - Index of the entry in 'other'.
+         *
+         * @return None.
+         */
+        void push_from(const packet_queue &other, size_t i);
+
+        /**
+         * @fn write
+         * @brief Formats an entry the way l3_packet::as_string does.
+         *
+         * @param i - Index of the entry.
+         * @param out - Writer to format into.
+         *
+         * @return None.
+         */
+        void write(size_t i, result_writer &out) const;
+
+        size_t size() const { return entries.size(); }
+        bool empty() const { return entries.empty(); }
+
+        /**
+         * @fn clear
+         * @brief Removes all entries, keeping the allocated memory.
+         */
+        void clear();
+
+        private:
+        void push_entry(const queue_entry &entry, const uint8_t *tail);
+
+        /* Amount of bytes an entry keeps in the spill pool. */
+        static size_t spill_size(const queue_entry &entry);
+
+        std::vector<queue_entry> entries;
+        std::vector<uint8_t> spill;
+    };
+}
+
+#endif
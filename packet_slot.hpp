@@ -0,0 +1,256 @@
+/**
+ * @file packet_slot.hpp
+ * @brief This header defines a reusable, statically dispatched storage for a
+ *        single packet of any layer.
+ *
+ * A 'packet_slot' is a tagged union of l2_packet, l3_packet and l4_packet.
+ * The flow keeps one slot per thread and builds every packet in it with
+ * placement new, so handling a packet doesn't touch the heap. Calls are
+ * dispatched on the tag to the concrete class, never through the vtable.
+ */
+
+#ifndef __PACKET_SLOT__
+#define __PACKET_SLOT__
+
+#include <new>
+#include <type_traits>
+#include "L2.h"
+#include "L3.h"
+#include "L4.h"
+
+class packet_slot {
+    public:
+    /**
+     * @fn packet_slot
+     * @brief Constructor of the class, creates an empty slot.
+     */
+    packet_slot() : layer(LAYER_AUTO) {}
+
+    /**
+     * @fn emplace
+     * @brief Builds a packet of the given layer in the slot, destroying the
+     *        previous one.
+     *
+     * @param packet_layer - Layer of the packet, must not be LAYER_AUTO.
+     * @param packet_str - String representation of the packet.
+     * @param checksum - Whether validate_packet checks the checksums.
+     * @param routes - Routing table of the NIC, for L2/L3 packets.
+     * @param nat - Connection tracking of the NIC, for L2/L3 packets.
+     *
+     * @return None.
+     */
+    void emplace(packet_layer packet_layer, field_view packet_str,
+                 checksum_mode checksum, const route_table *routes,
+                 nat_table *nat) {
+        reset();
+        switch (packet_layer) {
+            case LAYER_L2:
+                new (&storage) l2_packet(packet_str, checksum, routes, nat);
+                break;
+            case LAYER_L3:
+                new (&storage) l3_packet(packet_str, checksum, routes, nat);
+                break;
+            case LAYER_L4:
+                new (&storage) l4_packet(packet_str);
+                break;
+            case LAYER_AUTO:
+                return;
+        }
+        layer = packet_layer;
+    }
+
+    /**
+     * @fn emplace_parsed
+     * @brief Same as 'emplace', for a packet parsed ahead of time.
+     *
+     * @param rec - The packet's record, nullptr if it didn't parse. Its
+     *        text views must point into 'packet_str'.
+     *
+     * @return None.
+     */
+    void emplace_parsed(packet_layer packet_layer, field_view packet_str,
+                        const packet_record *rec, checksum_mode checksum,
+                        const route_table *routes, nat_table *nat) {
+        reset();
+        switch (packet_layer) {
+            case LAYER_L2:
+                new (&storage) l2_packet(packet_str, rec, checksum, routes, nat);
+                break;
+            case LAYER_L3:
+                new (&storage) l3_packet(packet_str, rec, checksum, routes, nat);
+                break;
+            case LAYER_L4:
+                new (&storage) l4_packet(packet_str, rec);
+                break;
+            case LAYER_AUTO:
+                return;
+        }
+        layer = packet_layer;
+    }
+
+    /**
+     * @fn reset
+     * @brief Destroys the packet held by the slot, if any.
+     */
+    void reset() {
+        switch (layer) {
+            case LAYER_L2:
+                as<l2_packet>().~l2_packet();
+                break;
+            case LAYER_L3:
+                as<l3_packet>().~l3_packet();
+                break;
+            case LAYER_L4:
+                as<l4_packet>().~l4_packet();
+                break;
+            case LAYER_AUTO:
+                break;
+        }
+        layer = LAYER_AUTO;
+    }
+
+    bool empty() const { return layer == LAYER_AUTO; }
+    packet_layer held_layer() const { return layer; }
+
+    /**
+     * @fn validate_packet
+     * @brief generic_packet::validate_packet of the held packet.
+     */
+    bool validate_packet(const open_port_vec &open_ports,
+                         uint8_t ip[IP_V4_SIZE],
+                         uint8_t mask,
+                         uint8_t mac[MAC_SIZE]) {
+        switch (layer) {
+            case LAYER_L2:
+                return as<l2_packet>().l2_packet::validate_packet(open_ports, ip, mask, mac);
+            case LAYER_L3:
+                return as<l3_packet>().l3_packet::validate_packet(open_ports, ip, mask, mac);
+            case LAYER_L4:
+                return as<l4_packet>().l4_packet::validate_packet(open_ports, ip, mask, mac);
+            case LAYER_AUTO:
+                break;
+        }
+        return false;
+    }
+
+    /**
+     * @fn proccess_packet
+     * @brief generic_packet::proccess_packet of the held packet.
+     */
+    bool proccess_packet(open_port_vec &open_ports,
+                         uint8_t ip[IP_V4_SIZE],
+                         memory_dest &dst) {
+        switch (layer) {
+            case LAYER_L2:
+                return as<l2_packet>().l2_packet::proccess_packet(open_ports, ip, dst);
+            case LAYER_L3:
+                return as<l3_packet>().l3_packet::proccess_packet(open_ports, ip, dst);
+            case LAYER_L4:
+                return as<l4_packet>().l4_packet::proccess_packet(open_ports, ip, dst);
+            case LAYER_AUTO:
+                break;
+        }
+        return false;
+    }
+
+    /**
+     * @fn as_string
+     * @brief generic_packet::as_string of the held packet.
+     */
+    bool as_string(std::string &packet) {
+        switch (layer) {
+            case LAYER_L2:
+                return as<l2_packet>().l2_packet::as_string(packet);
+            case LAYER_L3:
+                return as<l3_packet>().l3_packet::as_string(packet);
+            case LAYER_L4:
+                return as<l4_packet>().l4_packet::as_string(packet);
+            case LAYER_AUTO:
+                break;
+        }
+        return false;
+    }
+
+    /**
+     * @fn queued_record
+     * @brief Record of the held packet as stored in RQ/TQ.
+     *
+     * @return The record of an L2/L3 packet, nullptr for L4 packets (they
+     *         are never queued) or an empty slot.
+     */
+    const packet_record *queued_record() {
+        switch (layer) {
+            case LAYER_L2:
+                return as<l2_packet>().queued_record();
+            case LAYER_L3:
+                return as<l3_packet>().queued_record();
+            case LAYER_L4:
+            case LAYER_AUTO:
+                break;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @fn parsed_record
+     * @brief Record of the held packet before it is processed, for the ACL.
+     *
+     * @return The record, nullptr if the packet wasn't parsed or the slot
+     *         is empty.
+     */
+    const packet_record *parsed_record() {
+        switch (layer) {
+            case LAYER_L2:
+                return as<l2_packet>().queued_record();
+            case LAYER_L3:
+                return as<l3_packet>().queued_record();
+            case LAYER_L4:
+                return as<l4_packet>().parsed_record();
+            case LAYER_AUTO:
+                break;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @fn batch_record
+     * @brief Record of the held L2/L3 packet, processed in place by
+     *        nic_sim::process_batch.
+     *
+     * @return The record, nullptr for L4 packets or if the packet wasn't
+     *         parsed.
+     */
+    packet_record *batch_record() {
+        switch (layer) {
+            case LAYER_L2:
+                return as<l2_packet>().batch_record();
+            case LAYER_L3:
+                return as<l3_packet>().batch_record();
+            case LAYER_L4:
+            case LAYER_AUTO:
+                break;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @fn ~packet_slot
+     * @brief Destructor of the class.
+     *
+     * @return None.
+     */
+    ~packet_slot() { reset(); }
+
+    private:
+    /* The slot holds a live object at a fixed address, it can't be copied. */
+    packet_slot(const packet_slot &);
+    packet_slot &operator=(const packet_slot &);
+
+    template <typename T>
+    T &as() { return *reinterpret_cast<T *>(&storage); }
+
+    std::aligned_union<0, l2_packet, l3_packet, l4_packet>::type storage;
+    packet_layer layer;
+};
+
+#endif
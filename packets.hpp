@@ -16,6 +16,7 @@
 #include <string>
 #include <cstdint>
 #include "common.hpp"
+#include "parse.hpp"
 
 using namespace common;
 
@@ -25,7 +26,7 @@ class generic_packet {
      * @fn validate_packet
      * @brief Check whether the packet is valid.
      *
-     * @param [in] open_ports - Vector containing all the NIC's open ports.
+     * @param [in] open_ports - Flow table of all the NIC's open ports.
      * @param [in] ip - NIC's IP address.
      * @param [in] mask - NIC's mask; together with the IP,
      *               determines the NIC's local net.
@@ -34,7 +35,7 @@ class generic_packet {
      * @return true if the packet is valid and ready for processing.
      *         false if the packet isn't valid and should be discarded.
      */
-    virtual bool validate_packet(open_port_vec open_ports,
+    virtual bool validate_packet(const open_port_vec &open_ports,
                                 uint8_t ip[IP_V4_SIZE],
                                 uint8_t mask,
                                 uint8_t mac[MAC_SIZE]) = 0;
@@ -45,10 +46,8 @@ class generic_packet {
      *        stored in. In the case of local DRAM, the function will store
      *        the packet as a string in the relevant 'open_port' struct.
      *
-     * @param [in] open_ports - Vector containing all the NIC's open ports.
+     * @param [in] open_ports - Flow table of all the NIC's open ports.
      * @param [in] ip - NIC's IP address.
-     * @param [in] mask - NIC's mask; together with the IP, determines the NIC's
-     *        local net.
      * @param [out] dst - Reference to enum that indicate the memory space where
      *        the packet should be stored:
      *         LOCAL_DRAM - the function stored it to the currect struct.
@@ -59,7 +58,6 @@ class generic_packet {
      */
     virtual bool proccess_packet(open_port_vec &open_ports,
                                 uint8_t ip[IP_V4_SIZE],
-                                uint8_t mask,
                                 memory_dest &dst) = 0;
 
     /**
@@ -83,14 +81,14 @@ class generic_packet {
     protected:
     /**
      * @fn extract_between_delimiters
-     * @brief Extracts a substring between two delimiters in a string.
+     * @brief Extracts a view of the text between two delimiters in a string.
      * 
-     * This function extracts the substring starting immediately after the
+     * This function extracts the range starting immediately after the
      * delimiter at start_index and ending just before the delimiter at end_index.
      * If end_index is -1, it extracts until the end of the string. if start_index
      * is 0 it extract from the beginning of the string.
      * 
-     * @param input The input string to extract substring from.
+     * @param input The input text to extract the range from.
      * @param delimiter The character used as delimiter in the string.
      * @param start_index The index (1-based) of the delimiter after which
      *                    extraction begins.
@@ -99,33 +97,31 @@ class generic_packet {
      *                  0) of the delimiter before which extraction ends.
      *                  If -1, extracts until the end of the string.
      * 
-     * @return Substring starting after the delimiter at start_index and 
-     *         ending just before the delimiter at end_index or end of string if end_index is -1.
-     *         Returns an empty string if indices are invalid.
+     * @return View starting after the delimiter at start_index and ending just
+     *         before the delimiter at end_index or end of string if end_index
+     *         is -1. Returns an empty view if indices are invalid.
+     *
+     * @note The returned view points into 'input', nothing is copied.
      */
-    static std::string extract_between_delimiters(const std::string& input,
+    static field_view extract_between_delimiters(field_view input,
                                         char delimiter,
                                         int start_index,
                                         int end_index = -1)
     {
-        std::vector<size_t> positions;
-        size_t pos = input.find(delimiter);
-        size_t start = 0;
+        size_t start = 0, pos = 0;
+        int passed = 0;
 
-        /* Create position vector. */
-        while (pos != std::string::npos) {
-            positions.push_back(pos);
-            pos = input.find(delimiter, pos + 1);
+        /* Check indices. */
+        if (start_index < 0 || (end_index != -1 && end_index < start_index)) {
+            return field_view();
         }
 
-        /* Check start index. */
-        if (start_index < 0 || start_index > static_cast<int>(positions.size())) {
-            return "";
-        }
-
-        if (start_index > 0) {
-            if (start_index > positions.size()) return ""; // invalid
-            start = positions[start_index - 1] + 1;
+        /* Skip to the delimiter at start_index. */
+        while (passed < start_index) {
+            pos = input.find(delimiter, pos);
+            if (pos == field_view::npos) return field_view(); // invalid
+            start = ++pos;
+            ++passed;
         }
 
         /* Extract everything after start delimiter to end of string. */
@@ -133,14 +129,16 @@ class generic_packet {
             return input.substr(start);
         }
 
-        /* Validate end_index. */
-        if (end_index < start_index || end_index >= static_cast<int>(positions.size())) {
-            return "";
+        /* Walk to the delimiter at end_index. */
+        while ((pos = input.find(delimiter, pos)) != field_view::npos) {
+            if (passed == end_index) {
+                return input.substr(start, pos - start);
+            }
+            ++pos;
+            ++passed;
         }
 
-        size_t len = positions[end_index] - start;
-
-        return input.substr(start, len);
+        return field_view();
     }
 };
 #endif
\ No newline at end of file
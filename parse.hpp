@@ -0,0 +1,265 @@
+/**
+ * @file parse.hpp
+ * @brief This header defines the zero-copy parsing helpers shared by all
+ *        packet layers of the NIC simulation project.
+ *
+ * A 'field_view' is a non-owning window into a packet line, the tokenizer
+ * walks a line and hands out views of its fields, and the number parsers
+ * report errors through a return value instead of throwing. Nothing in this
+ * file allocates.
+ */
+
+#ifndef __PARSE__
+#define __PARSE__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace common {
+    /**
+     * @brief Non-owning view of a character range (pointer + length).
+     *
+     * @note The view is only valid while the underlying buffer is alive.
+     */
+    struct field_view {
+        static const size_t npos = static_cast<size_t>(-1);
+
+        const char *ptr;
+        size_t len;
+
+        field_view() : ptr(nullptr), len(0) {}
+        field_view(const char *p, size_t n) : ptr(p), len(n) {}
+        field_view(const std::string &str) : ptr(str.data()), len(str.size()) {}
+
+        const char *begin() const { return ptr; }
+        const char *end() const { return ptr + len; }
+        size_t size() const { return len; }
+        bool empty() const { return len == 0; }
+        char operator[](size_t i) const { return ptr[i]; }
+
+        /**
+         * @fn find
+         * @brief Finds the first occurrence of 'c' at or after 'from'.
+         *
+         * @return Position of the character, or npos if not found.
+         */
+        size_t find(char c, size_t from = 0) const {
+            if (from >= len) return npos;
+            const void *hit = std::memchr(ptr + from, c, len - from);
+            return hit ? static_cast<size_t>(static_cast<const char *>(hit) - ptr) : npos;
+        }
+
+        /**
+         * @fn rfind
+         * @brief Finds the last occurrence of 'c' in the view.
+         *
+         * @return Position of the character, or npos if not found.
+         */
+        size_t rfind(char c) const {
+            for (size_t i = len; i > 0; --i) {
+                if (ptr[i - 1] == c) return i - 1;
+            }
+            return npos;
+        }
+
+        /**
+         * @fn substr
+         * @brief Returns the view [pos, pos + n), clamped to the view's end.
+         */
+        field_view substr(size_t pos, size_t n = npos) const {
+            if (pos > len) pos = len;
+            if (n > len - pos) n = len - pos;
+            return field_view(ptr + pos, n);
+        }
+
+        /**
+         * @fn str
+         * @brief Copies the view into an owning string (for cold paths only).
+         */
+        std::string str() const { return std::string(ptr, len); }
+    };
+
+    /**
+     * @brief Splits a line into delimiter-separated fields without copying.
+     *
+     * Every call to 'next' returns the field up to the next delimiter, the
+     * last field runs to the end of the input.
+     */
+    class field_tokenizer {
+        public:
+        field_tokenizer(field_view input, char delimiter)
+            : cur(input.ptr), stop(input.ptr + input.len), delim(delimiter),
+              exhausted(input.ptr == nullptr) {}
+
+        /**
+         * @fn next
+         * @brief Extracts the next field.
+         *
+         * @param [out] field - View of the next field.
+         *
+         * @return true if a field was extracted, false if the input is exhausted.
+         */
+        bool next(field_view &field) {
+            if (exhausted) return false;
+            const char *hit = static_cast<const char *>(
+                std::memchr(cur, delim, static_cast<size_t>(stop - cur)));
+            if (hit == nullptr) {
+                field = field_view(cur, static_cast<size_t>(stop - cur));
+                cur = stop;
+                exhausted = true;
+                return true;
+            }
+            field = field_view(cur, static_cast<size_t>(hit - cur));
+            cur = hit + 1;
+            return true;
+        }
+
+        /**
+         * @fn done
+         * @brief Checks whether the last field (no delimiter after it) was taken.
+         */
+        bool done() const { return exhausted; }
+
+        /**
+         * @fn rest
+         * @brief Returns everything that was not consumed yet.
+         */
+        field_view rest() const {
+            return exhausted ? field_view(stop, 0)
+                             : field_view(cur, static_cast<size_t>(stop - cur));
+        }
+
+        private:
+        const char *cur;
+        const char *stop;
+        char delim;
+        bool exhausted;
+    };
+
+    /* Result of the non-throwing number parsers. */
+    enum parse_status {
+        PARSE_OK = 0,
+        PARSE_EMPTY,
+        PARSE_INVALID,
+        PARSE_OVERFLOW
+    };
+
+    /**
+     * @fn hex_digit_value
+     * @brief Converts a single hex character to its value.
+     *
+     * @return Value 0-15, or -1 if 'c' is not a hex digit.
+     */
+    inline int hex_digit_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    /**
+     * @fn parse_uint
+     * @brief Parses the whole field as an unsigned number.
+     *
+     * The field is optional leading whitespace, an optional '+' and at least
+     * one digit, as std::stoi read it before. Unlike std::stoi, a '-' sign,
+     * a "0x" prefix, trailing characters and values above 'max' are
+     * rejected instead of being truncated or wrapped.
+     *
+     * @param [in] field - Text to parse.
+     * @param [in] max - Largest accepted value.
+     * @param [out] out - Parsed value, untouched on failure.
+     * @param [in] base - 10 or 16.
+     *
+     * @return PARSE_OK on success, otherwise the reason of the failure.
+     */
+    inline parse_status parse_uint(field_view field, uint32_t max,
+                                   uint32_t &out, int base = 10) {
+        if (field.empty()) return PARSE_EMPTY;
+        size_t i = 0;
+        while (i < field.len && (field.ptr[i] == ' ' ||
+                                 (field.ptr[i] >= '\t' && field.ptr[i] <= '\r'))) {
+            ++i;
+        }
+        if (i < field.len && field.ptr[i] == '+') ++i;
+        if (i == field.len) return PARSE_INVALID;
+        uint64_t value = 0;
+        for (; i < field.len; ++i) {
+            int digit = hex_digit_value(field.ptr[i]);
+            if (digit < 0 || digit >= base) return PARSE_INVALID;
+            value = value * static_cast<uint64_t>(base) + static_cast<uint64_t>(digit);
+            if (value > max) return PARSE_OVERFLOW;
+        }
+        out = static_cast<uint32_t>(value);
+        return PARSE_OK;
+    }
+
+    /**
+     * @fn parse_u8
+     * @brief parse_uint wrapper for 8-bit fields.
+     */
+    inline parse_status parse_u8(field_view field, uint8_t &out, int base = 10) {
+        uint32_t value = 0;
+        parse_status status = parse_uint(field, 0xFF, value, base);
+        if (status == PARSE_OK) out = static_cast<uint8_t>(value);
+        return status;
+    }
+
+    /**
+     * @fn parse_u16
+     * @brief parse_uint wrapper for 16-bit fields.
+     */
+    inline parse_status parse_u16(field_view field, uint16_t &out, int base = 10) {
+        uint32_t value = 0;
+        parse_status status = parse_uint(field, 0xFFFF, value, base);
+        if (status == PARSE_OK) out = static_cast<uint16_t>(value);
+        return status;
+    }
+
+    /**
+     * @fn append_uint
+     * @brief Appends an unsigned number in decimal, the counterpart of
+     *        parse_uint. Doesn't allocate if 'out' has enough capacity.
+     *
+     * @return None.
+     */
+    inline void append_uint(std::string &out, uint32_t value) {
+        char digits[10];
+        int len = 0;
+        do {
+            digits[len++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (len > 0) {
+            out += digits[--len];
+        }
+    }
+
+    /**
+     * @fn parse_address
+     * @brief Parses 'count' delimiter-separated bytes (IP or MAC address).
+     *
+     * @param [in] field - Address text, e.g "192.168.1.1" or "01:02:03:04:05:06".
+     * @param [in] delimiter - '.' for IP, ':' for MAC.
+     * @param [in] base - 10 for IP, 16 for MAC.
+     * @param [out] out - Array of 'count' bytes.
+     * @param [in] count - Amount of address elements.
+     *
+     * @return PARSE_OK on success, otherwise the reason of the failure.
+     */
+    inline parse_status parse_address(field_view field, char delimiter, int base,
+                                      uint8_t *out, int count) {
+        field_tokenizer parts(field, delimiter);
+        field_view part;
+        for (int i = 0; i < count; ++i) {
+            if (!parts.next(part)) return PARSE_INVALID;
+            parse_status status = parse_u8(part, out[i], base);
+            if (status != PARSE_OK) return status;
+        }
+        return parts.next(part) ? PARSE_INVALID : PARSE_OK;
+    }
+}
+
+#endif
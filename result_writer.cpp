@@ -0,0 +1,128 @@
+/**
+ * @file result_writer.cpp
+ * @brief Implementation of the buffered result writer for the NIC simulation
+ *        project.
+ */
+
+#include "result_writer.hpp"
+#include <cerrno>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+namespace {
+    /* Size of the output buffer, one write per this many bytes. */
+    const size_t BUFFER_SIZE = 1 << 20;
+
+    /**
+     * @brief Table mapping every byte to its 2-digit lowercase hex form.
+     */
+    struct hex_table {
+        char digits[256][2];
+
+        hex_table() {
+            static const char hex[] = "0123456789abcdef";
+            for (int i = 0; i < 256; i++) {
+                digits[i][0] = hex[i >> 4];
+                digits[i][1] = hex[i & 0x0F];
+            }
+        }
+    };
+
+    const hex_table hex_bytes;
+}
+
+result_writer::result_writer(int fd) : storage(BUFFER_SIZE),
+                                       buffer(&storage[0]),
+                                       capacity(BUFFER_SIZE),
+                                       used(0),
+                                       fd(fd),
+                                       owns_fd(false),
+                                       failed(false) {
+}
+
+result_writer::result_writer(const std::string &path) : storage(BUFFER_SIZE),
+                                                        buffer(&storage[0]),
+                                                        capacity(BUFFER_SIZE),
+                                                        used(0),
+                                                        fd(-1),
+                                                        owns_fd(true),
+                                                        failed(false) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+void result_writer::put_uint(uint32_t value) {
+    char digits[10];
+    int len = 0;
+    do {
+        digits[len++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    if (static_cast<size_t>(len) > capacity - used) flush();
+    while (len > 0) {
+        buffer[used++] = digits[--len];
+    }
+}
+
+void result_writer::put_hex_bytes(const uint8_t *bytes, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    // Every byte is written as "xx ", the last space is dropped at the end
+    while (count > 0) {
+        size_t room = (capacity - used) / 3;
+        if (room == 0) {
+            flush();
+            room = capacity / 3;
+        }
+        size_t n = (count < room) ? count : room;
+        char *out = buffer + used;
+        for (size_t i = 0; i < n; i++) {
+            out[0] = hex_bytes.digits[bytes[i]][0];
+            out[1] = hex_bytes.digits[bytes[i]][1];
+            out[2] = ' ';
+            out += 3;
+        }
+        used += n * 3;
+        bytes += n;
+        count -= n;
+    }
+    used--;
+}
+
+bool result_writer::write_all(const char *text, size_t len) {
+    if (fd < 0 || failed) {
+        return false;
+    }
+    while (len > 0) {
+        long written = static_cast<long>(write(fd, text, static_cast<unsigned>(len)));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            failed = true;
+            return false;
+        }
+        text += written;
+        len -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool result_writer::flush() {
+    bool ok = write_all(buffer, used);
+    used = 0;
+    return ok;
+}
+
+result_writer::~result_writer() {
+    flush();
+    if (owns_fd && fd >= 0) {
+        close(fd);
+    }
+}
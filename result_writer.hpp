@@ -0,0 +1,117 @@
+/**
+ * @file result_writer.hpp
+ * @brief This header defines the buffered writer used to dump the NIC's
+ *        memory spaces.
+ *
+ * The writer formats into a large buffer and hands it to the OS in a few big
+ * writes. Data bytes are formatted through a precomputed byte -> "xx" table,
+ * so dumping LOCAL DRAM doesn't go through stream manipulators per byte.
+ */
+
+#ifndef __RESULT_WRITER__
+#define __RESULT_WRITER__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class result_writer {
+    public:
+    /**
+     * @fn result_writer
+     * @brief Constructor of the class, writes to an already open descriptor.
+     *
+     * @param fd - File descriptor to write to (e.g 1 for stdout). It is not
+     *        closed by the writer.
+     *
+     * @return New writer object.
+     */
+    explicit result_writer(int fd);
+
+    /**
+     * @fn result_writer
+     * @brief Constructor of the class, creates (or truncates) a file.
+     *
+     * @param path - File to write to.
+     *
+     * @return New writer object, check 'is_open' before use.
+     */
+    explicit result_writer(const std::string &path);
+
+    /**
+     * @fn is_open
+     * @brief Checks whether the writer has a valid target.
+     */
+    bool is_open() const { return fd >= 0; }
+
+    /**
+     * @fn put
+     * @brief Appends raw text.
+     */
+    void put(const char *text, size_t len) {
+        if (len > capacity - used) {
+            flush();
+            if (len > capacity) {
+                write_all(text, len);
+                return;
+            }
+        }
+        for (size_t i = 0; i < len; i++) {
+            buffer[used + i] = text[i];
+        }
+        used += len;
+    }
+    void put(const std::string &text) { put(text.data(), text.size()); }
+    void put(char c) {
+        if (used == capacity) flush();
+        buffer[used++] = c;
+    }
+
+    /**
+     * @fn put_uint
+     * @brief Appends an unsigned number in decimal.
+     */
+    void put_uint(uint32_t value);
+
+    /**
+     * @fn put_hex_bytes
+     * @brief Appends bytes as 2-digit lowercase hex numbers separated by
+     *        single spaces ("08 c9 3a").
+     */
+    void put_hex_bytes(const uint8_t *bytes, size_t count);
+
+    /**
+     * @fn flush
+     * @brief Writes the buffered text to the target.
+     *
+     * @return true if everything was written, false on an I/O error.
+     */
+    bool flush();
+
+    /**
+     * @fn ~result_writer
+     * @brief Destructor of the class, flushes the buffer and closes the file
+     *        if the writer opened it.
+     *
+     * @return None.
+     */
+    ~result_writer();
+
+    private:
+    /* Writers own a buffer and maybe a descriptor, copying them makes no sense. */
+    result_writer(const result_writer &);
+    result_writer &operator=(const result_writer &);
+
+    bool write_all(const char *text, size_t len);
+
+    std::vector<char> storage;
+    char *buffer;
+    size_t capacity;
+    size_t used;
+    int fd;
+    bool owns_fd;
+    bool failed;
+};
+
+#endif
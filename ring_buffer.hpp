@@ -0,0 +1,131 @@
+/**
+ * @file ring_buffer.hpp
+ * @brief This header defines the fixed-capacity lock-free ring used for the
+ *        NIC's RQ and TQ.
+ *
+ * 'spsc_ring' serves a single producer and a single consumer. It holds a
+ * power of two amount of items, never allocates after construction, and
+ * reports a full or empty ring through the return value instead of waiting.
+ */
+
+#ifndef __RING_BUFFER__
+#define __RING_BUFFER__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/* Size used to keep producer and consumer indices on separate cache lines. */
+#define RING_CACHE_LINE 64
+
+/**
+ * @fn ring_capacity
+ * @brief Rounds a requested ring depth up to a power of two (at least 2).
+ */
+inline size_t ring_capacity(size_t depth) {
+    size_t capacity = 2;
+    while (capacity < depth) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+template <typename T>
+class spsc_ring {
+    public:
+    /**
+     * @fn spsc_ring
+     * @brief Constructor of the class.
+     *
+     * @param depth - Requested capacity, rounded up to a power of two.
+     */
+    explicit spsc_ring(size_t depth)
+        : cells(new T[ring_capacity(depth)]), mask(ring_capacity(depth) - 1),
+          tail(0), head_cache(0), head(0), tail_cache(0) {}
+
+    size_t capacity() const { return mask + 1; }
+
+    /**
+     * @fn try_push
+     * @brief Moves 'item' into the ring. Producer thread only.
+     *
+     * @return true on success, false if the ring is full ('item' is kept).
+     */
+    bool try_push(T &item) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        if (pos - head_cache > mask) {
+            head_cache = head.load(std::memory_order_acquire);
+            if (pos - head_cache > mask) {
+                return false;
+            }
+        }
+        cells[pos & mask] = std::move(item);
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @fn try_pop
+     * @brief Moves the oldest item out of the ring. Consumer thread only.
+     *
+     * @return true on success, false if the ring is empty.
+     */
+    bool try_pop(T &item) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        if (pos == tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (pos == tail_cache) {
+                return false;
+            }
+        }
+        item = std::move(cells[pos & mask]);
+        head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @fn front
+     * @brief Returns the oldest item, left in the ring. Consumer thread only.
+     *
+     * @return The item, nullptr if the ring is empty.
+     */
+    T *front() {
+        size_t pos = head.load(std::memory_order_relaxed);
+        if (pos == tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (pos == tail_cache) {
+                return nullptr;
+            }
+        }
+        return &cells[pos & mask];
+    }
+
+    /**
+     * @fn pop_front
+     * @brief Frees the item 'front' returned. Consumer thread only.
+     *
+     * @return None.
+     */
+    void pop_front() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    private:
+    std::unique_ptr<T[]> cells;
+    size_t mask;
+
+    // Producer side: written index and last seen consumer index
+    char pad0[RING_CACHE_LINE];
+    std::atomic<size_t> tail;
+    size_t head_cache;
+
+    // Consumer side: read index and last seen producer index
+    char pad1[RING_CACHE_LINE];
+    std::atomic<size_t> head;
+    size_t tail_cache;
+    char pad2[RING_CACHE_LINE];
+};
+
+#endif
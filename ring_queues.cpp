@@ -0,0 +1,171 @@
+/**
+ * @file ring_queues.cpp
+ * @brief Implementation of the RQ/TQ descriptor rings of the NIC simulation
+ *        project.
+ */
+
+#include "ring_queues.hpp"
+#include "flow_trace.hpp"
+#include <cstring>
+
+namespace {
+    /**
+     * @fn queue_index
+     * @brief Index of the RQ/TQ ring in the ring arrays.
+     */
+    size_t queue_index(common::memory_dest queue) {
+        return queue == common::RQ ? 0 : 1;
+    }
+}
+
+const uint64_t queue_rings::NO_FLOOR;
+const size_t queue_rings::TEXT_SIZE;
+
+queue_rings::queue_rings(size_t depth, common::ring_policy policy,
+                         size_t producers, size_t floors,
+                         common::packet_queue &rq, common::packet_queue &tq)
+    : policy(policy), floors(new std::atomic<uint64_t>[floors]),
+      floor_count(floors), producers_done(false) {
+    for (size_t q = 0; q < 2; q++) {
+        for (size_t p = 0; p < producers; p++) {
+            rings[q].push_back(std::unique_ptr<entry_ring>(new entry_ring(depth)));
+        }
+    }
+    for (size_t i = 0; i < floors; i++) {
+        this->floors[i].store(0, std::memory_order_relaxed);
+    }
+    host[0] = &rq;
+    host[1] = &tq;
+    drainer = std::thread(&queue_rings::drain, this);
+}
+
+queue_rings::~queue_rings() {
+    finish();
+}
+
+bool queue_rings::push(size_t producer, common::memory_dest queue, uint64_t seq,
+                       const common::packet_record &rec) {
+    NIC_TRACE_SCOPE("ring.push");
+    size_t q = queue_index(queue);
+    entry_ring &ring = *rings[q][producer];
+    ring_entry entry;
+    entry.seq = seq;
+    entry.record = rec;
+    if (!rec.l4_canonical) {
+        entry.text_len = rec.l4_text.len;
+        char *text = entry.text;
+        if (entry.text_len > TEXT_SIZE) {
+            entry.long_text.reset(new char[entry.text_len]);
+            text = entry.long_text.get();
+        }
+        std::memcpy(text, rec.l4_text.ptr, entry.text_len);
+    }
+
+    if (ring.try_push(entry)) {
+        return true;
+    }
+
+    shared_counters &counters = stats[q];
+    counters.full.fetch_add(1, std::memory_order_relaxed);
+    if (policy == common::RING_DROP) {
+        counters.dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Block until the drain thread makes room
+    NIC_TRACE_SCOPE("ring.full");
+    while (!ring.try_push(entry)) {
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void queue_rings::deliver(size_t queue, entry_ring &ring, ring_entry &entry) {
+    if (!entry.record.l4_canonical) {
+        const char *text = entry.long_text ? entry.long_text.get() : entry.text;
+        entry.record.l4_text = common::field_view(text, entry.text_len);
+    }
+    host[queue]->push(entry.record);
+    entry.long_text.reset();
+    ring.pop_front();
+}
+
+bool queue_rings::merge(size_t queue, uint64_t floor) {
+    std::vector<std::unique_ptr<entry_ring> > &producers = rings[queue];
+    bool delivered = false;
+    for (;;) {
+        // Every ring is in trace order, the smallest head is the next packet
+        // once nothing below it can still be pushed
+        entry_ring *best = nullptr;
+        ring_entry *best_entry = nullptr;
+        for (size_t p = 0; p < producers.size(); p++) {
+            ring_entry *entry = producers[p]->front();
+            if (entry != nullptr && (best_entry == nullptr || entry->seq < best_entry->seq)) {
+                best = producers[p].get();
+                best_entry = entry;
+            }
+        }
+        if (best_entry == nullptr || best_entry->seq >= floor) {
+            return delivered;
+        }
+        deliver(queue, *best, *best_entry);
+        delivered = true;
+    }
+}
+
+uint64_t queue_rings::lowest_floor() const {
+    uint64_t lowest = NO_FLOOR;
+    for (size_t i = 0; i < floor_count; i++) {
+        uint64_t floor = floors[i].load(std::memory_order_acquire);
+        if (floor < lowest) {
+            lowest = floor;
+        }
+    }
+    return lowest;
+}
+
+void queue_rings::drain() {
+    NIC_TRACE_THREAD("ring drain");
+    for (;;) {
+        // Read the flag first, so a ring seen empty after it was set is
+        // empty for good. The floors are read before the rings for the same
+        // reason: the pushes they account for are already visible
+        bool done = producers_done.load(std::memory_order_acquire);
+        bool drained = false;
+        for (size_t q = 0; q < 2; q++) {
+            if (rings[q].size() == 1) {
+                // A single producer pushes in order
+                entry_ring &ring = *rings[q][0];
+                ring_entry *entry;
+                while ((entry = ring.front()) != nullptr) {
+                    deliver(q, ring, *entry);
+                    drained = true;
+                }
+            } else {
+                drained |= merge(q, done ? NO_FLOOR : lowest_floor());
+            }
+        }
+        if (!drained) {
+            if (done) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+void queue_rings::finish() {
+    if (!drainer.joinable()) {
+        return;
+    }
+    producers_done.store(true, std::memory_order_release);
+    drainer.join();
+}
+
+ring_counters queue_rings::counters(common::memory_dest queue) const {
+    const shared_counters &source = stats[queue_index(queue)];
+    ring_counters result;
+    result.full = source.full.load(std::memory_order_relaxed);
+    result.dropped = source.dropped.load(std::memory_order_relaxed);
+    return result;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file ring_queues.hpp
+ * @brief This header defines the NIC's RQ and TQ descriptor rings and the
+ *        thread draining them into host memory.
+ *
+ * Every producer has its own SPSC ring per queue and pushes in trace order.
+ * With several producers the drain thread merges their rings by trace
+ * position as it goes: it delivers the smallest queued position once it is
+ * below every floor, a lower bound on the positions still to be pushed that
+ * the flow publishes. Memory stays bounded by the rings and packets reach
+ * host memory during the flow, not at its end.
+ */
+
+#ifndef __RING_QUEUES__
+#define __RING_QUEUES__
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "common.hpp"
+#include "packet_queue.hpp"
+#include "ring_buffer.hpp"
+
+/**
+ * @brief Counters of a single ring.
+ * @param full - Pushes that found the ring full.
+ * @param dropped - Packets dropped because the ring was full (RING_DROP).
+ */
+struct ring_counters {
+    uint64_t full;
+    uint64_t dropped;
+
+    ring_counters() : full(0), dropped(0) {}
+};
+
+class queue_rings {
+    public:
+    /**
+     * @fn queue_rings
+     * @brief Constructor of the class, creates the RQ and TQ rings and starts
+     *        the drain thread.
+     *
+     * @param depth - Capacity of each ring, rounded up to a power of two.
+     * @param policy - What 'push' does when a ring is full.
+     * @param producers - Amount of threads calling 'push', each with its
+     *        own rings.
+     * @param floors - Amount of floor slots, see 'set_floor'. Unused with a
+     *        single producer, whose rings are delivered as they come.
+     * @param rq, tq - Host memory the drained packets are appended to, in
+     *        order. Must not be touched until 'finish' returns.
+     */
+    queue_rings(size_t depth, common::ring_policy policy, size_t producers,
+                size_t floors, common::packet_queue &rq, common::packet_queue &tq);
+
+    /**
+     * @fn push
+     * @brief Queues a processed packet to RQ or TQ.
+     *
+     * @param producer - Index of the calling producer.
+     * @param queue - common::RQ or common::TQ.
+     * @param seq - Position of the packet in the trace, increasing for every
+     *        producer. The drained packets are ordered by it.
+     * @param rec - The packet, copied.
+     *
+     * @return true if the packet was queued, false if it was dropped.
+     */
+    bool push(size_t producer, common::memory_dest queue, uint64_t seq,
+              const common::packet_record &rec);
+
+    /**
+     * @fn set_floor
+     * @brief Publishes that no push still to come, of the producer or part
+     *        of the trace the slot stands for, has a position below 'seq'.
+     *        Every slot starts at 0, so nothing is delivered until all of
+     *        them are published. Must follow the pushes it accounts for.
+     *
+     * @param slot - Index of the slot.
+     * @param seq - The bound, NO_FLOOR once the slot has nothing left.
+     *
+     * @return None.
+     */
+    void set_floor(size_t slot, uint64_t seq) {
+        floors[slot].store(seq, std::memory_order_release);
+    }
+
+    /* Floor of a slot that won't push anything anymore. */
+    static const uint64_t NO_FLOOR = ~0ull;
+
+    /**
+     * @fn finish
+     * @brief Drains what is left and stops the drain thread. Called once
+     *        all producers are done.
+     *
+     * @return None.
+     */
+    void finish();
+
+    /**
+     * @fn counters
+     * @brief Returns the counters of the RQ or TQ ring.
+     */
+    ring_counters counters(common::memory_dest queue) const;
+
+    /**
+     * @fn ~queue_rings
+     * @brief Destructor of the class, calls 'finish'.
+     */
+    ~queue_rings();
+
+    private:
+    /* Longest "index|data" text a ring entry holds inline. */
+    static const size_t TEXT_SIZE = 256;
+
+    /**
+     * @brief A ring item.
+     * @param text, text_len - Copy of the "index|data" text of a record that
+     *        isn't canonical, the line it points into may be gone once
+     *        drained.
+     * @param long_text - Copy of a text longer than TEXT_SIZE, only a payload
+     *        past DATA_ARR_SIZE bytes or far off the canonical layout needs
+     *        it.
+     */
+    struct ring_entry {
+        uint64_t seq;
+        common::packet_record record;
+        size_t text_len;
+        char text[TEXT_SIZE];
+        std::unique_ptr<char[]> long_text;
+
+        ring_entry() : seq(0), text_len(0) {}
+    };
+
+    /**
+     * @brief Atomic form of 'ring_counters', producers share it.
+     */
+    struct shared_counters {
+        std::atomic<uint64_t> full;
+        std::atomic<uint64_t> dropped;
+
+        shared_counters() : full(0), dropped(0) {}
+    };
+
+    typedef spsc_ring<ring_entry> entry_ring;
+
+    /**
+     * @fn deliver
+     * @brief Appends the oldest entry of a ring to the host memory of
+     *        'queue' and frees it.
+     */
+    void deliver(size_t queue, entry_ring &ring, ring_entry &entry);
+
+    /**
+     * @fn merge
+     * @brief Delivers the entries of 'queue' below 'floor' in trace order.
+     *
+     * @return true if anything was delivered.
+     */
+    bool merge(size_t queue, uint64_t floor);
+
+    /**
+     * @fn lowest_floor
+     * @brief The smallest published floor.
+     */
+    uint64_t lowest_floor() const;
+
+    void drain();
+
+    /**
+     * @param policy - What 'push' does when a ring is full.
+     * @param rings - RQ (index 0) and TQ (index 1) rings of every producer.
+     * @param floors, floor_count - Floor slots, see 'set_floor'.
+     * @param stats - RQ and TQ counters.
+     * @param host - Host memory of RQ and TQ.
+     * @param producers_done - Set by 'finish', the drain thread exits once
+     *        the rings are empty.
+     * @param drainer - The drain thread.
+     */
+    common::ring_policy policy;
+    std::vector<std::unique_ptr<entry_ring> > rings[2];
+    std::unique_ptr<std::atomic<uint64_t>[]> floors;
+    size_t floor_count;
+    shared_counters stats[2];
+    common::packet_queue *host[2];
+    std::atomic<bool> producers_done;
+    std::thread drainer;
+};
+
+#endif
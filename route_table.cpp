@@ -0,0 +1,133 @@
+/**
+ * @file route_table.cpp
+ * @brief Implementation of the longest-prefix-match routing table of the NIC
+ *        simulation project.
+ */
+
+#include "route_table.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    /**
+     * @fn prefix_mask
+     * @brief Network mask of a prefix length, 0 to 32.
+     */
+    uint32_t prefix_mask(int len) {
+        return len == 0 ? 0 : ~static_cast<uint32_t>(0) << (32 - len);
+    }
+
+    /**
+     * @fn skip_spaces
+     * @brief Drops the leading spaces of a view.
+     */
+    common::field_view skip_spaces(common::field_view text) {
+        size_t i = 0;
+        while (i < text.size() && text[i] == ' ') {
+            i++;
+        }
+        return text.substr(i);
+    }
+}
+
+namespace common {
+    route_table::route_table()
+        : local_prefix(0), local_mask(~static_cast<uint32_t>(0)), top(1 << 16, ROUTE_TQ) {}
+
+    void route_table::add(uint32_t prefix, int len, route_action action) {
+        route declared;
+        declared.prefix = prefix & prefix_mask(len);
+        declared.len = len;
+        declared.action = action;
+        routes.push_back(declared);
+    }
+
+    void route_table::set_local(uint32_t prefix, int len) {
+        local_mask = prefix_mask(len);
+        local_prefix = prefix & local_mask;
+    }
+
+    size_t route_table::expand(uint32_t &entry) {
+        if (entry & NEXT_CHUNK) {
+            return static_cast<size_t>(entry & ~NEXT_CHUNK) << 8;
+        }
+        size_t first = chunks.size();
+        chunks.resize(first + 256, entry);
+        entry = NEXT_CHUNK | static_cast<uint32_t>(first >> 8);
+        return first;
+    }
+
+    void route_table::compile() {
+        std::fill(top.begin(), top.end(), static_cast<uint32_t>(ROUTE_TQ));
+        chunks.clear();
+
+        // Shorter prefixes first, so every route overwrites the shorter ones
+        // it is nested in and leaves expanded only where longer ones follow.
+        // Equal prefixes keep their declaration order, the last one wins
+        std::vector<route> ordered(routes);
+        std::stable_sort(ordered.begin(), ordered.end(),
+                         [](const route &a, const route &b) { return a.len < b.len; });
+
+        for (const route &r : ordered) {
+            uint32_t action = static_cast<uint32_t>(r.action);
+            if (r.len <= 16) {
+                size_t first = r.prefix >> 16;
+                std::fill(top.begin() + first, top.begin() + first + (size_t(1) << (16 - r.len)),
+                          action);
+            } else if (r.len <= 24) {
+                size_t chunk = expand(top[r.prefix >> 16]);
+                size_t first = chunk + ((r.prefix >> 8) & 0xFF);
+                std::fill(chunks.begin() + first,
+                          chunks.begin() + first + (size_t(1) << (24 - r.len)), action);
+            } else {
+                size_t middle = expand(top[r.prefix >> 16]) + ((r.prefix >> 8) & 0xFF);
+                // 'expand' may grow 'chunks', take the entry by value
+                uint32_t entry = chunks[middle];
+                size_t chunk = expand(entry);
+                chunks[middle] = entry;
+                size_t first = chunk + (r.prefix & 0xFF);
+                std::fill(chunks.begin() + first,
+                          chunks.begin() + first + (size_t(1) << (32 - r.len)), action);
+            }
+        }
+    }
+
+    bool route_table::parse_route(field_view text, uint32_t &prefix, int &len,
+                                  route_action &action) {
+        // Format: <a.b.c.d>/<len> <action>
+        text = skip_spaces(text);
+        size_t slash = text.find('/');
+        size_t space = text.find(' ');
+        if (slash == field_view::npos || space == field_view::npos || space < slash) {
+            return false;
+        }
+
+        uint8_t addr[IP_V4_SIZE];
+        uint32_t parsed_len = 0;
+        if (parse_address(text.substr(0, slash), '.', 10, addr, IP_V4_SIZE) != PARSE_OK ||
+            parse_uint(text.substr(slash + 1, space - slash - 1), 32, parsed_len) != PARSE_OK) {
+            return false;
+        }
+
+        field_view name = skip_spaces(text.substr(space));
+        while (!name.empty() && (name[name.size() - 1] == ' ' || name[name.size() - 1] == '\r')) {
+            name = name.substr(0, name.size() - 1);
+        }
+        static const struct {
+            const char *name;
+            route_action action;
+        } ACTIONS[] = {
+            {"RQ", ROUTE_RQ}, {"TQ", ROUTE_TQ}, {"NAT", ROUTE_NAT}, {"DROP", ROUTE_DROP}
+        };
+        for (const auto &known : ACTIONS) {
+            if (name.size() == std::strlen(known.name) &&
+                std::memcmp(name.ptr, known.name, name.size()) == 0) {
+                prefix = ip_to_u32(addr);
+                len = static_cast<int>(parsed_len);
+                action = known.action;
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,161 @@
+/**
+ * @file route_table.hpp
+ * @brief This header defines the longest-prefix-match routing table of the
+ *        NIC simulation project.
+ *
+ * Routes are IPv4 prefixes with an action, declared in the param file as
+ * "route: <a.b.c.d>/<len> <RQ|TQ|NAT|DROP>". They are compiled into a
+ * DIR-16-8-8 table over uint32 addresses: a 65536-entry first level indexed
+ * by the top 16 bits, and 256-entry chunks for the next 8 and last 8 bits,
+ * only where a longer prefix needs them. A lookup is one memory access for
+ * addresses covered by /16 or shorter routes, two up to /24 and three for
+ * longer ones, whatever the amount of routes.
+ *
+ * Routes only decide by the destination. A NAT route translates sources in
+ * the NIC's own subnet (its ip/mask line), including hosts that a longer
+ * route sends elsewhere, and no other sources.
+ */
+
+#ifndef __ROUTE_TABLE__
+#define __ROUTE_TABLE__
+
+#include <cstdint>
+#include <vector>
+#include "common.hpp"
+
+namespace common {
+    /* What L3 does with a packet, by its destination address. */
+    enum route_action {
+        ROUTE_RQ = 0,   /* Local network, to RQ. */
+        ROUTE_TQ,       /* Forward to TQ as is. */
+        ROUTE_NAT,      /* Forward to TQ, translating local sources. */
+        ROUTE_DROP      /* Drop the packet. */
+    };
+
+    /**
+     * @fn ip_to_u32
+     * @brief Packs an IP address into a uint32, first byte highest.
+     */
+    inline uint32_t ip_to_u32(const uint8_t ip[IP_V4_SIZE]) {
+        return (static_cast<uint32_t>(ip[0]) << 24) | (static_cast<uint32_t>(ip[1]) << 16) |
+               (static_cast<uint32_t>(ip[2]) << 8) | ip[3];
+    }
+
+    /**
+     * @fn u32_to_ip
+     * @brief Unpacks an IP address packed by 'ip_to_u32'.
+     */
+    inline void u32_to_ip(uint32_t addr, uint8_t ip[IP_V4_SIZE]) {
+        for (int i = 0; i < IP_V4_SIZE; i++) {
+            ip[i] = static_cast<uint8_t>(addr >> (24 - 8 * i));
+        }
+    }
+
+    class route_table {
+        public:
+        /**
+         * @fn route_table
+         * @brief Constructor of the class, creates a table routing every
+         *        address to ROUTE_TQ.
+         */
+        route_table();
+
+        /**
+         * @fn add
+         * @brief Declares a route, effective after 'compile'. A route of a
+         *        prefix that was already declared replaces it.
+         *
+         * @param prefix - Network address, host bits are ignored.
+         * @param len - Prefix length, 0 to 32.
+         * @param action - Action of the addresses in the prefix.
+         *
+         * @return None.
+         */
+        void add(uint32_t prefix, int len, route_action action);
+
+        /**
+         * @fn set_local
+         * @brief Sets the NIC's own subnet, whose sources ROUTE_NAT
+         *        translates. Routes declared inside it don't change it.
+         *
+         * @param prefix - NIC's IP, host bits are ignored.
+         * @param len - NIC's mask, 0 to 32.
+         *
+         * @return None.
+         */
+        void set_local(uint32_t prefix, int len);
+
+        /**
+         * @fn is_local
+         * @brief Whether 'addr' is in the NIC's own subnet.
+         */
+        bool is_local(uint32_t addr) const {
+            return (addr & local_mask) == local_prefix;
+        }
+
+        /**
+         * @fn compile
+         * @brief Rebuilds the lookup tables from all declared routes.
+         *
+         * @return None.
+         */
+        void compile();
+
+        /**
+         * @fn lookup
+         * @brief Finds the action of the longest prefix matching 'addr'.
+         *
+         * @return The action, ROUTE_TQ if no route matches.
+         */
+        route_action lookup(uint32_t addr) const {
+            uint32_t entry = top[addr >> 16];
+            if (entry & NEXT_CHUNK) {
+                entry = chunks[((entry & ~NEXT_CHUNK) << 8) | ((addr >> 8) & 0xFF)];
+                if (entry & NEXT_CHUNK) {
+                    entry = chunks[((entry & ~NEXT_CHUNK) << 8) | (addr & 0xFF)];
+                }
+            }
+            return static_cast<route_action>(entry);
+        }
+
+        /**
+         * @fn parse_route
+         * @brief Parses the text after "route:" of a param file line,
+         *        e.g " 10.0.0.0/8 NAT".
+         *
+         * @param [in] text - Text to parse.
+         * @param [out] prefix, len, action - The route.
+         *
+         * @return true on success, false if the text is not a valid route.
+         */
+        static bool parse_route(field_view text, uint32_t &prefix, int &len,
+                                route_action &action);
+
+        private:
+        /* Set in an entry that holds the index of a chunk, not an action. */
+        static const uint32_t NEXT_CHUNK = 0x80000000u;
+
+        struct route {
+            uint32_t prefix;
+            int len;
+            route_action action;
+        };
+
+        /**
+         * @fn expand
+         * @brief Makes 'entry' point to a chunk, filled with its action if
+         *        it held one.
+         *
+         * @return Index of the first entry of the chunk in 'chunks'.
+         */
+        size_t expand(uint32_t &entry);
+
+        std::vector<route> routes;
+        uint32_t local_prefix;
+        uint32_t local_mask;
+        std::vector<uint32_t> top;
+        std::vector<uint32_t> chunks;
+    };
+}
+
+#endif
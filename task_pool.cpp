@@ -0,0 +1,126 @@
+/**
+ * @file task_pool.cpp
+ * @brief Implementation of the work-stealing thread pool of the NIC
+ *        simulation project.
+ */
+
+#include "task_pool.hpp"
+#include "flow_trace.hpp"
+
+namespace {
+    /* Pool and deque of the calling thread, nullptr outside the workers. */
+    thread_local const task_pool *current_pool = nullptr;
+    thread_local size_t current_worker = 0;
+}
+
+task_pool::task_pool(unsigned workers) : next_deque(0), queued(0),
+                                         unfinished(0), stopping(false) {
+    if (workers == 0) {
+        workers = std::thread::hardware_concurrency();
+        if (workers == 0) {
+            workers = 1;
+        }
+    }
+    for (unsigned i = 0; i < workers; i++) {
+        deques.push_back(std::unique_ptr<task_deque>(new task_deque()));
+    }
+    for (unsigned i = 0; i < workers; i++) {
+        this->workers.push_back(std::thread(&task_pool::run_worker, this, i));
+    }
+}
+
+task_pool::~task_pool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void task_pool::submit(std::function<void()> task) {
+    // Counted before it is visible, so a worker never sees more tasks than
+    // 'queued' says
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+        unfinished++;
+    }
+    size_t target = current_pool == this
+                  ? current_worker
+                  : next_deque.fetch_add(1, std::memory_order_relaxed) % deques.size();
+    {
+        std::lock_guard<std::mutex> lock(deques[target]->mutex);
+        deques[target]->tasks.push_back(std::move(task));
+    }
+    work_ready.notify_one();
+}
+
+void task_pool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (unfinished > 0) {
+        all_done.wait(lock);
+    }
+}
+
+bool task_pool::take(size_t self, std::function<void()> &task) {
+    // Own deque newest first, it is the warmest in cache
+    {
+        task_deque &own = *deques[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest task of the next worker that has one
+    for (size_t i = 1; i < deques.size(); i++) {
+        task_deque &victim = *deques[(self + i) % deques.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void task_pool::run_worker(size_t self) {
+    current_pool = this;
+    current_worker = self;
+    NIC_TRACE_THREAD("pool");
+
+    std::function<void()> task;
+    for (;;) {
+        if (take(self, task)) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queued--;
+            }
+            task();
+            task = nullptr;
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--unfinished == 0) {
+                all_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (queued == 0 && !stopping) {
+            work_ready.wait(lock);
+        }
+        if (queued == 0) {
+            return;
+        }
+        // A task is counted but not pushed yet
+        lock.unlock();
+        std::this_thread::yield();
+    }
+}
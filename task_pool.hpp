@@ -0,0 +1,114 @@
+/**
+ * @file task_pool.hpp
+ * @brief This header defines the work-stealing thread pool of the NIC
+ *        simulation project.
+ *
+ * Every worker owns a deque of tasks. A worker runs the newest task of its
+ * own deque first, and once it is empty steals the oldest task of another
+ * worker, so a worker that finished its small tasks picks up work queued
+ * behind a large one instead of sitting idle. Tasks submitted by a task go
+ * to the deque of the worker running it, tasks submitted from outside the
+ * pool are spread round-robin.
+ */
+
+#ifndef __TASK_POOL__
+#define __TASK_POOL__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class task_pool {
+    public:
+    /**
+     * @fn task_pool
+     * @brief Constructor of the class, starts the workers.
+     *
+     * @param workers - Amount of worker threads, 0 for one per hardware
+     *        thread.
+     */
+    explicit task_pool(unsigned workers);
+
+    /**
+     * @fn submit
+     * @brief Queues a task to run on one of the workers.
+     *
+     * @param task - The task, may submit more tasks.
+     *
+     * @return None.
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * @fn wait
+     * @brief Waits until every submitted task, and every task they
+     *        submitted, has run. Must not be called from a task.
+     *
+     * @return None.
+     */
+    void wait();
+
+    /* Amount of worker threads. */
+    size_t size() const { return workers.size(); }
+
+    /**
+     * @fn ~task_pool
+     * @brief Destructor of the class, runs the queued tasks and stops the
+     *        workers.
+     */
+    ~task_pool();
+
+    task_pool(const task_pool &) = delete;
+    task_pool &operator=(const task_pool &) = delete;
+
+    private:
+    /**
+     * @brief Tasks of a single worker, the owner pops the back and thieves
+     *        take the front.
+     */
+    struct task_deque {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    /**
+     * @fn run_worker
+     * @brief Main loop of worker 'self'.
+     */
+    void run_worker(size_t self);
+
+    /**
+     * @fn take
+     * @brief Pops a task of worker 'self' or steals one from the others.
+     *
+     * @return true if 'task' was set, false if every deque was empty.
+     */
+    bool take(size_t self, std::function<void()> &task);
+
+    /**
+     * @param deques - Tasks of every worker.
+     * @param workers - The worker threads.
+     * @param next_deque - Round-robin position of outside submissions.
+     * @param queued - Tasks waiting in the deques.
+     * @param unfinished - Tasks submitted and not run yet.
+     * @param stopping - Set by the destructor once all tasks ran.
+     * @param mutex, work_ready, all_done - Sleeping workers and 'wait'.
+     */
+    std::vector<std::unique_ptr<task_deque> > deques;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next_deque;
+    size_t queued;
+    size_t unfinished;
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable all_done;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file trace_reader.hpp
+ * @brief This header defines the packet file reader shared by every flow of
+ *        the NIC simulation project.
+ */
+
+#ifndef __TRACE_READER__
+#define __TRACE_READER__
+
+#include <fstream>
+#include <string>
+#include "common.hpp"
+#include "mapped_file.hpp"
+
+/**
+ * @fn read_trace
+ * @brief Calls 'fn' with every non-empty line of a packet file.
+ *
+ * @param path - Name of the packet file.
+ * @param mode - INGEST_MMAP to parse from the mapped pages (falls back to
+ *        INGEST_STREAM if the file can't be mapped) or INGEST_STREAM.
+ * @param fn - Callable taking (common::field_view line, bool persistent).
+ *        'persistent' is true if the line stays valid until 'end' returns,
+ *        false if it is only valid during the call.
+ * @param end - Callable run after the last line, while persistent lines are
+ *        still valid (e.g to wait for threads still reading them).
+ *
+ * @return true if the file was read, false if it can't be opened.
+ */
+template <typename Fn, typename End>
+bool read_trace(const std::string &path, common::ingest_mode mode,
+                Fn fn, End end) {
+    if (mode == common::INGEST_MMAP) {
+        mapped_file mapping(path);
+        if (mapping.is_mapped()) {
+            for_each_line(mapping.contents(), [&fn](common::field_view line) {
+                fn(line, true);
+            });
+            end();
+            return true;
+        }
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.resize(line.size() - 1);
+        }
+        if (!line.empty()) {
+            fn(common::field_view(line), false);
+        }
+    }
+    end();
+    return true;
+}
+
+#endif
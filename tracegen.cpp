@@ -0,0 +1,173 @@
+/**
+ * @file tracegen.cpp
+ * @brief This C++ file contains the trace generator tool of the NIC
+ *        simulation project.
+ *
+ * Writes a synthetic packet trace of any size for the NIC described by a
+ * param file. The composition of the trace is set by the options below, the
+ * same options and seed always give the same trace.
+ *
+ * Usage: tracegen.exe [options] <param_file>
+ *
+ *        --packets=N      Amount of packets (default 1000).
+ *        --seed=N         Seed of the generator (default 1).
+ *        --output=path    Trace file, stdout if not given.
+ *        --layers=A:B:C   Relative amount of L2:L3:L4 packets (default 1:1:1).
+ *        --mac-hit=P      % of L2 packets sent to the NIC's MAC.
+ *        --nic-dst=P      % of L2/L3 packets sent to the NIC's IP.
+ *        --local-dst=P    % of the other L2/L3 packets sent to the subnet.
+ *        --local-src=P    % of L2/L3 packets sent from the subnet.
+ *        --port-hit=P     % of L4 and NIC-targeted packets on open ports.
+ *        --ttl-expired=P  % of L2/L3 packets with TTL 0.
+ *        --index-max=N    Indices are uniform in [0, N) (default 64).
+ */
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "result_writer.hpp"
+#include "traffic_gen.hpp"
+
+namespace {
+    /* Size of the text handed to the writer at once. */
+    const size_t CHUNK_SIZE = 1 << 20;
+
+    /**
+     * @fn parse_number
+     * @brief Parses the value of a "--name=N" option, at most 'max'.
+     *
+     * @return true on success, false if the value is invalid.
+     */
+    bool parse_number(const char *value, uint32_t max, uint32_t &out) {
+        return common::parse_uint(common::field_view(value, std::strlen(value)),
+                                  max, out) == common::PARSE_OK;
+    }
+
+    /**
+     * @fn parse_layers
+     * @brief Parses the value of --layers ("A:B:C").
+     *
+     * @return true on success, false if the value is invalid.
+     */
+    bool parse_layers(const char *value, traffic_mix &mix) {
+        common::field_tokenizer weights(common::field_view(value, std::strlen(value)), ':');
+        uint32_t *targets[] = {&mix.l2_weight, &mix.l3_weight, &mix.l4_weight};
+        common::field_view weight;
+        for (uint32_t *target : targets) {
+            if (!weights.next(weight) ||
+                common::parse_uint(weight, 1000000, *target) != common::PARSE_OK) {
+                return false;
+            }
+        }
+        return weights.done() &&
+               mix.l2_weight + mix.l3_weight + mix.l4_weight > 0;
+    }
+
+    /**
+     * @fn parse_option
+     * @brief Applies a single "--name=value" command line option.
+     *
+     * @return true if the option is known and valid, false otherwise.
+     */
+    bool parse_option(const char *arg, traffic_mix &mix, uint32_t &packets,
+                      uint32_t &seed, std::string &output) {
+        static const struct {
+            const char *name;
+            uint32_t traffic_mix::*share;
+        } shares[] = {
+            {"--mac-hit=", &traffic_mix::mac_hit},
+            {"--nic-dst=", &traffic_mix::nic_dst},
+            {"--local-dst=", &traffic_mix::local_dst},
+            {"--local-src=", &traffic_mix::local_src},
+            {"--port-hit=", &traffic_mix::port_hit},
+            {"--ttl-expired=", &traffic_mix::ttl_expired},
+        };
+        for (const auto &share : shares) {
+            size_t len = std::strlen(share.name);
+            if (std::strncmp(arg, share.name, len) == 0) {
+                return parse_number(arg + len, 100, mix.*share.share);
+            }
+        }
+
+        if (std::strncmp(arg, "--packets=", 10) == 0) {
+            return parse_number(arg + 10, 0xFFFFFFFFu, packets);
+        }
+        if (std::strncmp(arg, "--seed=", 7) == 0) {
+            return parse_number(arg + 7, 0xFFFFFFFFu, seed);
+        }
+        if (std::strncmp(arg, "--index-max=", 12) == 0) {
+            return parse_number(arg + 12, 65536, mix.index_max) && mix.index_max > 0;
+        }
+        if (std::strncmp(arg, "--layers=", 9) == 0) {
+            return parse_layers(arg + 9, mix);
+        }
+        if (std::strncmp(arg, "--output=", 9) == 0 && arg[9] != '\0') {
+            output = arg + 9;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @fn generate
+     * @brief Writes 'packets' packets drawn from 'mix'.
+     *
+     * @return true on success, false on an I/O error.
+     */
+    bool generate(result_writer &out, traffic_gen &gen, const traffic_mix &mix,
+                  uint32_t packets) {
+        std::string chunk;
+        chunk.reserve(CHUNK_SIZE + 1024);
+        for (uint32_t p = 0; p < packets; p++) {
+            gen.append_mixed(mix, chunk);
+            if (chunk.size() >= CHUNK_SIZE) {
+                out.put(chunk);
+                chunk.clear();
+            }
+        }
+        out.put(chunk);
+        return out.flush();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    traffic_mix mix;
+    uint32_t packets = 1000;
+    uint32_t seed = 1;
+    std::string output;
+    std::string param_file;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--", 2) != 0 && param_file.empty()) {
+            param_file = argv[i];
+        } else if (!parse_option(argv[i], mix, packets, seed, output)) {
+            std::cerr << "Error: Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (param_file.empty()) {
+        std::cerr << "Usage: tracegen.exe [options] <param_file>" << std::endl;
+        return 1;
+    }
+
+    nic_params nic;
+    if (!traffic_gen::read_params(param_file, nic)) {
+        std::cerr << "Error: Could not read parameter file: " << param_file << std::endl;
+        return 1;
+    }
+    traffic_gen gen(nic, seed);
+
+    bool written;
+    if (output.empty()) {
+        result_writer out(1);
+        written = generate(out, gen, mix, packets);
+    } else {
+        result_writer out(output);
+        written = out.is_open() && generate(out, gen, mix, packets);
+    }
+    if (!written) {
+        std::cerr << "Error: Could not write the trace" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,412 @@
+/**
+ * @file traffic_gen.cpp
+ * @brief Implementation of the synthetic traffic generator of the NIC
+ *        simulation project.
+ */
+
+#include "traffic_gen.hpp"
+#include "checksum.hpp"
+#include "hex_decode.hpp"
+#include <algorithm>
+#include <fstream>
+
+namespace {
+    const char HEX_DIGITS[] = "0123456789abcdef";
+
+    /**
+     * @fn flow_key
+     * @brief Packs a (src_port, dst_port) pair.
+     */
+    uint32_t flow_key(uint16_t src_port, uint16_t dst_port) {
+        return (static_cast<uint32_t>(src_port) << 16) | dst_port;
+    }
+
+    /**
+     * @fn prefix_mask
+     * @brief Mask byte of octet 'i' of a /'mask' network.
+     */
+    uint8_t prefix_mask(int i, uint8_t mask) {
+        if (i < mask / 8) return 0xFF;
+        if (i > mask / 8 || mask % 8 == 0) return 0x00;
+        return static_cast<uint8_t>(0xFF << (8 - mask % 8));
+    }
+
+    /**
+     * @fn append_ip
+     * @brief Appends an IP address in dotted decimal.
+     */
+    void append_ip(std::string &out, const uint8_t ip[common::IP_V4_SIZE]) {
+        for (int i = 0; i < common::IP_V4_SIZE; i++) {
+            if (i > 0) out += '.';
+            common::append_uint(out, ip[i]);
+        }
+    }
+
+    /**
+     * @fn append_mac
+     * @brief Appends a MAC address as ':' separated 2-digit hex bytes.
+     */
+    void append_mac(std::string &out, const uint8_t mac[common::MAC_SIZE]) {
+        for (int i = 0; i < common::MAC_SIZE; i++) {
+            if (i > 0) out += ':';
+            out += HEX_DIGITS[mac[i] >> 4];
+            out += HEX_DIGITS[mac[i] & 0x0F];
+        }
+    }
+
+    /**
+     * @fn append_hex16
+     * @brief Appends a 16-bit value in hex without leading zeros.
+     */
+    void append_hex16(std::string &out, uint16_t value) {
+        bool started = false;
+        for (int shift = 12; shift >= 0; shift -= 4) {
+            int digit = (value >> shift) & 0x0F;
+            if (digit != 0 || started || shift == 0) {
+                out += HEX_DIGITS[digit];
+                started = true;
+            }
+        }
+    }
+
+    /**
+     * @fn read_ports
+     * @brief Parses a "src_prt:X, dst_port:Y" param file line.
+     *
+     * @return true on success, false if the line isn't one.
+     */
+    bool read_ports(common::field_view line, uint16_t &src_port, uint16_t &dst_port) {
+        static const char src_key[] = "src_prt:";
+        static const char dst_key[] = ", dst_port:";
+        const size_t src_len = sizeof(src_key) - 1;
+        const size_t dst_len = sizeof(dst_key) - 1;
+
+        size_t comma = line.find(',');
+        if (line.size() < src_len || std::string(line.ptr, src_len) != src_key ||
+            comma == common::field_view::npos ||
+            line.substr(comma, dst_len).str() != dst_key) {
+            return false;
+        }
+        return common::parse_u16(line.substr(src_len, comma - src_len), src_port) == common::PARSE_OK &&
+               common::parse_u16(line.substr(comma + dst_len), dst_port) == common::PARSE_OK;
+    }
+}
+
+traffic_gen::traffic_gen(const nic_params &nic, uint64_t seed)
+    : nic(nic), state(seed) {
+    for (size_t i = 0; i < nic.ports.size(); i++) {
+        open.insert(flow_key(nic.ports[i].first, nic.ports[i].second));
+    }
+}
+
+uint64_t traffic_gen::next() {
+    // splitmix64, fully specified so traces don't depend on the library
+    state += 0x9E3779B97F4A7C15ull;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+uint32_t traffic_gen::below(uint32_t bound) {
+    return static_cast<uint32_t>(((next() >> 32) * bound) >> 32);
+}
+
+bool traffic_gen::chance(uint32_t percent) {
+    return below(100) < percent;
+}
+
+void traffic_gen::random_ip(uint8_t ip[common::IP_V4_SIZE], bool local) {
+    // A /32 subnet holds nothing but the NIC
+    if (nic.mask >= 32) {
+        local = false;
+    }
+    do {
+        for (int i = 0; i < common::IP_V4_SIZE; i++) {
+            uint8_t net = prefix_mask(i, nic.mask);
+            uint8_t host = static_cast<uint8_t>(next());
+            ip[i] = static_cast<uint8_t>((nic.ip[i] & net) | (host & ~net));
+        }
+        if (!local) {
+            // Leave the subnet by flipping the first bit of the prefix
+            ip[0] ^= 0x80;
+        }
+    } while (local && std::equal(ip, ip + common::IP_V4_SIZE, nic.ip));
+}
+
+void traffic_gen::random_ports(bool is_open, uint16_t &src_port, uint16_t &dst_port) {
+    if (is_open && !nic.ports.empty()) {
+        const std::pair<uint16_t, uint16_t> &port =
+            nic.ports[below(static_cast<uint32_t>(nic.ports.size()))];
+        src_port = port.first;
+        dst_port = port.second;
+        return;
+    }
+    do {
+        src_port = static_cast<uint16_t>(next());
+        dst_port = static_cast<uint16_t>(next());
+    } while (open.count(flow_key(src_port, dst_port)) != 0);
+}
+
+void traffic_gen::append_l4_text(uint32_t index_max, std::string &out) {
+    // Format: index|data
+    common::append_uint(out, below(index_max));
+    out += '|';
+    for (int i = 0; i < common::PACKET_DATA_SIZE; i++) {
+        payload[i] = static_cast<uint8_t>(next());
+    }
+    common::append_hex_payload(out, payload, common::PACKET_DATA_SIZE);
+}
+
+void traffic_gen::append_l4(bool port_open, uint32_t index_max, std::string &out) {
+    // Format: src_port|dst_port|index|data
+    uint16_t src_port, dst_port;
+    random_ports(port_open, src_port, dst_port);
+    common::append_uint(out, src_port);
+    out += '|';
+    common::append_uint(out, dst_port);
+    out += '|';
+    append_l4_text(index_max, out);
+}
+
+void traffic_gen::append_l3(const l3_shape &shape, std::string &out) {
+    // Format: src_ip|dst_ip|ttl|checksum|src_port|dst_port|index|data
+    uint8_t src_ip[common::IP_V4_SIZE];
+    uint8_t dst_ip[common::IP_V4_SIZE];
+    random_ip(src_ip, shape.src_local);
+    if (shape.dst == DST_NIC) {
+        std::copy(nic.ip, nic.ip + common::IP_V4_SIZE, dst_ip);
+    } else {
+        random_ip(dst_ip, shape.dst == DST_LOCAL);
+    }
+    uint8_t ttl = shape.ttl_expired ? 0 : static_cast<uint8_t>(2 + below(254));
+
+    uint16_t src_port, dst_port;
+    random_ports(shape.port_open, src_port, dst_port);
+
+    // The L3 checksum covers the "index|data" text
+    l4_text.clear();
+    append_l4_text(shape.index_max, l4_text);
+    uint32_t checksum = common::checksum_bytes(src_ip, common::IP_V4_SIZE) +
+                        common::checksum_bytes(dst_ip, common::IP_V4_SIZE) +
+                        ttl + src_port + dst_port + common::checksum_text(l4_text);
+
+    append_ip(out, src_ip);
+    out += '|';
+    append_ip(out, dst_ip);
+    out += '|';
+    common::append_uint(out, ttl);
+    out += '|';
+    common::append_uint(out, checksum & 0xFFFF);
+    out += '|';
+    common::append_uint(out, src_port);
+    out += '|';
+    common::append_uint(out, dst_port);
+    out += '|';
+    out += l4_text;
+}
+
+void traffic_gen::append_l2(bool mac_hit, const l3_shape &shape, std::string &out) {
+    // Format: src_mac|dst_mac|<L3 packet>|checksum (hex)
+    uint8_t src_mac[common::MAC_SIZE];
+    uint8_t dst_mac[common::MAC_SIZE];
+    for (int i = 0; i < common::MAC_SIZE; i++) {
+        src_mac[i] = static_cast<uint8_t>(next());
+        dst_mac[i] = nic.mac[i];
+    }
+    if (!mac_hit) {
+        dst_mac[0] ^= 0x02;
+    }
+
+    // The L2 checksum covers the text of the L3 packet
+    l3_text.clear();
+    append_l3(shape, l3_text);
+    uint32_t checksum = common::checksum_bytes(src_mac, common::MAC_SIZE) +
+                        common::checksum_bytes(dst_mac, common::MAC_SIZE) +
+                        common::checksum_text(l3_text);
+
+    append_mac(out, src_mac);
+    out += '|';
+    append_mac(out, dst_mac);
+    out += '|';
+    out += l3_text;
+    out += '|';
+    append_hex16(out, static_cast<uint16_t>(checksum & 0xFFFF));
+}
+
+bool traffic_gen::append_packet(common::packet_layer layer,
+                                traffic_outcome outcome, std::string &out) {
+    l3_shape shape;
+    shape.src_local = below(2) == 0;
+    shape.dst = DST_REMOTE;
+    shape.ttl_expired = false;
+    shape.port_open = false;
+    shape.index_max = common::DATA_ARR_SIZE;
+
+    switch (outcome) {
+        case OUTCOME_RQ:
+            // Incoming to the local network, not to the NIC itself
+            if (layer == common::LAYER_L4 || nic.mask >= 32) return false;
+            shape.src_local = false;
+            shape.dst = DST_LOCAL;
+            break;
+        case OUTCOME_TQ:
+            if (layer == common::LAYER_L4 || nic.mask == 0) return false;
+            break;
+        case OUTCOME_DRAM:
+            if (nic.ports.empty()) return false;
+            shape.dst = DST_NIC;
+            shape.port_open = true;
+            break;
+        case OUTCOME_DROP:
+            // L4 drops miss the open ports, L3 drops are expired, L2 drops
+            // are for a foreign MAC and carry a valid L3 packet
+            shape.ttl_expired = (layer == common::LAYER_L3);
+            break;
+    }
+
+    switch (layer) {
+        case common::LAYER_L2:
+            append_l2(outcome != OUTCOME_DROP, shape, out);
+            break;
+        case common::LAYER_L3:
+            append_l3(shape, out);
+            break;
+        case common::LAYER_L4:
+            append_l4(shape.port_open, shape.index_max, out);
+            break;
+        case common::LAYER_AUTO:
+            return false;
+    }
+    out += '\n';
+    return true;
+}
+
+void traffic_gen::append_mixed(const traffic_mix &mix, std::string &out) {
+    uint32_t total = mix.l2_weight + mix.l3_weight + mix.l4_weight;
+    uint32_t pick = below(total > 0 ? total : 1);
+    uint32_t index_max = mix.index_max > 0 ? mix.index_max : 1;
+
+    if (total == 0 || pick >= mix.l2_weight + mix.l3_weight) {
+        append_l4(chance(mix.port_hit), index_max, out);
+        out += '\n';
+        return;
+    }
+
+    l3_shape shape;
+    shape.src_local = chance(mix.local_src);
+    if (chance(mix.nic_dst)) {
+        shape.dst = DST_NIC;
+    } else {
+        shape.dst = chance(mix.local_dst) ? DST_LOCAL : DST_REMOTE;
+    }
+    shape.ttl_expired = chance(mix.ttl_expired);
+    shape.port_open = chance(mix.port_hit);
+    shape.index_max = index_max;
+
+    if (pick < mix.l2_weight) {
+        append_l2(chance(mix.mac_hit), shape, out);
+    } else {
+        append_l3(shape, out);
+    }
+    out += '\n';
+}
+
+bool traffic_gen::read_params(const std::string &path, nic_params &nic) {
+    std::ifstream file(path.c_str());
+    std::string line;
+    nic.ports.clear();
+
+    // MAC address
+    if (!std::getline(file, line) ||
+        common::parse_address(common::field_view(line), ':', 16, nic.mac,
+                              common::MAC_SIZE) != common::PARSE_OK) {
+        return false;
+    }
+
+    // IP address and mask
+    if (!std::getline(file, line)) {
+        return false;
+    }
+    common::field_view address(line);
+    size_t slash = address.find('/');
+    if (slash == common::field_view::npos ||
+        common::parse_address(address.substr(0, slash), '.', 10, nic.ip,
+                              common::IP_V4_SIZE) != common::PARSE_OK ||
+        common::parse_u8(address.substr(slash + 1), nic.mask) != common::PARSE_OK ||
+        nic.mask > 32) {
+        return false;
+    }
+
+    // Open communications, other lines are ignored like the NIC does
+    while (std::getline(file, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.resize(line.size() - 1);
+        }
+        uint16_t src_port, dst_port;
+        if (read_ports(common::field_view(line), src_port, dst_port)) {
+            nic.ports.push_back(std::make_pair(src_port, dst_port));
+        }
+    }
+    return true;
+}
+
+nic_params traffic_gen::make_params(size_t ports, uint64_t seed) {
+    static const uint8_t mac[common::MAC_SIZE] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+    static const uint8_t ip[common::IP_V4_SIZE] = {192, 168, 10, 0};
+
+    nic_params nic;
+    std::copy(mac, mac + common::MAC_SIZE, nic.mac);
+    std::copy(ip, ip + common::IP_V4_SIZE, nic.ip);
+    nic.mask = 20;
+
+    traffic_gen gen(nic, seed);
+    std::unordered_set<uint32_t> taken;
+    if (ports > 65536) {
+        ports = 65536;
+    }
+    while (nic.ports.size() < ports) {
+        uint16_t src_port = static_cast<uint16_t>(gen.next());
+        uint16_t dst_port = static_cast<uint16_t>(gen.next());
+        if (taken.insert(flow_key(src_port, dst_port)).second) {
+            nic.ports.push_back(std::make_pair(src_port, dst_port));
+        }
+    }
+    return nic;
+}
+
+void traffic_gen::append_params(const nic_params &nic, std::string &out) {
+    append_mac(out, nic.mac);
+    out += '\n';
+    append_ip(out, nic.ip);
+    out += '/';
+    common::append_uint(out, nic.mask);
+    out += '\n';
+    for (size_t i = 0; i < nic.ports.size(); i++) {
+        out += "src_prt:";
+        common::append_uint(out, nic.ports[i].first);
+        out += ", dst_port:";
+        common::append_uint(out, nic.ports[i].second);
+        out += '\n';
+    }
+}
+
+const char *traffic_gen::outcome_name(traffic_outcome outcome) {
+    switch (outcome) {
+        case OUTCOME_RQ: return "RQ";
+        case OUTCOME_TQ: return "TQ";
+        case OUTCOME_DRAM: return "DRAM";
+        case OUTCOME_DROP: return "DROP";
+    }
+    return "?";
+}
+
+const char *traffic_gen::layer_name(common::packet_layer layer) {
+    switch (layer) {
+        case common::LAYER_L2: return "L2";
+        case common::LAYER_L3: return "L3";
+        case common::LAYER_L4: return "L4";
+        case common::LAYER_AUTO: return "auto";
+    }
+    return "?";
+}
@@ -0,0 +1,200 @@
+/**
+ * @file traffic_gen.hpp
+ * @brief This header defines the synthetic traffic generator of the NIC
+ *        simulation project, used by the benchmark harness.
+ *
+ * The generator writes packet lines in the trace format read by 'nic_flow'
+ * for a given set of NIC parameters. A packet is either built to end in a
+ * chosen routing outcome (used by the benchmark harness) or drawn from a
+ * 'traffic_mix' (used by the trace generator tool). It is deterministic: the
+ * same seed gives the same trace on every platform.
+ */
+
+#ifndef __TRAFFIC_GEN__
+#define __TRAFFIC_GEN__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "common.hpp"
+
+/* Where a generated packet ends up. */
+enum traffic_outcome {
+    OUTCOME_RQ = 0,
+    OUTCOME_TQ,
+    OUTCOME_DRAM,
+    OUTCOME_DROP
+};
+
+/**
+ * @brief NIC parameters of a generated trace, the content of a param file.
+ * @param mac - NIC's MAC address.
+ * @param ip - NIC's IP address.
+ * @param mask - NIC's subnet mask (prefix length).
+ * @param ports - Open communications as (src_prt, dst_prt) pairs.
+ */
+struct nic_params {
+    uint8_t mac[common::MAC_SIZE];
+    uint8_t ip[common::IP_V4_SIZE];
+    uint8_t mask;
+    std::vector<std::pair<uint16_t, uint16_t> > ports;
+};
+
+/**
+ * @brief Composition of a mixed trace. Shares are in percent.
+ * @param l2_weight, l3_weight, l4_weight - Relative amount of packets of
+ *        every layer.
+ * @param mac_hit - Share of L2 packets sent to the NIC's MAC address.
+ * @param nic_dst - Share of L2/L3 packets sent to the NIC's IP address.
+ * @param local_dst - Share of the other L2/L3 packets sent to the local
+ *        subnet, the rest goes to remote addresses.
+ * @param local_src - Share of L2/L3 packets sent from the local subnet.
+ * @param port_hit - Share of L4 and NIC-targeted packets whose ports are an
+ *        open communication.
+ * @param ttl_expired - Share of L2/L3 packets with a TTL of 0.
+ * @param index_max - Indices are drawn uniformly from [0, index_max), values
+ *        over DATA_ARR_SIZE give out-of-range indices.
+ */
+struct traffic_mix {
+    uint32_t l2_weight;
+    uint32_t l3_weight;
+    uint32_t l4_weight;
+    uint32_t mac_hit;
+    uint32_t nic_dst;
+    uint32_t local_dst;
+    uint32_t local_src;
+    uint32_t port_hit;
+    uint32_t ttl_expired;
+    uint32_t index_max;
+
+    traffic_mix() : l2_weight(1), l3_weight(1), l4_weight(1), mac_hit(90),
+                    nic_dst(30), local_dst(30), local_src(50), port_hit(80),
+                    ttl_expired(5), index_max(common::DATA_ARR_SIZE) {}
+};
+
+class traffic_gen {
+    public:
+    /**
+     * @fn traffic_gen
+     * @brief Constructor of the class.
+     *
+     * @param nic - Parameters of the NIC the traffic is sent to, must stay
+     *        alive as long as the generator.
+     * @param seed - Seed of the generator.
+     *
+     * @return New generator object.
+     */
+    traffic_gen(const nic_params &nic, uint64_t seed);
+
+    /**
+     * @fn append_packet
+     * @brief Appends a packet line (with its '\n') that ends in 'outcome'.
+     *
+     * @param layer - Outermost layer of the packet, not LAYER_AUTO.
+     * @param outcome - Routing outcome of the packet.
+     * @param out - Trace to append to.
+     *
+     * @return true on success, false if no such packet exists (e.g an L4
+     *         packet can't be queued, a NIC without open ports can't be
+     *         written to DRAM).
+     */
+    bool append_packet(common::packet_layer layer, traffic_outcome outcome,
+                       std::string &out);
+
+    /**
+     * @fn append_mixed
+     * @brief Appends a packet line (with its '\n') drawn from 'mix'.
+     *
+     * @return None.
+     */
+    void append_mixed(const traffic_mix &mix, std::string &out);
+
+    /**
+     * @fn read_params
+     * @brief Reads NIC parameters from a param file.
+     *
+     * @param [in] path - Name of the param file.
+     * @param [out] nic - The parameters.
+     *
+     * @return true on success, false if the file can't be read or parsed.
+     */
+    static bool read_params(const std::string &path, nic_params &nic);
+
+    /**
+     * @fn make_params
+     * @brief Creates NIC parameters with 'ports' distinct open communications.
+     *
+     * @param ports - Amount of open communications, at most 65536.
+     * @param seed - Seed of the port numbers.
+     *
+     * @return The parameters, the NIC is 01:02:03:04:05:06 at 192.168.10.0/20.
+     */
+    static nic_params make_params(size_t ports, uint64_t seed);
+
+    /**
+     * @fn append_params
+     * @brief Appends NIC parameters in the param file format.
+     *
+     * @return None.
+     */
+    static void append_params(const nic_params &nic, std::string &out);
+
+    /**
+     * @fn outcome_name
+     * @brief Name of an outcome ("RQ", "TQ", "DRAM", "DROP").
+     */
+    static const char *outcome_name(traffic_outcome outcome);
+
+    /**
+     * @fn layer_name
+     * @brief Name of a layer ("L2", "L3", "L4", "auto").
+     */
+    static const char *layer_name(common::packet_layer layer);
+
+    private:
+    /* Destination address of a generated L3 packet. */
+    enum l3_dst {
+        DST_NIC = 0,
+        DST_LOCAL,
+        DST_REMOTE
+    };
+
+    /**
+     * @brief Everything that decides the fate of an L3 packet.
+     */
+    struct l3_shape {
+        bool src_local;
+        l3_dst dst;
+        bool ttl_expired;
+        bool port_open;
+        uint32_t index_max;
+    };
+
+    uint64_t next();
+    uint32_t below(uint32_t bound);
+    bool chance(uint32_t percent);
+    void random_ip(uint8_t ip[common::IP_V4_SIZE], bool local);
+    void random_ports(bool open, uint16_t &src_port, uint16_t &dst_port);
+    void append_l4_text(uint32_t index_max, std::string &out);
+    void append_l4(bool port_open, uint32_t index_max, std::string &out);
+    void append_l3(const l3_shape &shape, std::string &out);
+    void append_l2(bool mac_hit, const l3_shape &shape, std::string &out);
+
+    /**
+     * @param nic - Parameters of the NIC.
+     * @param state - State of the random generator.
+     * @param open - Flow keys of the open communications.
+     * @param payload - Buffer reused to build payloads.
+     * @param l3_text, l4_text - Buffers reused to build checksummed text.
+     */
+    const nic_params &nic;
+    uint64_t state;
+    std::unordered_set<uint32_t> open;
+    uint8_t payload[common::PACKET_DATA_SIZE];
+    std::string l3_text;
+    std::string l4_text;
+};
+
+#endif
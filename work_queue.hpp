@@ -0,0 +1,95 @@
+/**
+ * @file work_queue.hpp
+ * @brief This header defines a blocking FIFO used to hand work between the
+ *        threads of the NIC simulation project.
+ */
+
+#ifndef __WORK_QUEUE__
+#define __WORK_QUEUE__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template <typename T>
+class work_queue {
+    public:
+    work_queue() : closed(false) {}
+
+    /**
+     * @fn push
+     * @brief Adds an item and wakes up one waiting consumer.
+     *
+     * @return None.
+     */
+    void push(const T &item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            items.push_back(item);
+        }
+        ready.notify_one();
+    }
+
+    /**
+     * @fn pop
+     * @brief Takes the oldest item, waiting for one if the queue is empty.
+     *
+     * @param [out] item - The item taken.
+     *
+     * @return true if an item was taken, false if the queue is closed and
+     *         empty.
+     */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (items.empty() && !closed) {
+            ready.wait(lock);
+        }
+        if (items.empty()) {
+            return false;
+        }
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    /**
+     * @fn try_pop
+     * @brief Takes the oldest item if there is one, without waiting.
+     *
+     * @param [out] item - The item taken.
+     *
+     * @return true if an item was taken, false if the queue is empty.
+     */
+    bool try_pop(T &item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) {
+            return false;
+        }
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    /**
+     * @fn close
+     * @brief Marks the end of the input, consumers drain what is left and
+     *        then 'pop' returns false.
+     *
+     * @return None.
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+    private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<T> items;
+    bool closed;
+};
+
+#endif